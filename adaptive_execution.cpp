@@ -0,0 +1,178 @@
+#include "adaptive_execution.h"
+#include "search_server.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+namespace {
+atomic<size_t> parallel_terms_min_postings{static_cast<size_t>(-1)};
+atomic<size_t> sharded_min_postings{static_cast<size_t>(-1)};
+atomic<size_t> parallel_remove_min_words{static_cast<size_t>(-1)};
+atomic<bool> thresholds_set{false};
+once_flag calibration_flag;
+
+void StoreThresholds(const ExecutionThresholds& thresholds) {
+    parallel_terms_min_postings.store(thresholds.parallel_terms_min_postings, memory_order_relaxed);
+    sharded_min_postings.store(thresholds.sharded_min_postings, memory_order_relaxed);
+    parallel_remove_min_words.store(thresholds.parallel_remove_min_words, memory_order_relaxed);
+}
+// median of several runs, nanoseconds
+template <typename Operation>
+int64_t MeasureMedian(Operation operation) {
+    using Clock = chrono::steady_clock;
+    vector<int64_t> times;
+    for (int run = 0; run < 5; ++run) {
+        const auto start = Clock::now();
+        operation();
+        times.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+// parallel path has to win clearly to be chosen
+bool IsParallelFaster(int64_t sequential_ns, int64_t parallel_ns) {
+    return parallel_ns * 5 < sequential_ns * 4;
+}
+struct Measurement {
+    size_t postings;
+    int64_t sequential_ns;
+    int64_t parallel_ns;
+};
+// both costs are taken as linear in postings through the two largest measurements,
+// the crossover is where the parallel path wins by the margin of IsParallelFaster;
+// it stays above the largest measured size, which the parallel path did not win
+size_t ExtrapolateCrossover(const Measurement& smaller, const Measurement& larger) {
+    const double size_difference = static_cast<double>(larger.postings - smaller.postings);
+    const double sequential_slope = (larger.sequential_ns - smaller.sequential_ns) / size_difference;
+    const double parallel_slope = (larger.parallel_ns - smaller.parallel_ns) / size_difference;
+    const double sequential_base = larger.sequential_ns - sequential_slope * larger.postings;
+    const double parallel_base = larger.parallel_ns - parallel_slope * larger.postings;
+    const double slope_difference = sequential_slope * 4 - parallel_slope * 5;
+    if (slope_difference <= 0.0) {
+        // a parallel posting is not cheaper enough, the parallel path never catches up
+        return static_cast<size_t>(-1);
+    }
+    const double crossover = (parallel_base * 5 - sequential_base * 4) / slope_difference;
+    if (crossover >= 1e18) {
+        return static_cast<size_t>(-1);
+    }
+    return max(larger.postings + 1, static_cast<size_t>(max(crossover, 0.0)) + 1);
+}
+}
+ExecutionThresholds GetExecutionThresholds() {
+    call_once(calibration_flag, [] {
+        if (!thresholds_set.load()) {
+            StoreThresholds(CalibrateExecutionThresholds());
+        }
+    });
+    return {parallel_terms_min_postings.load(memory_order_relaxed),
+            sharded_min_postings.load(memory_order_relaxed),
+            parallel_remove_min_words.load(memory_order_relaxed)};
+}
+void SetExecutionThresholds(const ExecutionThresholds& thresholds) {
+    thresholds_set.store(true);
+    StoreThresholds(thresholds);
+}
+ExecutionThresholds CalibrateExecutionThresholds() {
+    ExecutionThresholds thresholds;
+    if (thread::hardware_concurrency() < 2) {
+        return thresholds;
+    }
+    // word l<level>_<k> is contained in documents with (id + k) % 4^level == 0,
+    // so every posting list of level is DOCUMENT_COUNT / 4^level long
+    const int document_count = 1 << 13;
+    const int level_count = 5;
+    SearchServer search_server(""s);
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        int period = 1;
+        for (int level = 0; level < level_count; ++level, period *= 4) {
+            for (int k = 0; k < 4; ++k) {
+                if ((id + k) % period == 0) {
+                    text += "l"s + to_string(level) + "_"s + to_string(k) + " "s;
+                }
+            }
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 10});
+    }
+    // from the shortest lists to the longest ones
+    vector<Measurement> single_measurements;
+    vector<Measurement> four_measurements;
+    for (int level = level_count - 1; level >= 0; --level) {
+        const size_t postings = static_cast<size_t>(document_count) >> (2 * level);
+        const string prefix = "l"s + to_string(level) + "_"s;
+        const string single_word = prefix + "0"s;
+        const string four_words = single_word + " "s + prefix + "1 "s + prefix + "2 "s + prefix + "3"s;
+        // crossovers are recorded in these sizes, so they have to be the measured ones
+        if (search_server.EstimateQueryCost(single_word) != postings || search_server.EstimateQueryCost(four_words) != postings * 4) {
+            throw logic_error("calibration posting lists of level "s + to_string(level) + " have unexpected length"s);
+        }
+        const int64_t sequential_single = MeasureMedian([&] {
+            search_server.FindTopDocuments(ExecutionMode::SEQUENTIAL, single_word);
+        });
+        const int64_t sharded_single = MeasureMedian([&] {
+            search_server.FindTopDocuments(ExecutionMode::SHARDED, single_word);
+        });
+        single_measurements.push_back({postings, sequential_single, sharded_single});
+        if (thresholds.sharded_min_postings == static_cast<size_t>(-1) && IsParallelFaster(sequential_single, sharded_single)) {
+            thresholds.sharded_min_postings = postings;
+        }
+        const int64_t sequential_four = MeasureMedian([&] {
+            search_server.FindTopDocuments(ExecutionMode::SEQUENTIAL, four_words);
+        });
+        const int64_t parallel_four = MeasureMedian([&] {
+            search_server.FindTopDocuments(ExecutionMode::PARALLEL_TERMS, four_words);
+        });
+        four_measurements.push_back({postings * 4, sequential_four, parallel_four});
+        if (thresholds.parallel_terms_min_postings == static_cast<size_t>(-1) && IsParallelFaster(sequential_four, parallel_four)) {
+            thresholds.parallel_terms_min_postings = postings * 4;
+        }
+    }
+    // lists of the synthetic index can be too short for a crossover, then it is
+    // extrapolated, so long queries of a real index still go parallel
+    if (thresholds.sharded_min_postings == static_cast<size_t>(-1)) {
+        thresholds.sharded_min_postings = ExtrapolateCrossover(single_measurements[level_count - 2], single_measurements[level_count - 1]);
+    }
+    if (thresholds.parallel_terms_min_postings == static_cast<size_t>(-1)) {
+        thresholds.parallel_terms_min_postings = ExtrapolateCrossover(four_measurements[level_count - 2], four_measurements[level_count - 1]);
+    }
+    // every document has its own words, forward index of level is 32 * 4^level words
+    SearchServer remove_server(""s);
+    const int documents_per_level = 10;
+    for (int level = 0; level < 4; ++level) {
+        const int word_count = 32 << (2 * level);
+        for (int i = 0; i < documents_per_level; ++i) {
+            const int id = level * documents_per_level + i;
+            string text;
+            for (int k = 0; k < word_count; ++k) {
+                text += "d"s + to_string(id) + "_"s + to_string(k) + " "s;
+            }
+            remove_server.AddDocument(id, text, DocumentStatus::ACTUAL, {});
+        }
+    }
+    for (int level = 0; level < 4; ++level) {
+        const int first_id = level * documents_per_level;
+        // documents are removed, so every run takes the next one
+        int sequential_id = first_id;
+        const int64_t sequential = MeasureMedian([&] {
+            remove_server.RemoveDocument(execution::seq, sequential_id++);
+        });
+        int parallel_id = first_id + documents_per_level / 2;
+        const int64_t parallel = MeasureMedian([&] {
+            remove_server.RemoveDocument(execution::par, parallel_id++);
+        });
+        if (IsParallelFaster(sequential, parallel)) {
+            thresholds.parallel_remove_min_words = static_cast<size_t>(32) << (2 * level);
+            break;
+        }
+    }
+    return thresholds;
+}
+ExecutionThresholds CalibrateExecutionThresholdsAtStartup() {
+    return GetExecutionThresholds();
+}
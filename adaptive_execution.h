@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+// tag for overloads which choose execution mode by themselves:
+// search_server.FindTopDocuments(ADAPTIVE_POLICY, "query"s)
+struct AdaptivePolicy {
+};
+inline constexpr AdaptivePolicy ADAPTIVE_POLICY{};
+
+enum class ExecutionMode {
+    SEQUENTIAL,
+    // plus words are walked in parallel, one task per word
+    PARALLEL_TERMS,
+    // documents are split into id ranges, every range is scored by its own task over all words
+    SHARDED,
+};
+// crossover points measured in posting list entries (words of forward index for removal)
+struct ExecutionThresholds {
+    size_t parallel_terms_min_postings = static_cast<size_t>(-1);
+    size_t sharded_min_postings = static_cast<size_t>(-1);
+    size_t parallel_remove_min_words = static_cast<size_t>(-1);
+};
+// thresholds in use; programs calibrate at startup with CalibrateExecutionThresholdsAtStartup,
+// a program which did not is calibrated by the first call
+ExecutionThresholds GetExecutionThresholds();
+void SetExecutionThresholds(const ExecutionThresholds& thresholds);
+// microbenchmark of sequential and parallel paths on a synthetic index, takes a few hundred ms;
+// crossovers beyond the measured list sizes are extrapolated from the measured costs,
+// on a single core machine parallel modes are never chosen
+ExecutionThresholds CalibrateExecutionThresholds();
+// calibrates and sets the thresholds unless they were set already, returns the thresholds in use
+ExecutionThresholds CalibrateExecutionThresholdsAtStartup();
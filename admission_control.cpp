@@ -0,0 +1,86 @@
+#include "admission_control.h"
+#include <utility>
+using namespace std;
+AdmissionController::Ticket::Ticket(AdmissionController* controller, size_t cost)
+        : controller_(controller)
+        , cost_(cost) {
+}
+AdmissionController::Ticket::Ticket(Ticket&& other) noexcept
+        : controller_(exchange(other.controller_, nullptr))
+        , cost_(other.cost_) {
+}
+AdmissionController::Ticket& AdmissionController::Ticket::operator=(Ticket&& other) noexcept {
+    if (this != &other) {
+        Release();
+        controller_ = exchange(other.controller_, nullptr);
+        cost_ = other.cost_;
+    }
+    return *this;
+}
+AdmissionController::Ticket::~Ticket() {
+    Release();
+}
+bool AdmissionController::Ticket::IsAdmitted() const {
+    return controller_ != nullptr;
+}
+AdmissionController::Ticket::operator bool() const {
+    return IsAdmitted();
+}
+void AdmissionController::Ticket::Release() {
+    if (controller_ != nullptr) {
+        exchange(controller_, nullptr)->Release(cost_);
+    }
+}
+
+AdmissionController::AdmissionController(size_t max_inflight_cost, Clock::duration max_queue_wait)
+        : max_inflight_cost_(max_inflight_cost)
+        , max_queue_wait_(max_queue_wait) {
+}
+AdmissionController::Ticket AdmissionController::Admit(size_t cost) {
+    unique_lock lock(mutex_);
+    if (!CanAdmit(cost)) {
+        const bool is_admitted = max_queue_wait_ > Clock::duration::zero()
+                && released_.wait_for(lock, max_queue_wait_, [this, cost] { return CanAdmit(cost); });
+        if (!is_admitted) {
+            ++shed_count_;
+            return Ticket();
+        }
+    }
+    return AdmitLocked(cost);
+}
+AdmissionController::Ticket AdmissionController::TryAdmit(size_t cost) {
+    lock_guard lock(mutex_);
+    if (!CanAdmit(cost)) {
+        return Ticket();
+    }
+    return AdmitLocked(cost);
+}
+size_t AdmissionController::GetInflightCost() const {
+    lock_guard lock(mutex_);
+    return inflight_cost_;
+}
+uint64_t AdmissionController::GetAdmittedCount() const {
+    lock_guard lock(mutex_);
+    return admitted_count_;
+}
+uint64_t AdmissionController::GetShedCount() const {
+    lock_guard lock(mutex_);
+    return shed_count_;
+}
+void AdmissionController::Release(size_t cost) {
+    {
+        lock_guard lock(mutex_);
+        inflight_cost_ -= cost;
+        --inflight_count_;
+    }
+    released_.notify_all();
+}
+bool AdmissionController::CanAdmit(size_t cost) const {
+    return inflight_count_ == 0 || inflight_cost_ + cost <= max_inflight_cost_;
+}
+AdmissionController::Ticket AdmissionController::AdmitLocked(size_t cost) {
+    inflight_cost_ += cost;
+    ++inflight_count_;
+    ++admitted_count_;
+    return Ticket(this, cost);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+// keeps the summary cost of running queries under a limit:
+// a query over the limit waits up to max_queue_wait for running ones to finish and is shed after that.
+// A query is always admitted when nothing runs, so a single costly query is never starved.
+// There is no ordering among waiting callers
+class AdmissionController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // holds admitted cost until destroyed, an empty ticket means the query was shed
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        Ticket(Ticket&& other) noexcept;
+        Ticket& operator=(Ticket&& other) noexcept;
+        ~Ticket();
+
+        bool IsAdmitted() const;
+        explicit operator bool() const;
+        void Release();
+    private:
+        friend class AdmissionController;
+        Ticket(AdmissionController* controller, size_t cost);
+
+        AdmissionController* controller_ = nullptr;
+        size_t cost_ = 0;
+    };
+
+    explicit AdmissionController(size_t max_inflight_cost, Clock::duration max_queue_wait = Clock::duration::zero());
+    AdmissionController(const AdmissionController&) = delete;
+    AdmissionController& operator=(const AdmissionController&) = delete;
+
+    Ticket Admit(size_t cost);
+    // never waits: an empty ticket means the cost does not fit now, the query is not counted as shed
+    Ticket TryAdmit(size_t cost);
+
+    size_t GetInflightCost() const;
+    uint64_t GetAdmittedCount() const;
+    uint64_t GetShedCount() const;
+private:
+    void Release(size_t cost);
+    bool CanAdmit(size_t cost) const;
+    Ticket AdmitLocked(size_t cost);
+
+    const size_t max_inflight_cost_;
+    const Clock::duration max_queue_wait_;
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    size_t inflight_cost_ = 0;
+    size_t inflight_count_ = 0;
+    uint64_t admitted_count_ = 0;
+    uint64_t shed_count_ = 0;
+};
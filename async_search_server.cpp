@@ -0,0 +1,50 @@
+#include "async_search_server.h"
+using namespace std;
+CancellationToken::CancellationToken(shared_ptr<const atomic<bool>> flag)
+        : flag_(move(flag)) {
+}
+bool CancellationToken::IsCancelled() const {
+    return flag_ && flag_->load(memory_order_relaxed);
+}
+const atomic<bool>* CancellationToken::GetFlag() const {
+    return flag_.get();
+}
+CancellationSource::CancellationSource()
+        : flag_(make_shared<atomic<bool>>(false)) {
+}
+void CancellationSource::Cancel() {
+    flag_->store(true, memory_order_relaxed);
+}
+CancellationToken CancellationSource::GetToken() const {
+    return CancellationToken(flag_);
+}
+
+AsyncSearchServer::AsyncSearchServer(SearchServer& search_server, size_t thread_count)
+        : search_server_(search_server)
+        , pool_(thread_count)
+        , mutex_(pool_) {
+}
+Task<PartialResult> AsyncSearchServer::FindTopDocuments(string raw_query, CancellationToken token, SearchBudget budget) {
+    co_await pool_.Schedule();
+    budget.cancelled = token.GetFlag();
+    const auto lock = co_await mutex_.LockShared();
+    co_return search_server_.FindTopDocuments(raw_query, budget);
+}
+Task<tuple<vector<string_view>, DocumentStatus>> AsyncSearchServer::MatchDocument(string raw_query, int document_id) {
+    co_await pool_.Schedule();
+    const auto lock = co_await mutex_.LockShared();
+    co_return search_server_.MatchDocument(raw_query, document_id);
+}
+Task<> AsyncSearchServer::AddDocument(int document_id, string document, DocumentStatus status, vector<int> ratings) {
+    co_await pool_.Schedule();
+    const auto lock = co_await mutex_.LockExclusive();
+    search_server_.AddDocument(document_id, document, status, ratings);
+}
+Task<> AsyncSearchServer::RemoveDocument(int document_id) {
+    co_await pool_.Schedule();
+    const auto lock = co_await mutex_.LockExclusive();
+    search_server_.RemoveDocument(document_id);
+}
+ThreadPool& AsyncSearchServer::GetThreadPool() {
+    return pool_;
+}
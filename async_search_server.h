@@ -0,0 +1,58 @@
+#pragma once
+// C++20: build with -std=c++20
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include "async_task.h"
+#include "search_budget.h"
+#include "search_server.h"
+// flag shared by a source and its tokens
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    bool IsCancelled() const;
+    // nullptr for a token which can't be cancelled
+    const std::atomic<bool>* GetFlag() const;
+private:
+    friend class CancellationSource;
+    explicit CancellationToken(std::shared_ptr<const std::atomic<bool>> flag);
+
+    std::shared_ptr<const std::atomic<bool>> flag_;
+};
+class CancellationSource {
+public:
+    CancellationSource();
+    void Cancel();
+    CancellationToken GetToken() const;
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+// awaitable front of a SearchServer: every call is a lazy Task run on the internal pool,
+// the awaiting coroutine continues on a pool thread when the call is done.
+// Queries share the server, mutations take it exclusively; a call waiting for the server
+// is suspended (AsyncSharedMutex), pool threads go on with other calls meanwhile.
+// Arguments are taken by value since they have to live in the coroutine frame
+class AsyncSearchServer {
+public:
+    explicit AsyncSearchServer(SearchServer& search_server, size_t thread_count = std::thread::hardware_concurrency());
+
+    // cancellation is checked by the scoring loop through the budget,
+    // a query cancelled before start or in the middle returns what it found as partial
+    Task<PartialResult> FindTopDocuments(std::string raw_query, CancellationToken token = CancellationToken(),
+                                         SearchBudget budget = SearchBudget());
+    // words point into the server, they are valid while the words are indexed
+    Task<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocument(std::string raw_query, int document_id);
+    // GCC 12 rejects a braced ratings list inside a co_await expression, pass a named vector there
+    Task<> AddDocument(int document_id, std::string document, DocumentStatus status, std::vector<int> ratings);
+    Task<> RemoveDocument(int document_id);
+
+    ThreadPool& GetThreadPool();
+private:
+    SearchServer& search_server_;
+    ThreadPool pool_;
+    AsyncSharedMutex mutex_;
+};
@@ -0,0 +1,98 @@
+#include "async_task.h"
+#include <algorithm>
+using namespace std;
+ThreadPool::ThreadPool(size_t thread_count) {
+    for (size_t i = 0; i < max<size_t>(thread_count, 1); ++i) {
+        workers_.emplace_back([this] {
+            WorkerLoop();
+        });
+    }
+}
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard lock(mutex_);
+        is_stopping_ = true;
+    }
+    has_work_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+size_t ThreadPool::GetThreadCount() const {
+    return workers_.size();
+}
+void ThreadPool::Enqueue(coroutine_handle<> handle) {
+    {
+        lock_guard lock(mutex_);
+        queue_.push_back(handle);
+    }
+    has_work_.notify_one();
+}
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        coroutine_handle<> handle;
+        {
+            unique_lock lock(mutex_);
+            has_work_.wait(lock, [this] {
+                return !queue_.empty() || is_stopping_;
+            });
+            if (queue_.empty()) {
+                return;
+            }
+            handle = queue_.front();
+            queue_.pop_front();
+        }
+        handle.resume();
+    }
+}
+
+AsyncSharedMutex::AsyncSharedMutex(ThreadPool& pool)
+        : pool_(pool) {
+}
+bool AsyncSharedMutex::Suspend(const Waiter& waiter) {
+    lock_guard lock(mutex_);
+    const bool is_free = waiter.is_exclusive ? !has_writer_ && reader_count_ == 0 : !has_writer_;
+    if (is_free && waiters_.empty()) {
+        if (waiter.is_exclusive) {
+            has_writer_ = true;
+        } else {
+            ++reader_count_;
+        }
+        return false;
+    }
+    waiters_.push_back(waiter);
+    return true;
+}
+size_t AsyncSharedMutex::GetWaiterCount() {
+    lock_guard lock(mutex_);
+    return waiters_.size();
+}
+void AsyncSharedMutex::Unlock(bool is_exclusive) {
+    vector<coroutine_handle<>> granted;
+    {
+        lock_guard lock(mutex_);
+        if (is_exclusive) {
+            has_writer_ = false;
+        } else {
+            --reader_count_;
+        }
+        // a writer at the front takes the lock alone, readers up to the next writer together
+        while (!waiters_.empty() && !has_writer_) {
+            const Waiter& waiter = waiters_.front();
+            if (waiter.is_exclusive) {
+                if (reader_count_ > 0) {
+                    break;
+                }
+                has_writer_ = true;
+            } else {
+                ++reader_count_;
+            }
+            granted.push_back(waiter.handle);
+            waiters_.pop_front();
+        }
+    }
+    // resumed on the pool, so the unlocking coroutine goes on without running them
+    for (const coroutine_handle<> handle : granted) {
+        pool_.Enqueue(handle);
+    }
+}
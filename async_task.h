@@ -0,0 +1,282 @@
+#pragma once
+// C++20: build files including this header with -std=c++20
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+template <typename T>
+class Task;
+
+namespace detail {
+template <typename T>
+class TaskPromiseBase {
+public:
+    // the awaiting coroutine is resumed right from the final suspend point
+    struct FinalAwaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            const std::coroutine_handle<> continuation = handle.promise().continuation_;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {
+        }
+    };
+
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+    FinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+    void unhandled_exception() {
+        result_.template emplace<std::exception_ptr>(std::current_exception());
+    }
+    void SetContinuation(std::coroutine_handle<> continuation) {
+        continuation_ = continuation;
+    }
+    void RethrowIfFailed() {
+        if (auto* error = std::get_if<std::exception_ptr>(&result_)) {
+            std::rethrow_exception(*error);
+        }
+    }
+protected:
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+    std::variant<std::monostate, Value, std::exception_ptr> result_;
+private:
+    std::coroutine_handle<> continuation_;
+};
+template <typename T>
+class TaskPromise : public TaskPromiseBase<T> {
+public:
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& value) {
+        this->result_.template emplace<1>(std::forward<U>(value));
+    }
+    T TakeResult() {
+        this->RethrowIfFailed();
+        return std::move(std::get<1>(this->result_));
+    }
+};
+template <>
+class TaskPromise<void> : public TaskPromiseBase<void> {
+public:
+    Task<void> get_return_object();
+    void return_void() {
+    }
+    void TakeResult() {
+        RethrowIfFailed();
+    }
+};
+// fire-and-forget coroutine, frame is freed on completion
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() const noexcept {
+            return {};
+        }
+        std::suspend_never initial_suspend() const noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+        void return_void() const noexcept {
+        }
+        void unhandled_exception() const noexcept {
+            std::terminate();
+        }
+    };
+};
+}  // namespace detail
+
+// lazy coroutine: starts when awaited, resumes the awaiting coroutine when done,
+// exceptions are rethrown at co_await
+template <typename T = void>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> handle)
+            : handle_(handle) {
+    }
+    Task(Task&& other) noexcept
+            : handle_(std::exchange(other.handle_, {})) {
+    }
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            Destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        Destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return !handle_ || handle_.done();
+    }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().SetContinuation(awaiting);
+        return handle_;
+    }
+    T await_resume() {
+        return handle_.promise().TakeResult();
+    }
+private:
+    void Destroy() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// blocks the calling thread until the task is done, for code outside coroutines
+template <typename T>
+T SyncWait(Task<T> task) {
+    std::promise<T> promise;
+    auto future = promise.get_future();
+    [](Task<T> task, std::promise<T>& promise) -> detail::DetachedTask {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                co_await task;
+                promise.set_value();
+            } else {
+                promise.set_value(co_await task);
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }(std::move(task), promise);
+    return future.get();
+}
+
+// fixed set of threads resuming coroutines which co_await Schedule();
+// queued coroutines are still resumed when the pool is destroyed
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    auto Schedule() {
+        struct Awaiter {
+            ThreadPool* pool;
+            bool await_ready() const noexcept {
+                return false;
+            }
+            void await_suspend(std::coroutine_handle<> handle) {
+                pool->Enqueue(handle);
+            }
+            void await_resume() const noexcept {
+            }
+        };
+        return Awaiter{this};
+    }
+    size_t GetThreadCount() const;
+private:
+    friend class AsyncSharedMutex;
+
+    void Enqueue(std::coroutine_handle<> handle);
+    void WorkerLoop();
+
+    std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::deque<std::coroutine_handle<>> queue_;
+    bool is_stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// reader-writer lock for coroutines: a coroutine which can't take it is suspended instead of
+// blocking its thread and is resumed on the pool when the lock is handed over to it.
+// Waiters are served in order, so readers coming after a waiting writer wait for it
+class AsyncSharedMutex {
+public:
+    // unlocks on destruction
+    class [[nodiscard]] Lock {
+    public:
+        Lock(AsyncSharedMutex* mutex, bool is_exclusive)
+                : mutex_(mutex)
+                , is_exclusive_(is_exclusive) {
+        }
+        Lock(Lock&& other) noexcept
+                : mutex_(std::exchange(other.mutex_, nullptr))
+                , is_exclusive_(other.is_exclusive_) {
+        }
+        Lock& operator=(Lock&&) = delete;
+        ~Lock() {
+            if (mutex_) {
+                mutex_->Unlock(is_exclusive_);
+            }
+        }
+    private:
+        AsyncSharedMutex* mutex_;
+        bool is_exclusive_;
+    };
+
+    explicit AsyncSharedMutex(ThreadPool& pool);
+    AsyncSharedMutex(const AsyncSharedMutex&) = delete;
+    AsyncSharedMutex& operator=(const AsyncSharedMutex&) = delete;
+
+    // auto lock = co_await mutex.LockShared();
+    auto LockShared() {
+        return Awaiter{this, false};
+    }
+    auto LockExclusive() {
+        return Awaiter{this, true};
+    }
+    // coroutines suspended until the lock is handed over to them
+    size_t GetWaiterCount();
+private:
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        bool is_exclusive;
+    };
+    struct Awaiter {
+        AsyncSharedMutex* mutex;
+        bool is_exclusive;
+        bool await_ready() const noexcept {
+            return false;
+        }
+        // false takes the lock without suspending
+        bool await_suspend(std::coroutine_handle<> handle) {
+            return mutex->Suspend({handle, is_exclusive});
+        }
+        Lock await_resume() const noexcept {
+            return Lock(mutex, is_exclusive);
+        }
+    };
+
+    bool Suspend(const Waiter& waiter);
+    void Unlock(bool is_exclusive);
+
+    ThreadPool& pool_;
+    std::mutex mutex_;
+    size_t reader_count_ = 0;
+    bool has_writer_ = false;
+    std::deque<Waiter> waiters_;
+};
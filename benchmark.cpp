@@ -0,0 +1,351 @@
+// benchmark of SearchServer operations on a synthetic Zipfian corpus
+// build: g++ -std=c++17 -O2 benchmark.cpp corpus_generator.cpp <library sources> -ltbb
+// results are printed as tab-separated lines, one per operation, so runs can be diffed
+#include "corpus_generator.h"
+#include "document_reordering.h"
+#include "impact_index.h"
+#include "numa_index.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace {
+atomic<uint64_t> allocation_count{0};
+atomic<uint64_t> allocated_bytes{0};
+}
+
+namespace {
+// all replaced operators go through these two, kept out of line so the compiler never sees
+// free() of a pointer it knows came from operator new
+__attribute__((noinline)) void* CountedAllocate(size_t size, size_t alignment) {
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    allocated_bytes.fetch_add(size, memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    void* ptr = alignment <= alignof(max_align_t)
+            ? malloc(size)
+            // aligned_alloc wants a multiple of the alignment
+            : aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (ptr == nullptr) {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+__attribute__((noinline)) void CountedFree(void* ptr) noexcept {
+    free(ptr);
+}
+}
+
+void* operator new(size_t size) {
+    return CountedAllocate(size, 0);
+}
+void* operator new[](size_t size) {
+    return CountedAllocate(size, 0);
+}
+void* operator new(size_t size, align_val_t alignment) {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, align_val_t alignment) {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+void operator delete(void* ptr) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, align_val_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, align_val_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, size_t, align_val_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, size_t, align_val_t) noexcept {
+    CountedFree(ptr);
+}
+
+namespace {
+struct BenchmarkOptions {
+    CorpusOptions corpus;
+    QueryOptions queries;
+    string output_path;
+};
+struct OperationReport {
+    string name;
+    size_t operations = 0;
+    double seconds = 0.0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    long peak_rss_kb = 0;
+};
+
+long GetPeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// runs operation(i) for i in [0, count) and times every call separately
+template <typename Operation>
+OperationReport Measure(const string& name, size_t count, Operation operation) {
+    using Clock = chrono::steady_clock;
+    vector<uint64_t> latencies;
+    latencies.reserve(count);
+    const uint64_t allocations_before = allocation_count.load();
+    const uint64_t bytes_before = allocated_bytes.load();
+    const auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        const auto op_start = Clock::now();
+        operation(i);
+        latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - op_start).count());
+    }
+    const auto finish = Clock::now();
+
+    OperationReport report;
+    report.name = name;
+    report.operations = count;
+    report.seconds = chrono::duration<double>(finish - start).count();
+    // latencies vector itself was reserved before counting
+    report.allocations = allocation_count.load() - allocations_before;
+    report.bytes = allocated_bytes.load() - bytes_before;
+    report.peak_rss_kb = GetPeakRssKb();
+    if (!latencies.empty()) {
+        sort(latencies.begin(), latencies.end());
+        report.p50_ns = latencies[(latencies.size() - 1) / 2];
+        report.p99_ns = latencies[(latencies.size() - 1) * 99 / 100];
+    }
+    return report;
+}
+
+void PrintReports(ostream& out, const BenchmarkOptions& options, const vector<OperationReport>& reports) {
+    out << "# documents=" << options.corpus.document_count
+        << " vocabulary=" << options.corpus.vocabulary_size
+        << " zipf=" << options.corpus.zipf_exponent
+        << " queries=" << options.queries.query_count
+        << " seed=" << options.corpus.seed << '\n';
+    out << "operation\tops\tops_per_sec\tp50_ns\tp99_ns\tallocs_per_op\tbytes_per_op\tpeak_rss_kb\n";
+    for (const OperationReport& report : reports) {
+        const double ops = static_cast<double>(max<size_t>(report.operations, 1));
+        out << report.name << '\t'
+            << report.operations << '\t'
+            << fixed << setprecision(2) << (report.seconds > 0 ? report.operations / report.seconds : 0.0) << '\t'
+            << report.p50_ns << '\t'
+            << report.p99_ns << '\t'
+            << static_cast<uint64_t>(report.allocations / ops) << '\t'
+            << static_cast<uint64_t>(report.bytes / ops) << '\t'
+            << report.peak_rss_kb << '\n';
+    }
+}
+
+BenchmarkOptions ParseOptions(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; i += 2) {
+        const string key = argv[i];
+        if (i + 1 == argc) {
+            throw invalid_argument("no value for option "s + key);
+        }
+        const string value = argv[i + 1];
+        if (key == "--documents"s) {
+            options.corpus.document_count = stoul(value);
+        } else if (key == "--vocabulary"s) {
+            options.corpus.vocabulary_size = stoul(value);
+        } else if (key == "--zipf"s) {
+            options.corpus.zipf_exponent = stod(value);
+        } else if (key == "--min-length"s) {
+            options.corpus.min_document_length = stoul(value);
+        } else if (key == "--max-length"s) {
+            options.corpus.max_document_length = stoul(value);
+        } else if (key == "--stop-ratio"s) {
+            options.corpus.stop_word_ratio = stod(value);
+        } else if (key == "--queries"s) {
+            options.queries.query_count = stoul(value);
+        } else if (key == "--max-query-words"s) {
+            options.queries.max_plus_words = stoul(value);
+        } else if (key == "--minus-ratio"s) {
+            options.queries.minus_query_ratio = stod(value);
+        } else if (key == "--seed"s) {
+            options.corpus.seed = stoull(value);
+        } else if (key == "--output"s) {
+            options.output_path = value;
+        } else {
+            throw invalid_argument("unknown option "s + key);
+        }
+    }
+    return options;
+}
+
+void AddDocuments(SearchServer& search_server, const vector<string>& documents) {
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)});
+    }
+}
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    try {
+        options = ParseOptions(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    {
+        // at startup, so calibration is kept out of measured time
+        const ExecutionThresholds thresholds = CalibrateExecutionThresholdsAtStartup();
+        cerr << "adaptive thresholds: parallel terms "s << thresholds.parallel_terms_min_postings << ", sharded "s
+             << thresholds.sharded_min_postings << ", parallel remove "s << thresholds.parallel_remove_min_words << endl;
+    }
+    CorpusGenerator generator(options.corpus);
+    const vector<string> documents = generator.GenerateDocuments();
+    const vector<string> queries = generator.GenerateQueries(options.queries);
+    const string stop_words = generator.GetStopWordsText();
+    vector<OperationReport> reports;
+
+    SearchServer search_server(stop_words);
+    reports.push_back(Measure("add_document"s, documents.size(), [&](size_t i) {
+        search_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)});
+    }));
+    reports.push_back(Measure("find_top_documents_seq"s, queries.size(), [&](size_t i) {
+        search_server.FindTopDocuments(execution::seq, queries[i]);
+    }));
+    {
+        // the same path with vector kernels off, for comparison
+        const SimdLevel simd_level = GetSimdLevel();
+        SetSimdLevel(SimdLevel::SCALAR);
+        reports.push_back(Measure("find_top_documents_seq_scalar"s, queries.size(), [&](size_t i) {
+            search_server.FindTopDocuments(execution::seq, queries[i]);
+        }));
+        SetSimdLevel(simd_level);
+        cerr << "simd level: "s << GetSimdLevelName(simd_level) << endl;
+    }
+    reports.push_back(Measure("find_top_documents_with_facets"s, queries.size(), [&](size_t i) {
+        search_server.FindTopDocumentsWithFacets(queries[i]);
+    }));
+    reports.push_back(Measure("find_top_documents_tf_idf_policy"s, queries.size(), [&](size_t i) {
+        search_server.FindTopDocuments(TF_IDF_SCORING, queries[i]);
+    }));
+    reports.push_back(Measure("find_top_documents_bm25_policy"s, queries.size(), [&](size_t i) {
+        search_server.FindTopDocuments(BM25_SCORING, queries[i]);
+    }));
+    reports.push_back(Measure("find_top_documents_par"s, queries.size(), [&](size_t i) {
+        search_server.FindTopDocuments(execution::par, queries[i]);
+    }));
+    reports.push_back(Measure("find_top_documents_adaptive"s, queries.size(), [&](size_t i) {
+        search_server.FindTopDocuments(ADAPTIVE_POLICY, queries[i]);
+    }));
+    {
+        const ImpactIndex impact_index(search_server);
+        reports.push_back(Measure("find_top_documents_impact"s, queries.size(), [&](size_t i) {
+            impact_index.FindTopDocuments(queries[i]);
+        }));
+        vector<int> document_order;
+        reports.push_back(Measure("reorder_documents"s, 1, [&](size_t) {
+            document_order = ComputeDocumentOrder(search_server);
+        }));
+        const ImpactIndex reordered_index(search_server, document_order);
+        reports.push_back(Measure("find_top_documents_impact_reordered"s, queries.size(), [&](size_t i) {
+            reordered_index.FindTopDocuments(queries[i]);
+        }));
+        // kept out of the report lines, they are sizes and not timings
+        cerr << "compressed postings: "s << EstimateCompressedPostingBytes(search_server, GetIdentityOrder(search_server))
+             << " bytes in id order, "s << EstimateCompressedPostingBytes(search_server, document_order) << " bytes reordered"s << endl;
+    }
+    reports.push_back(Measure("match_document"s, queries.size(), [&](size_t i) {
+        search_server.MatchDocument(queries[i], static_cast<int>(i % documents.size()));
+    }));
+    reports.push_back(Measure("process_queries_batch"s, 5, [&](size_t) {
+        ProcessQueries(search_server, queries);
+    }));
+    reports.push_back(Measure("process_queries_shared_terms"s, 5, [&](size_t) {
+        ProcessQueriesBatched(search_server, queries);
+    }));
+    {
+        // SEARCH_SERVER_NUMA_TOPOLOGY simulates nodes on a single node machine
+        const NumaReplicatedIndex numa_index(search_server, DetectNumaTopology());
+        reports.push_back(Measure("process_queries_numa"s, 5, [&](size_t) {
+            numa_index.ProcessQueries(queries);
+        }));
+        for (const NumaNodeStatistics& node : numa_index.GetNodeStatistics()) {
+            cerr << "numa node "s << node.node_id << ": "s << node.queries << " queries, "s
+                 << node.GetBandwidth() / (1 << 20) << " MiB/s read"s << endl;
+        }
+    }
+    {
+        const size_t removed = documents.size() / 2;
+        SearchServer seq_server(stop_words);
+        AddDocuments(seq_server, documents);
+        reports.push_back(Measure("remove_document_seq"s, removed, [&](size_t i) {
+            seq_server.RemoveDocument(execution::seq, static_cast<int>(i));
+        }));
+        SearchServer adaptive_server(stop_words);
+        AddDocuments(adaptive_server, documents);
+        reports.push_back(Measure("remove_document_adaptive"s, removed, [&](size_t i) {
+            adaptive_server.RemoveDocument(ADAPTIVE_POLICY, static_cast<int>(i));
+        }));
+        SearchServer par_server(stop_words);
+        AddDocuments(par_server, documents);
+        reports.push_back(Measure("remove_document_par"s, removed, [&](size_t i) {
+            par_server.RemoveDocument(execution::par, static_cast<int>(i));
+        }));
+        // one operation removing the same documents as the rows above
+        vector<int> removed_ids(removed);
+        iota(removed_ids.begin(), removed_ids.end(), 0);
+        SearchServer batch_server(stop_words);
+        AddDocuments(batch_server, documents);
+        reports.push_back(Measure("remove_documents_batch_par"s, 1, [&](size_t) {
+            const RemovalStatistics statistics = batch_server.RemoveDocuments(execution::par, removed_ids);
+            cerr << "batch removal: "s << statistics.erased_words << " words erased, "s << statistics.reclaimed_bytes
+                 << " bytes reclaimed"s << endl;
+        }));
+    }
+    {
+        // every fourth document gets a duplicate
+        SearchServer duplicates_server(stop_words);
+        AddDocuments(duplicates_server, documents);
+        for (size_t i = 0; i < documents.size(); i += 4) {
+            duplicates_server.AddDocument(static_cast<int>(documents.size() + i), documents[i], DocumentStatus::ACTUAL, {1});
+        }
+        // RemoveDuplicates reports every removal to cout
+        ostringstream sink;
+        auto* cout_buffer = cout.rdbuf(sink.rdbuf());
+        reports.push_back(Measure("remove_duplicates"s, 1, [&](size_t) {
+            RemoveDuplicates(duplicates_server);
+        }));
+        cout.rdbuf(cout_buffer);
+    }
+
+    PrintReports(cout, options, reports);
+    if (!options.output_path.empty()) {
+        ofstream out(options.output_path);
+        PrintReports(out, options, reports);
+    }
+    return 0;
+}
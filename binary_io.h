@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+// raw host-order values for snapshots, readers throw runtime_error on short input
+template <typename T>
+void WriteBinary(std::ostream& output, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    output.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+template <typename T>
+T ReadBinary(std::istream& input) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    if (!input.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+        throw std::runtime_error("unexpected end of binary data");
+    }
+    return value;
+}
+inline void WriteBinaryString(std::ostream& output, std::string_view text) {
+    WriteBinary(output, static_cast<uint32_t>(text.size()));
+    output.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+inline std::string ReadBinaryString(std::istream& input) {
+    std::string text(ReadBinary<uint32_t>(input), '\0');
+    if (!input.read(text.data(), static_cast<std::streamsize>(text.size()))) {
+        throw std::runtime_error("unexpected end of binary data");
+    }
+    return text;
+}
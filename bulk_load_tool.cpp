@@ -0,0 +1,82 @@
+#include "bulk_loader.h"
+#include "corpus_generator.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+// loads a corpus file into a SearchServer and reports throughput;
+// --generate N writes a generated corpus of N documents to --input first
+namespace {
+struct ToolOptions {
+    string input;
+    string stop_words;
+    size_t generate = 0;
+    BulkLoadOptions load;
+    CorpusOptions corpus;
+};
+
+ToolOptions ParseOptions(int argc, char* argv[]) {
+    ToolOptions options;
+    for (int i = 1; i < argc; i += 2) {
+        const string key = argv[i];
+        if (i + 1 == argc) {
+            throw invalid_argument("no value for option "s + key);
+        }
+        const string value = argv[i + 1];
+        if (key == "--input"s) {
+            options.input = value;
+        } else if (key == "--format"s) {
+            if (value != "lines"s && value != "tsv"s) {
+                throw invalid_argument("format is lines or tsv"s);
+            }
+            options.load.format = value == "lines"s ? RecordFormat::LINES : RecordFormat::TSV;
+        } else if (key == "--stop-words"s) {
+            options.stop_words = value;
+        } else if (key == "--window-mb"s) {
+            options.load.window_bytes = stoul(value) << 20;
+        } else if (key == "--generate"s) {
+            options.generate = stoul(value);
+        } else if (key == "--vocabulary"s) {
+            options.corpus.vocabulary_size = stoul(value);
+        } else if (key == "--seed"s) {
+            options.corpus.seed = stoull(value);
+        } else {
+            throw invalid_argument("unknown option "s + key);
+        }
+    }
+    if (options.input.empty()) {
+        throw invalid_argument("--input is required"s);
+    }
+    return options;
+}
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        ToolOptions options = ParseOptions(argc, argv);
+        if (options.generate > 0) {
+            options.corpus.document_count = options.generate;
+            CorpusGenerator generator(options.corpus);
+            ofstream output(options.input);
+            int id = options.load.first_id;
+            for (const string& document : generator.GenerateDocuments()) {
+                if (options.load.format == RecordFormat::TSV) {
+                    output << id << '\t' << id % 10 << '\t';
+                }
+                output << document << '\n';
+                ++id;
+            }
+            if (options.stop_words.empty()) {
+                options.stop_words = generator.GetStopWordsText();
+            }
+        }
+        SearchServer search_server(options.stop_words);
+        const BulkLoadStats stats = LoadCorpus(search_server, options.input, options.load);
+        cout << "documents "s << stats.documents << ", "s << stats.bytes / 1e6 << " MB in "s << stats.total_seconds << " s: "s
+             << stats.GetGigabytesPerSecond() << " GB/s, "s << stats.GetDocumentsPerSecond() << " docs/s (split "s
+             << stats.split_seconds << " s, index "s << stats.index_seconds << " s)"s << endl;
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
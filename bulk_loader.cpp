@@ -0,0 +1,170 @@
+#include "bulk_loader.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+namespace {
+using Clock = chrono::steady_clock;
+
+double GetSeconds(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+bool ParseNumber(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+// <id>\t<ratings>\t<text>
+bool ParseTsvRecord(string_view line, DocumentInput& document) {
+    const size_t first_tab = line.find('\t');
+    const size_t second_tab = first_tab == string_view::npos ? first_tab : line.find('\t', first_tab + 1);
+    if (second_tab == string_view::npos || !ParseNumber(line.substr(0, first_tab), document.id)) {
+        return false;
+    }
+    string_view ratings = line.substr(first_tab + 1, second_tab - first_tab - 1);
+    while (!ratings.empty()) {
+        const size_t comma = min(ratings.find(','), ratings.size());
+        int rating;
+        if (!ParseNumber(ratings.substr(0, comma), rating)) {
+            return false;
+        }
+        document.ratings.push_back(rating);
+        ratings.remove_prefix(min(comma + 1, ratings.size()));
+    }
+    document.text = line.substr(second_tab + 1);
+    return true;
+}
+}  // namespace
+
+double BulkLoadStats::GetGigabytesPerSecond() const {
+    return total_seconds > 0.0 ? bytes / total_seconds / 1e9 : 0.0;
+}
+double BulkLoadStats::GetDocumentsPerSecond() const {
+    return total_seconds > 0.0 ? documents / total_seconds : 0.0;
+}
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error("can't open "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("can't stat "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = nullptr;
+        throw runtime_error("can't map "s + path);
+    }
+    if (data_ != nullptr) {
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+}
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+string_view MappedFile::GetData() const {
+    return string_view(static_cast<const char*>(data_), size_);
+}
+
+vector<string_view> SplitLines(string_view text) {
+    // every chunk starts right after a line end, so it holds whole lines only
+    const size_t chunk_count = max<size_t>(1, min<size_t>(thread::hardware_concurrency() * 4, text.size() / (1 << 16)));
+    vector<size_t> borders = {0};
+    for (size_t i = 1; i < chunk_count; ++i) {
+        const size_t line_end = text.find('\n', max(borders.back(), text.size() / chunk_count * i));
+        if (line_end == string_view::npos) {
+            break;
+        }
+        borders.push_back(line_end + 1);
+    }
+    borders.push_back(text.size());
+    borders.erase(unique(borders.begin(), borders.end()), borders.end());
+
+    vector<vector<string_view>> chunk_lines(borders.size() - 1);
+    vector<size_t> chunks(chunk_lines.size());
+    iota(chunks.begin(), chunks.end(), 0);
+    for_each(execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+        string_view rest = text.substr(borders[chunk], borders[chunk + 1] - borders[chunk]);
+        while (!rest.empty()) {
+            const size_t line_end = min(rest.find('\n'), rest.size());
+            string_view line = rest.substr(0, line_end);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            chunk_lines[chunk].push_back(line);
+            rest.remove_prefix(min(line_end + 1, rest.size()));
+        }
+    });
+    vector<string_view> lines;
+    lines.reserve(accumulate(chunk_lines.begin(), chunk_lines.end(), size_t(0), [](size_t sum, const auto& chunk) {
+        return sum + chunk.size();
+    }));
+    for (const auto& chunk : chunk_lines) {
+        lines.insert(lines.end(), chunk.begin(), chunk.end());
+    }
+    return lines;
+}
+
+BulkLoadStats LoadCorpus(SearchServer& search_server, const string& path, const BulkLoadOptions& options) {
+    const auto start = Clock::now();
+    const MappedFile file(path);
+    const string_view data = file.GetData();
+    BulkLoadStats stats;
+    stats.bytes = data.size();
+    size_t position = 0;
+    size_t line_number = 0;
+    while (position < data.size()) {
+        // window ends after a line end, a single longer line makes the window longer
+        size_t window_end = min(data.size(), position + max<size_t>(options.window_bytes, 1));
+        if (window_end < data.size()) {
+            const size_t line_end = data.find('\n', window_end - 1);
+            window_end = line_end == string_view::npos ? data.size() : line_end + 1;
+        }
+        auto stage_start = Clock::now();
+        const vector<string_view> lines = SplitLines(data.substr(position, window_end - position));
+        vector<DocumentInput> documents(lines.size());
+        vector<char> is_valid(lines.size(), true);
+        vector<size_t> indexes(lines.size());
+        iota(indexes.begin(), indexes.end(), 0);
+        for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+            DocumentInput& document = documents[i];
+            document.status = options.status;
+            if (options.format == RecordFormat::LINES) {
+                document.id = options.first_id + static_cast<int>(line_number + i);
+                document.text = lines[i];
+            } else {
+                is_valid[i] = ParseTsvRecord(lines[i], document);
+            }
+        });
+        const auto invalid = find(is_valid.begin(), is_valid.end(), false);
+        if (invalid != is_valid.end()) {
+            throw invalid_argument("malformed record at line "s + to_string(line_number + (invalid - is_valid.begin()) + 1));
+        }
+        stats.split_seconds += GetSeconds(stage_start);
+
+        stage_start = Clock::now();
+        search_server.AddDocuments(execution::par, documents);
+        stats.index_seconds += GetSeconds(stage_start);
+        stats.documents += documents.size();
+        line_number += lines.size();
+        position = window_end;
+    }
+    stats.total_seconds = GetSeconds(start);
+    return stats;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "document.h"
+#include "search_server.h"
+enum class RecordFormat {
+    // one document text per line, ids go up from first_id by line
+    LINES,
+    // <id>\t<comma separated ratings, may be empty>\t<text>
+    TSV,
+};
+struct BulkLoadOptions {
+    RecordFormat format = RecordFormat::LINES;
+    int first_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    // bytes of the file split and indexed at once, records are views into the mapping
+    size_t window_bytes = size_t(64) << 20;
+};
+struct BulkLoadStats {
+    size_t bytes = 0;
+    size_t documents = 0;
+    double split_seconds = 0.0;
+    double index_seconds = 0.0;
+    double total_seconds = 0.0;
+
+    double GetGigabytesPerSecond() const;
+    double GetDocumentsPerSecond() const;
+};
+// read-only sequential mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view GetData() const;
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+// records of text are found in parallel chunks cut at line ends, a '\r' before '\n' is dropped;
+// views point into text
+std::vector<std::string_view> SplitLines(std::string_view text);
+// the file is mapped and processed window by window: lines are split in parallel,
+// records parsed without copies and handed to AddDocuments(execution::par, ...).
+// throws invalid_argument with the line number for a malformed TSV record; windows indexed
+// before an error stay in the server, the failing window adds nothing
+BulkLoadStats LoadCorpus(SearchServer& search_server, const std::string& path, const BulkLoadOptions& options = BulkLoadOptions());
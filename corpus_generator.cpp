@@ -0,0 +1,107 @@
+#include "corpus_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+using namespace std;
+namespace {
+// distinct lowercase word for every rank
+string MakeWord(size_t rank, char first_letter) {
+    string word(1, first_letter);
+    do {
+        word += static_cast<char>('a' + rank % 26);
+        rank /= 26;
+    } while (rank > 0);
+    return word;
+}
+}
+CorpusGenerator::CorpusGenerator(const CorpusOptions& options)
+        : options_(options)
+        , generator_(options.seed) {
+    if (options_.vocabulary_size == 0 || options_.min_document_length == 0
+        || options_.min_document_length > options_.max_document_length) {
+        throw invalid_argument("wrong corpus options"s);
+    }
+    vocabulary_.reserve(options_.vocabulary_size);
+    cumulative_.reserve(options_.vocabulary_size);
+    double sum = 0.0;
+    for (size_t rank = 0; rank < options_.vocabulary_size; ++rank) {
+        vocabulary_.push_back(MakeWord(rank, 'w'));
+        sum += 1.0 / pow(static_cast<double>(rank + 1), options_.zipf_exponent);
+        cumulative_.push_back(sum);
+    }
+    for (double& value : cumulative_) {
+        value /= sum;
+    }
+    for (size_t i = 0; i < options_.stop_word_count; ++i) {
+        stop_words_.push_back(MakeWord(i, 's'));
+    }
+}
+const vector<string>& CorpusGenerator::GetStopWords() const {
+    return stop_words_;
+}
+string CorpusGenerator::GetStopWordsText() const {
+    string text;
+    for (const string& word : stop_words_) {
+        if (!text.empty()) {
+            text += ' ';
+        }
+        text += word;
+    }
+    return text;
+}
+vector<string> CorpusGenerator::GenerateDocuments() {
+    uniform_int_distribution<size_t> length(options_.min_document_length, options_.max_document_length);
+    bernoulli_distribution is_stop(stop_words_.empty() ? 0.0 : options_.stop_word_ratio);
+    vector<string> documents;
+    documents.reserve(options_.document_count);
+    for (size_t i = 0; i < options_.document_count; ++i) {
+        string document;
+        const size_t word_count = length(generator_);
+        for (size_t j = 0; j < word_count; ++j) {
+            if (j > 0) {
+                document += ' ';
+            }
+            document += is_stop(generator_) ? SampleStopWord() : SampleWord();
+        }
+        documents.push_back(move(document));
+    }
+    return documents;
+}
+vector<string> CorpusGenerator::GenerateQueries(const QueryOptions& options) {
+    if (options.min_plus_words == 0 || options.min_plus_words > options.max_plus_words) {
+        throw invalid_argument("wrong query options"s);
+    }
+    uniform_int_distribution<size_t> plus_count(options.min_plus_words, options.max_plus_words);
+    uniform_int_distribution<size_t> minus_count(1, max<size_t>(options.max_minus_words, 1));
+    bernoulli_distribution has_minus(options.max_minus_words == 0 ? 0.0 : options.minus_query_ratio);
+    bernoulli_distribution is_stop(stop_words_.empty() ? 0.0 : options.stop_word_ratio);
+    vector<string> queries;
+    queries.reserve(options.query_count);
+    for (size_t i = 0; i < options.query_count; ++i) {
+        string query;
+        const size_t words = plus_count(generator_);
+        for (size_t j = 0; j < words; ++j) {
+            if (!query.empty()) {
+                query += ' ';
+            }
+            query += is_stop(generator_) ? SampleStopWord() : SampleWord();
+        }
+        if (has_minus(generator_)) {
+            const size_t minus_words = minus_count(generator_);
+            for (size_t j = 0; j < minus_words; ++j) {
+                query += " -"s;
+                query += SampleWord();
+            }
+        }
+        queries.push_back(move(query));
+    }
+    return queries;
+}
+const string& CorpusGenerator::SampleWord() {
+    const double point = uniform_real_distribution<double>(0.0, 1.0)(generator_);
+    const size_t rank = lower_bound(cumulative_.begin(), cumulative_.end(), point) - cumulative_.begin();
+    return vocabulary_[min(rank, vocabulary_.size() - 1)];
+}
+const string& CorpusGenerator::SampleStopWord() {
+    return stop_words_[uniform_int_distribution<size_t>(0, stop_words_.size() - 1)(generator_)];
+}
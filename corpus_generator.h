@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+// synthetic corpus for benchmarks: word ranks follow Zipf distribution
+struct CorpusOptions {
+    size_t vocabulary_size = 50000;
+    double zipf_exponent = 1.0;
+    size_t document_count = 20000;
+    size_t min_document_length = 20;
+    size_t max_document_length = 200;
+    size_t stop_word_count = 20;
+    // share of stop words among words of a document
+    double stop_word_ratio = 0.1;
+    uint64_t seed = 42;
+};
+struct QueryOptions {
+    size_t query_count = 1000;
+    size_t min_plus_words = 1;
+    size_t max_plus_words = 5;
+    // probability of a query to have minus words at all
+    double minus_query_ratio = 0.3;
+    size_t max_minus_words = 2;
+    double stop_word_ratio = 0.1;
+};
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusOptions& options);
+
+    const std::vector<std::string>& GetStopWords() const;
+    std::string GetStopWordsText() const;
+    std::vector<std::string> GenerateDocuments();
+    std::vector<std::string> GenerateQueries(const QueryOptions& options);
+private:
+    const std::string& SampleWord();
+    const std::string& SampleStopWord();
+
+    CorpusOptions options_;
+    std::mt19937_64 generator_;
+    std::vector<std::string> vocabulary_;
+    std::vector<std::string> stop_words_;
+    // cumulative probabilities of word ranks
+    std::vector<double> cumulative_;
+};
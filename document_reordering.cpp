@@ -0,0 +1,170 @@
+#include "document_reordering.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+using namespace std;
+namespace {
+// log gap cost of a word with degree postings in a partition of size documents
+double GapCost(uint32_t degree, size_t size) {
+    return degree * log2(static_cast<double>(size) / (degree + 1));
+}
+
+class GraphBisection {
+public:
+    GraphBisection(vector<vector<uint32_t>> document_words, size_t word_count, const ReorderingOptions& options)
+            : document_words_(move(document_words))
+            , options_(options)
+            , left_degrees_(word_count, 0)
+            , right_degrees_(word_count, 0)
+            , move_gains_(word_count, 0.0)
+            , reverse_gains_(word_count, 0.0)
+            , gains_(document_words_.size(), 0.0) {
+    }
+
+    // documents are ordinals in the id order, they are permuted in place
+    void Bisect(vector<uint32_t>::iterator first, vector<uint32_t>::iterator last, size_t depth) {
+        const size_t size = static_cast<size_t>(last - first);
+        if (size < 2 * options_.min_partition_size || depth >= options_.max_depth) {
+            // leaves keep the id order
+            sort(first, last);
+            return;
+        }
+        const auto middle = first + size / 2;
+        for (size_t iteration = 0; iteration < options_.max_iterations; ++iteration) {
+            if (SwapDocuments(first, middle, last) == 0) {
+                break;
+            }
+        }
+        Bisect(first, middle, depth + 1);
+        Bisect(middle, last, depth + 1);
+    }
+private:
+    // moves documents whose exchange lowers the summed gap cost of both halves, returns swaps
+    size_t SwapDocuments(vector<uint32_t>::iterator first, vector<uint32_t>::iterator middle, vector<uint32_t>::iterator last) {
+        const size_t left_size = static_cast<size_t>(middle - first);
+        const size_t right_size = static_cast<size_t>(last - middle);
+        vector<uint32_t> words;
+        for (auto it = first; it != last; ++it) {
+            auto& degrees = it < middle ? left_degrees_ : right_degrees_;
+            for (const uint32_t word : document_words_[*it]) {
+                if (left_degrees_[word] == 0 && right_degrees_[word] == 0) {
+                    words.push_back(word);
+                }
+                ++degrees[word];
+            }
+        }
+        // cost saved by moving one posting of the word to the other half
+        for (const uint32_t word : words) {
+            const uint32_t left = left_degrees_[word];
+            const uint32_t right = right_degrees_[word];
+            const double before = GapCost(left, left_size) + GapCost(right, right_size);
+            const double to_right = left > 0 ? GapCost(left - 1, left_size) + GapCost(right + 1, right_size) : before;
+            const double to_left = right > 0 ? GapCost(left + 1, left_size) + GapCost(right - 1, right_size) : before;
+            move_gains_[word] = before - to_right;
+            reverse_gains_[word] = before - to_left;
+        }
+        for (auto it = first; it != last; ++it) {
+            double gain = 0.0;
+            for (const uint32_t word : document_words_[*it]) {
+                gain += it < middle ? move_gains_[word] : reverse_gains_[word];
+            }
+            gains_[*it] = gain;
+        }
+        const auto by_gain = [this](uint32_t lhs, uint32_t rhs) {
+            return gains_[lhs] != gains_[rhs] ? gains_[lhs] > gains_[rhs] : lhs < rhs;
+        };
+        sort(first, middle, by_gain);
+        sort(middle, last, by_gain);
+        size_t swaps = 0;
+        for (auto left = first, right = middle; left != middle && right != last; ++left, ++right) {
+            if (gains_[*left] + gains_[*right] <= 0.0) {
+                break;
+            }
+            iter_swap(left, right);
+            ++swaps;
+        }
+        for (const uint32_t word : words) {
+            left_degrees_[word] = 0;
+            right_degrees_[word] = 0;
+        }
+        return swaps;
+    }
+
+    const vector<vector<uint32_t>> document_words_;
+    const ReorderingOptions options_;
+    // per word state of the partition being split, reset after every round
+    vector<uint32_t> left_degrees_;
+    vector<uint32_t> right_degrees_;
+    vector<double> move_gains_;
+    vector<double> reverse_gains_;
+    vector<double> gains_;
+};
+
+// length of the Elias gamma code of a positive value
+size_t GetGammaCodeBits(uint32_t value) {
+    size_t bits = 1;
+    while (value > 1) {
+        value >>= 1;
+        bits += 2;
+    }
+    return bits;
+}
+}  // namespace
+
+vector<int> ComputeDocumentOrder(const SearchServer& search_server, const ReorderingOptions& options) {
+    if (options.min_partition_size == 0) {
+        throw invalid_argument("min partition size must be positive"s);
+    }
+    const vector<int> document_ids = GetIdentityOrder(search_server);
+    map<string_view, uint32_t> word_ids;
+    vector<vector<uint32_t>> document_words;
+    document_words.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        vector<uint32_t>& words = document_words.emplace_back();
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) {
+            words.push_back(word_ids.emplace(word, static_cast<uint32_t>(word_ids.size())).first->second);
+        }
+    }
+    vector<uint32_t> ordinals(document_ids.size());
+    iota(ordinals.begin(), ordinals.end(), 0);
+    GraphBisection bisection(move(document_words), word_ids.size(), options);
+    bisection.Bisect(ordinals.begin(), ordinals.end(), 0);
+
+    vector<int> document_order;
+    document_order.reserve(ordinals.size());
+    for (const uint32_t ordinal : ordinals) {
+        document_order.push_back(document_ids[ordinal]);
+    }
+    return document_order;
+}
+
+void CheckDocumentOrder(const SearchServer& search_server, const vector<int>& document_order) {
+    vector<int> sorted_order(document_order);
+    sort(sorted_order.begin(), sorted_order.end());
+    if (!equal(sorted_order.begin(), sorted_order.end(), search_server.begin(), search_server.end())) {
+        throw invalid_argument("document order has to list every document once"s);
+    }
+}
+
+vector<int> GetIdentityOrder(const SearchServer& search_server) {
+    return vector<int>(search_server.begin(), search_server.end());
+}
+
+size_t EstimateCompressedPostingBytes(const SearchServer& search_server, const vector<int>& document_order) {
+    CheckDocumentOrder(search_server, document_order);
+    // documents are visited by ordinal, so every list gets its ordinals in increasing order
+    // gaps are counted from ordinal -1, so they are all positive
+    map<string_view, uint32_t> next_gap_starts;
+    size_t bits = 0;
+    for (uint32_t ordinal = 0; ordinal < document_order.size(); ++ordinal) {
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_order[ordinal])) {
+            const auto it = next_gap_starts.emplace(word, 0).first;
+            bits += GetGammaCodeBits(ordinal + 1 - it->second);
+            it->second = ordinal + 1;
+        }
+    }
+    return (bits + 7) / 8;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "search_server.h"
+// offline reordering of documents by recursive graph bisection: documents sharing words
+// get close ordinals, so posting lists of indexes built in this order have small gaps
+// and neighbouring postings of a query are scored together.
+// The order is a table ordinal -> document id, ids seen by callers don't change.
+struct ReorderingOptions {
+    // partitions smaller than this are not split further
+    size_t min_partition_size = 16;
+    size_t max_depth = 32;
+    // rounds of swaps between the halves of one partition
+    size_t max_iterations = 20;
+};
+// document ids of the server in the new order
+std::vector<int> ComputeDocumentOrder(const SearchServer& search_server, const ReorderingOptions& options = {});
+// ids of the server in increasing order, the order of an index built without reordering
+std::vector<int> GetIdentityOrder(const SearchServer& search_server);
+// throws invalid_argument unless the order is a permutation of the server's ids
+void CheckDocumentOrder(const SearchServer& search_server, const std::vector<int>& document_order);
+// size of all posting lists of the server with gaps of ordinals coded by Elias gamma,
+// when ordinals are given to documents in the order; document_order has to be
+// a permutation of the server's ids
+size_t EstimateCompressedPostingBytes(const SearchServer& search_server, const std::vector<int>& document_order);
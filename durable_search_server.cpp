@@ -0,0 +1,199 @@
+#include "durable_search_server.h"
+#include "binary_io.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+namespace {
+void SyncPath(const string& path, int flags) {
+    const int fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw runtime_error("can't sync "s + path);
+    }
+    close(fd);
+}
+}  // namespace
+
+DurableSearchServer::DurableSearchServer(const string& directory, const string& stop_words_text, const WalOptions& options)
+        : snapshot_path_(directory + "/snapshot"s)
+        , wal_path_(directory + "/wal"s)
+        , search_server_(stop_words_text) {
+    const WalReadResult log = Recover();
+    wal_.emplace(wal_path_, options, recovery_stats_.snapshot_lsn + 1, log);
+    applied_lsn_ = wal_->GetLastLsn();
+}
+void DurableSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    uint64_t lsn;
+    {
+        lock_guard lock(log_mutex_);
+        // a rejected document is never logged
+        CheckNewDocument(document_id, document, {});
+        lsn = wal_->AppendAddDocument(document_id, document, status, ratings);
+        MarkPending(document_id, true);
+    }
+    Commit(lsn, lsn, {document_id}, [&] {
+        search_server_.AddDocument(document_id, document, status, ratings);
+    });
+}
+void DurableSearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    if (documents.empty()) {
+        return;
+    }
+    vector<int> document_ids;
+    uint64_t first_lsn = 0;
+    uint64_t last_lsn = 0;
+    {
+        lock_guard lock(log_mutex_);
+        set<int> batch_ids;
+        for (const DocumentInput& document : documents) {
+            CheckNewDocument(document.id, document.text, batch_ids);
+            batch_ids.insert(document.id);
+        }
+        for (const DocumentInput& document : documents) {
+            last_lsn = wal_->AppendAddDocument(document.id, document.text, document.status, document.ratings);
+            first_lsn = first_lsn == 0 ? last_lsn : first_lsn;
+            MarkPending(document.id, true);
+            document_ids.push_back(document.id);
+        }
+    }
+    Commit(first_lsn, last_lsn, document_ids, [&] {
+        search_server_.AddDocuments(execution::par, documents);
+    });
+}
+void DurableSearchServer::RemoveDocument(int document_id) {
+    uint64_t lsn;
+    {
+        lock_guard lock(log_mutex_);
+        lsn = wal_->AppendRemoveDocument(document_id);
+        MarkPending(document_id, false);
+    }
+    Commit(lsn, lsn, {document_id}, [&] {
+        search_server_.RemoveDocument(document_id);
+    });
+}
+// snapshot is written to a temporary file and renamed, so a crash leaves either the old
+// or the new one; the log is emptied only after the new snapshot is durable
+void DurableSearchServer::Checkpoint() {
+    // nothing is appended meanwhile and everything logged is applied first,
+    // so the snapshot has every change up to its lsn
+    lock_guard log_lock(log_mutex_);
+    const uint64_t lsn = wal_->GetLastLsn();
+    {
+        unique_lock apply_lock(apply_mutex_);
+        applied_.wait(apply_lock, [this, lsn] {
+            return applied_lsn_ == lsn;
+        });
+    }
+    shared_lock lock(index_mutex_);
+    const string temporary_path = snapshot_path_ + ".tmp"s;
+    {
+        ofstream output(temporary_path, ios::binary | ios::trunc);
+        WriteBinary(output, lsn);
+        search_server_.SaveSnapshot(output);
+        output.flush();
+        if (!output) {
+            throw runtime_error("can't write "s + temporary_path);
+        }
+    }
+    SyncPath(temporary_path, O_RDONLY);
+    if (rename(temporary_path.c_str(), snapshot_path_.c_str()) != 0) {
+        throw runtime_error("can't replace "s + snapshot_path_);
+    }
+    SyncPath(snapshot_path_.substr(0, snapshot_path_.rfind('/')), O_RDONLY | O_DIRECTORY);
+    wal_->Truncate();
+}
+const RecoveryStats& DurableSearchServer::GetRecoveryStats() const {
+    return recovery_stats_;
+}
+WalStats DurableSearchServer::GetWalStats() const {
+    return wal_->GetStats();
+}
+WalReadResult DurableSearchServer::Recover() {
+    ifstream input(snapshot_path_, ios::binary);
+    if (input) {
+        recovery_stats_.snapshot_lsn = ReadBinary<uint64_t>(input);
+        search_server_.LoadSnapshot(input);
+        recovery_stats_.snapshot_documents = static_cast<size_t>(search_server_.GetDocumentCount());
+    }
+    WalReadResult log = WriteAheadLog::Read(wal_path_, recovery_stats_.snapshot_lsn);
+    recovery_stats_.discarded_bytes = log.file_bytes - log.valid_bytes;
+    recovery_stats_.replayed_records = log.records.size();
+    Replay(log.records);
+    log.records.clear();
+    return log;
+}
+void DurableSearchServer::Replay(vector<WalRecord>& records) {
+    vector<DocumentInput> batch;
+    const auto flush_batch = [&] {
+        search_server_.AddDocuments(execution::par, batch);
+        batch.clear();
+    };
+    for (WalRecord& record : records) {
+        if (record.type == WalRecordType::ADD_DOCUMENT) {
+            batch.push_back({record.document_id, record.text, record.status, move(record.ratings)});
+        } else {
+            flush_batch();
+            search_server_.RemoveDocument(record.document_id);
+        }
+    }
+    flush_batch();
+}
+void DurableSearchServer::CheckNewDocument(int document_id, string_view document, const set<int>& batch_ids) const {
+    if (document_id < 0 || batch_ids.count(document_id) > 0 || IsPresentAfterLog(document_id)) {
+        throw invalid_argument("id for adding doc isn't correct"s);
+    }
+    search_server_.CheckDocumentText(document);
+}
+bool DurableSearchServer::IsPresentAfterLog(int document_id) const {
+    if (const auto it = pending_changes_.find(document_id); it != pending_changes_.end()) {
+        return it->second.is_present;
+    }
+    shared_lock lock(index_mutex_);
+    return search_server_.HasDocument(document_id);
+}
+void DurableSearchServer::MarkPending(int document_id, bool is_present) {
+    PendingChange& change = pending_changes_[document_id];
+    change.is_present = is_present;
+    ++change.count;
+}
+void DurableSearchServer::Commit(uint64_t first_lsn, uint64_t last_lsn, const vector<int>& document_ids, const function<void()>& apply) {
+    exception_ptr error;
+    try {
+        wal_->WaitDurable(last_lsn);
+    } catch (...) {
+        error = current_exception();
+    }
+    {
+        unique_lock apply_lock(apply_mutex_);
+        applied_.wait(apply_lock, [this, first_lsn] {
+            return applied_lsn_ + 1 == first_lsn;
+        });
+        if (!error) {
+            try {
+                unique_lock lock(index_mutex_);
+                apply();
+            } catch (...) {
+                error = current_exception();
+            }
+        }
+        applied_lsn_ = last_lsn;
+    }
+    applied_.notify_all();
+    {
+        lock_guard lock(log_mutex_);
+        for (const int document_id : document_ids) {
+            const auto it = pending_changes_.find(document_id);
+            if (--it->second.count == 0) {
+                pending_changes_.erase(it);
+            }
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
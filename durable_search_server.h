@@ -0,0 +1,80 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <execution>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "search_server.h"
+#include "write_ahead_log.h"
+struct RecoveryStats {
+    // lsn stored in the snapshot, 0 without snapshot
+    uint64_t snapshot_lsn = 0;
+    size_t snapshot_documents = 0;
+    size_t replayed_records = 0;
+    // torn tail of the log cut off on open
+    uint64_t discarded_bytes = 0;
+};
+// SearchServer whose mutations survive a crash: every change is validated, appended to the
+// write-ahead log and applied to the index once the log is synced, in log order, so readers
+// see durable changes only and a failed write leaves the index unchanged.
+// Directory holds "snapshot" (lsn + SearchServer snapshot) and "wal";
+// on open the snapshot is loaded and log records after its lsn are replayed,
+// consecutive additions in parallel batches. Checkpoint writes a new snapshot and empties the log
+class DurableSearchServer {
+public:
+    DurableSearchServer(const std::string& directory, const std::string& stop_words_text, const WalOptions& options = WalOptions());
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // one group commit for the whole batch
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+    void RemoveDocument(int document_id);
+    void Checkpoint();
+
+    // callback gets const SearchServer&, changes wait while it runs
+    template <typename Callback>
+    auto Read(Callback callback) const {
+        std::shared_lock lock(index_mutex_);
+        return callback(search_server_);
+    }
+    const RecoveryStats& GetRecoveryStats() const;
+    WalStats GetWalStats() const;
+private:
+    // presence of a document after its changes which are logged but not applied yet
+    struct PendingChange {
+        bool is_present = false;
+        size_t count = 0;
+    };
+
+    // the log has to be opened after the snapshot lsn is known
+    WalReadResult Recover();
+    void Replay(std::vector<WalRecord>& records);
+    // throws invalid_argument if the document can't be added after the logged changes
+    void CheckNewDocument(int document_id, std::string_view document, const std::set<int>& batch_ids) const;
+    bool IsPresentAfterLog(int document_id) const;
+    void MarkPending(int document_id, bool is_present);
+    // waits until records first_lsn..last_lsn are durable and the ones before them are applied,
+    // then applies them unless the log failed
+    void Commit(uint64_t first_lsn, uint64_t last_lsn, const std::vector<int>& document_ids, const std::function<void()>& apply);
+
+    const std::string snapshot_path_;
+    const std::string wal_path_;
+    SearchServer search_server_;
+    mutable std::shared_mutex index_mutex_;
+    // writers validate and append under it, so the log is a valid sequence of changes
+    std::mutex log_mutex_;
+    std::map<int, PendingChange> pending_changes_;
+    // changes are applied in log order
+    std::mutex apply_mutex_;
+    std::condition_variable applied_;
+    uint64_t applied_lsn_ = 0;
+    RecoveryStats recovery_stats_;
+    // opened after recovery, with the log read by it
+    std::optional<WriteAheadLog> wal_;
+};
@@ -0,0 +1,347 @@
+#include "frozen_index.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+namespace {
+const uint64_t FROZEN_INDEX_MAGIC = 0x5844494e5a525246;  // "FRRZNIDX"
+const uint32_t FROZEN_INDEX_VERSION = 1;
+
+size_t AlignUp(size_t offset) {
+    return (offset + 7) & ~size_t(7);
+}
+template <typename T>
+void WriteAt(vector<char>& image, size_t offset, const T& value) {
+    memcpy(image.data() + offset, &value, sizeof(value));
+}
+// generation of a valid image at path, 0 if there is none
+uint64_t ReadGeneration(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    FrozenIndexHeader header;
+    const bool is_read = read(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+    close(fd);
+    return is_read && header.magic == FROZEN_INDEX_MAGIC ? header.generation : 0;
+}
+// makes a rename inside the directory of path durable
+void SyncParentDirectory(const string& path) {
+    const size_t slash = path.rfind('/');
+    const string directory = slash == string::npos ? "."s : slash == 0 ? "/"s : path.substr(0, slash);
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    const bool is_synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!is_synced) {
+        throw runtime_error("can't sync "s + directory);
+    }
+}
+}  // namespace
+
+vector<char> BuildFrozenIndex(const SearchServer& search_server, uint64_t generation) {
+    // words of current documents with postings as (ordinal, term frequency)
+    map<string_view, vector<pair<uint32_t, double>>> word_to_postings;
+    vector<FrozenDocument> documents;
+    for (const int document_id : search_server) {
+        const uint32_t ordinal = static_cast<uint32_t>(documents.size());
+        documents.push_back({document_id, search_server.GetDocumentRating(document_id),
+                             static_cast<int32_t>(search_server.GetDocumentStatus(document_id)), 0});
+        for (const auto& [word, term_freq] : search_server.GetWordFrequencies(document_id)) {
+            word_to_postings[word].push_back({ordinal, term_freq});
+        }
+    }
+    FrozenIndexHeader header{};
+    header.magic = FROZEN_INDEX_MAGIC;
+    header.version = FROZEN_INDEX_VERSION;
+    header.generation = generation;
+    header.document_count = documents.size();
+    header.word_count = word_to_postings.size();
+    size_t char_count = 0;
+    for (const auto& [word, postings] : word_to_postings) {
+        char_count += word.size();
+        header.posting_count += postings.size();
+    }
+    header.documents_offset = AlignUp(sizeof(header));
+    header.words_offset = AlignUp(header.documents_offset + documents.size() * sizeof(FrozenDocument));
+    header.chars_offset = AlignUp(header.words_offset + header.word_count * sizeof(FrozenWord));
+    header.ordinals_offset = AlignUp(header.chars_offset + char_count);
+    header.freqs_offset = AlignUp(header.ordinals_offset + header.posting_count * sizeof(uint32_t));
+    header.total_size = header.freqs_offset + header.posting_count * sizeof(double);
+
+    vector<char> image(header.total_size, '\0');
+    WriteAt(image, 0, header);
+    if (!documents.empty()) {
+        memcpy(image.data() + header.documents_offset, documents.data(), documents.size() * sizeof(FrozenDocument));
+    }
+    size_t word_offset = header.words_offset;
+    uint64_t chars_begin = 0;
+    uint64_t posting = 0;
+    for (const auto& [word, postings] : word_to_postings) {
+        WriteAt(image, word_offset, FrozenWord{chars_begin, static_cast<uint32_t>(word.size()), 0, posting, posting + postings.size()});
+        word_offset += sizeof(FrozenWord);
+        memcpy(image.data() + header.chars_offset + chars_begin, word.data(), word.size());
+        chars_begin += word.size();
+        for (const auto& [ordinal, term_freq] : postings) {
+            WriteAt(image, header.ordinals_offset + posting * sizeof(uint32_t), ordinal);
+            WriteAt(image, header.freqs_offset + posting * sizeof(double), term_freq);
+            ++posting;
+        }
+    }
+    return image;
+}
+uint64_t WriteFrozenIndex(const SearchServer& search_server, const string& path) {
+    const uint64_t generation = ReadGeneration(path) + 1;
+    const vector<char> image = BuildFrozenIndex(search_server, generation);
+    const string temporary_path = path + ".tmp"s;
+    const int fd = open(temporary_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw runtime_error("can't create "s + temporary_path);
+    }
+    size_t written = 0;
+    while (written < image.size()) {
+        const ssize_t count = write(fd, image.data() + written, image.size() - written);
+        if (count < 0 && errno != EINTR) {
+            close(fd);
+            throw runtime_error("can't write "s + temporary_path);
+        }
+        written += count > 0 ? static_cast<size_t>(count) : 0;
+    }
+    const bool is_synced = fsync(fd) == 0;
+    close(fd);
+    if (!is_synced || rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw runtime_error("can't replace "s + path);
+    }
+    SyncParentDirectory(path);
+    return generation;
+}
+
+FrozenIndexView::FrozenIndexView(const char* data, size_t size) {
+    if (size < sizeof(FrozenIndexHeader) || reinterpret_cast<uintptr_t>(data) % alignof(FrozenIndexHeader) != 0) {
+        throw runtime_error("frozen index is corrupted"s);
+    }
+    header_ = reinterpret_cast<const FrozenIndexHeader*>(data);
+    const FrozenIndexHeader& header = *header_;
+    // every section has to fit into the image
+    const auto fits = [size](uint64_t offset, uint64_t count, size_t item_size) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / item_size;
+    };
+    if (header.magic != FROZEN_INDEX_MAGIC || header.version != FROZEN_INDEX_VERSION || header.total_size != size
+        || !fits(header.documents_offset, header.document_count, sizeof(FrozenDocument))
+        || !fits(header.words_offset, header.word_count, sizeof(FrozenWord))
+        || !fits(header.ordinals_offset, header.posting_count, sizeof(uint32_t))
+        || !fits(header.freqs_offset, header.posting_count, sizeof(double))
+        || header.chars_offset > size) {
+        throw runtime_error("frozen index is corrupted"s);
+    }
+    documents_ = reinterpret_cast<const FrozenDocument*>(data + header.documents_offset);
+    words_ = reinterpret_cast<const FrozenWord*>(data + header.words_offset);
+    chars_ = data + header.chars_offset;
+    ordinals_ = reinterpret_cast<const uint32_t*>(data + header.ordinals_offset);
+    freqs_ = reinterpret_cast<const double*>(data + header.freqs_offset);
+    for (uint64_t i = 0; i < header.word_count; ++i) {
+        const FrozenWord& word = words_[i];
+        if (word.chars_begin + word.length > size - header.chars_offset
+            || word.postings_begin > word.postings_end || word.postings_end > header.posting_count) {
+            throw runtime_error("frozen index is corrupted"s);
+        }
+    }
+    for (uint64_t i = 0; i < header.posting_count; ++i) {
+        if (ordinals_[i] >= header.document_count) {
+            throw runtime_error("frozen index is corrupted"s);
+        }
+    }
+}
+vector<Document> FrozenIndexView::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+}
+vector<Document> FrozenIndexView::FindTopDocuments(const string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+tuple<vector<string_view>, DocumentStatus> FrozenIndexView::MatchDocument(const string_view raw_query, int document_id) const {
+    const uint32_t ordinal = GetOrdinal(document_id);
+    const Query query = ParseQuery(raw_query);
+    vector<string_view> matched_words;
+    for (const FrozenWord* word : query.minus_words) {
+        if (Contains(*word, ordinal)) {
+            return {matched_words, static_cast<DocumentStatus>(documents_[ordinal].status)};
+        }
+    }
+    for (const FrozenWord* word : query.plus_words) {
+        if (Contains(*word, ordinal)) {
+            matched_words.push_back(GetWordText(*word));
+        }
+    }
+    return {matched_words, static_cast<DocumentStatus>(documents_[ordinal].status)};
+}
+int FrozenIndexView::GetDocumentCount() const {
+    return static_cast<int>(header_->document_count);
+}
+uint64_t FrozenIndexView::GetGeneration() const {
+    return header_->generation;
+}
+size_t FrozenIndexView::EstimateQueryCost(const string_view raw_query) const {
+    const Query query = ParseQuery(raw_query);
+    size_t postings = 0;
+    for (const auto* words : {&query.plus_words, &query.minus_words}) {
+        for (const FrozenWord* word : *words) {
+            postings += word->postings_end - word->postings_begin;
+        }
+    }
+    return postings;
+}
+size_t FrozenIndexView::Prefetch(const string_view raw_query) const {
+    static const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const Query query = ParseQuery(raw_query);
+    size_t advised_bytes = 0;
+    const auto advise = [&](const void* begin, const void* end) {
+        // madvise takes whole pages
+        const uintptr_t first = reinterpret_cast<uintptr_t>(begin) & ~(page_size - 1);
+        const uintptr_t last = reinterpret_cast<uintptr_t>(end);
+        if (last > first && madvise(reinterpret_cast<void*>(first), last - first, MADV_WILLNEED) == 0) {
+            advised_bytes += last - first;
+        }
+    };
+    for (const auto* words : {&query.plus_words, &query.minus_words}) {
+        for (const FrozenWord* word : *words) {
+            advise(ordinals_ + word->postings_begin, ordinals_ + word->postings_end);
+            advise(freqs_ + word->postings_begin, freqs_ + word->postings_end);
+        }
+    }
+    return advised_bytes;
+}
+// words absent from the image (stop words among them) are dropped and `word*` is expanded
+// like in SearchServer; the image has no fuzzy index, so '~' is a part of the word like in
+// SearchServer without fuzzy matching
+FrozenIndexView::Query FrozenIndexView::ParseQuery(const string_view raw_query) const {
+    set<const FrozenWord*> plus_words;
+    set<const FrozenWord*> minus_words;
+    for (const string_view text : SplitIntoWordsView(raw_query)) {
+        const QueryWord query_word = ParseQueryWord(text);
+        const string_view data = query_word.data;
+        auto& words = query_word.is_minus ? minus_words : plus_words;
+        if (data.size() > 1 && data.back() == '*') {
+            const size_t max_words = query_word.is_minus ? numeric_limits<size_t>::max() : SearchServer::MAX_PREFIX_EXPANSIONS;
+            for (const FrozenWord* word : FindWordsByPrefix(data.substr(0, data.size() - 1), max_words)) {
+                words.insert(word);
+            }
+        } else if (const FrozenWord* word = FindWord(data)) {
+            words.insert(word);
+        }
+    }
+    return {vector<const FrozenWord*>(plus_words.begin(), plus_words.end()),
+            vector<const FrozenWord*>(minus_words.begin(), minus_words.end())};
+}
+const FrozenWord* FrozenIndexView::FindWord(const string_view text) const {
+    const FrozenWord* last = words_ + header_->word_count;
+    const FrozenWord* it = lower_bound(words_, last, text, [this](const FrozenWord& word, string_view value) {
+        return GetWordText(word) < value;
+    });
+    return it != last && GetWordText(*it) == text ? it : nullptr;
+}
+// more frequent first and in lexical order among equally frequent, as SearchServer::FindWordsByPrefix
+vector<const FrozenWord*> FrozenIndexView::FindWordsByPrefix(const string_view prefix, size_t max_words) const {
+    const FrozenWord* last = words_ + header_->word_count;
+    const FrozenWord* it = lower_bound(words_, last, prefix, [this](const FrozenWord& word, string_view value) {
+        return GetWordText(word) < value;
+    });
+    vector<const FrozenWord*> matched;
+    for (; it != last && GetWordText(*it).substr(0, prefix.size()) == prefix; ++it) {
+        matched.push_back(it);
+    }
+    // words are stored in lexical order, so pointers compare like their texts
+    const auto by_frequency = [](const FrozenWord* lhs, const FrozenWord* rhs) {
+        const uint64_t lhs_count = lhs->postings_end - lhs->postings_begin;
+        const uint64_t rhs_count = rhs->postings_end - rhs->postings_begin;
+        if (lhs_count != rhs_count) {
+            return lhs_count > rhs_count;
+        }
+        return lhs < rhs;
+    };
+    const size_t count = min(max_words, matched.size());
+    partial_sort(matched.begin(), matched.begin() + count, matched.end(), by_frequency);
+    matched.resize(count);
+    return matched;
+}
+string_view FrozenIndexView::GetWordText(const FrozenWord& word) const {
+    return string_view(chars_ + word.chars_begin, word.length);
+}
+double FrozenIndexView::ComputeWordInverseDocumentFreq(const FrozenWord& word) const {
+    return log(GetDocumentCount() * 1.0 / (word.postings_end - word.postings_begin));
+}
+uint32_t FrozenIndexView::GetOrdinal(int document_id) const {
+    const FrozenDocument* last = documents_ + header_->document_count;
+    const FrozenDocument* it = lower_bound(documents_, last, document_id, [](const FrozenDocument& document, int id) {
+        return document.id < id;
+    });
+    if (it == last || it->id != document_id) {
+        throw out_of_range("no document "s + to_string(document_id));
+    }
+    return static_cast<uint32_t>(it - documents_);
+}
+bool FrozenIndexView::Contains(const FrozenWord& word, uint32_t ordinal) const {
+    return binary_search(ordinals_ + word.postings_begin, ordinals_ + word.postings_end, ordinal);
+}
+
+MappedFrozenIndex::MappedFrozenIndex(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error("can't open "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        throw runtime_error("frozen index is corrupted"s);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    inode_ = file_stat.st_ino;
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = nullptr;
+        throw runtime_error("can't map "s + path);
+    }
+    try {
+        view_ = make_unique<FrozenIndexView>(static_cast<const char*>(data_), size_);
+    } catch (...) {
+        munmap(data_, size_);
+        throw;
+    }
+}
+MappedFrozenIndex::~MappedFrozenIndex() {
+    munmap(data_, size_);
+}
+const FrozenIndexView& MappedFrozenIndex::GetView() const {
+    return *view_;
+}
+ino_t MappedFrozenIndex::GetInode() const {
+    return inode_;
+}
+
+FrozenIndexReader::FrozenIndexReader(string path)
+        : path_(move(path))
+        , current_(make_shared<const MappedFrozenIndex>(path_)) {
+}
+shared_ptr<const MappedFrozenIndex> FrozenIndexReader::Get() const {
+    lock_guard lock(mutex_);
+    return current_;
+}
+bool FrozenIndexReader::Refresh() {
+    struct stat file_stat;
+    if (stat(path_.c_str(), &file_stat) != 0 || file_stat.st_ino == Get()->GetInode()) {
+        return false;
+    }
+    auto next = make_shared<const MappedFrozenIndex>(path_);
+    lock_guard lock(mutex_);
+    current_ = move(next);
+    return true;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <sys/types.h>
+#include "document.h"
+#include "search_server.h"
+// Read-only index image with offsets instead of pointers, so it can be mapped at any address
+// and shared between processes. Layout (host byte order, 8-byte aligned sections):
+//   FrozenIndexHeader
+//   documents  FrozenDocument[document_count], sorted by id
+//   words      FrozenWord[word_count], sorted by text
+//   chars      texts of the words
+//   ordinals   uint32_t[posting_count], positions in documents, sorted inside a word
+//   freqs      double[posting_count], term frequencies next to ordinals
+// Relevance is computed as in SearchServer, so results are the same.
+struct FrozenIndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t generation;
+    uint64_t total_size;
+    uint64_t document_count;
+    uint64_t word_count;
+    uint64_t posting_count;
+    uint64_t documents_offset;
+    uint64_t words_offset;
+    uint64_t chars_offset;
+    uint64_t ordinals_offset;
+    uint64_t freqs_offset;
+};
+struct FrozenDocument {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    uint32_t reserved;
+};
+struct FrozenWord {
+    uint64_t chars_begin;
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t postings_begin;
+    uint64_t postings_end;
+};
+
+std::vector<char> BuildFrozenIndex(const SearchServer& search_server, uint64_t generation = 1);
+// the image is written next to path and renamed over it, so readers see either the old
+// or the new generation; generation is the one of the replaced image + 1.
+// A path under /dev/shm keeps the image in POSIX shared memory
+uint64_t WriteFrozenIndex(const SearchServer& search_server, const std::string& path);
+
+// queries over an image in memory, the memory has to outlive the view.
+// Query syntax is the one of SearchServer without fuzzy matching: '~' is a part of the word
+class FrozenIndexView {
+public:
+    // throws runtime_error if the image is malformed
+    FrozenIndexView(const char* data, size_t size);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
+        const auto [plus_words, minus_words] = ParseQuery(raw_query);
+        std::map<uint32_t, double> ordinal_to_relevance;
+        for (const FrozenWord* word : plus_words) {
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(*word);
+            for (uint64_t posting = word->postings_begin; posting < word->postings_end; ++posting) {
+                const FrozenDocument& document = documents_[ordinals_[posting]];
+                if (document_predicate(document.id, static_cast<DocumentStatus>(document.status), document.rating)) {
+                    ordinal_to_relevance[ordinals_[posting]] += freqs_[posting] * inverse_document_freq;
+                }
+            }
+        }
+        for (const FrozenWord* word : minus_words) {
+            for (uint64_t posting = word->postings_begin; posting < word->postings_end; ++posting) {
+                ordinal_to_relevance.erase(ordinals_[posting]);
+            }
+        }
+        std::vector<Document> matched_documents;
+        for (const auto [ordinal, relevance] : ordinal_to_relevance) {
+            matched_documents.push_back({documents_[ordinal].id, relevance, documents_[ordinal].rating});
+        }
+        SearchServer::SelectTopDocuments(std::execution::seq, matched_documents);
+        return matched_documents;
+    }
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+    // words point into the image, throws out_of_range for unknown document
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+    uint64_t GetGeneration() const;
+    // postings of the words of the query, as SearchServer::EstimateQueryCost
+    size_t EstimateQueryCost(const std::string_view raw_query) const;
+    // advises the kernel to read ahead the postings of the words of the query (madvise
+    // MADV_WILLNEED on their pages), returns bytes advised
+    size_t Prefetch(const std::string_view raw_query) const;
+private:
+    struct Query {
+        // ordered by word text like SearchServer::Query, so relevance is summed in the same order
+        std::vector<const FrozenWord*> plus_words;
+        std::vector<const FrozenWord*> minus_words;
+    };
+    Query ParseQuery(const std::string_view raw_query) const;
+    const FrozenWord* FindWord(const std::string_view text) const;
+    std::vector<const FrozenWord*> FindWordsByPrefix(const std::string_view prefix, size_t max_words) const;
+    std::string_view GetWordText(const FrozenWord& word) const;
+    double ComputeWordInverseDocumentFreq(const FrozenWord& word) const;
+    // position of the document in documents_, throws out_of_range
+    uint32_t GetOrdinal(int document_id) const;
+    bool Contains(const FrozenWord& word, uint32_t ordinal) const;
+
+    const FrozenIndexHeader* header_;
+    const FrozenDocument* documents_;
+    const FrozenWord* words_;
+    const char* chars_;
+    const uint32_t* ordinals_;
+    const double* freqs_;
+};
+
+// read-only shared mapping of an image file
+class MappedFrozenIndex {
+public:
+    explicit MappedFrozenIndex(const std::string& path);
+    MappedFrozenIndex(const MappedFrozenIndex&) = delete;
+    MappedFrozenIndex& operator=(const MappedFrozenIndex&) = delete;
+    ~MappedFrozenIndex();
+
+    const FrozenIndexView& GetView() const;
+    // identity of the mapped file, a new generation is a new file
+    ino_t GetInode() const;
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    ino_t inode_ = 0;
+    std::unique_ptr<FrozenIndexView> view_;
+};
+
+// current generation of an image path; Refresh maps a replaced file and swaps it in,
+// queries keep the generation they started with until they drop its pointer
+class FrozenIndexReader {
+public:
+    explicit FrozenIndexReader(std::string path);
+
+    std::shared_ptr<const MappedFrozenIndex> Get() const;
+    // true if a new generation was mapped
+    bool Refresh();
+private:
+    const std::string path_;
+    mutable std::mutex mutex_;
+    std::shared_ptr<const MappedFrozenIndex> current_;
+};
@@ -0,0 +1,176 @@
+#include "fuzzy_index.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+using namespace std;
+namespace {
+// code points of UTF-8 text with their bytes packed into one number;
+// a stray continuation byte counts as a character
+void SplitCharacters(string_view word, vector<uint32_t>& characters) {
+    characters.clear();
+    for (const char c : word) {
+        const auto byte = static_cast<unsigned char>(c);
+        if ((byte & 0xC0) == 0x80 && !characters.empty() && characters.back() >= 0xC0 && characters.back() <= 0xFFFFFF) {
+            characters.back() = (characters.back() << 8) | byte;
+        } else {
+            characters.push_back(byte);
+        }
+    }
+}
+vector<uint32_t> SplitCharacters(string_view word) {
+    vector<uint32_t> characters;
+    SplitCharacters(word, characters);
+    return characters;
+}
+
+// FNV-1a
+uint64_t HashCharacters(const vector<uint32_t>& characters) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const uint32_t character : characters) {
+        hash = (hash ^ character) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void CollectDeletions(const vector<uint32_t>& characters, size_t distance, unordered_set<uint64_t>& hashes) {
+    hashes.insert(HashCharacters(characters));
+    if (distance == 0 || characters.empty()) {
+        return;
+    }
+    vector<uint32_t> shorter(characters.size() - 1);
+    for (size_t i = 0; i < characters.size(); ++i) {
+        copy(characters.begin(), characters.begin() + i, shorter.begin());
+        copy(characters.begin() + i + 1, characters.end(), shorter.begin() + i);
+        CollectDeletions(shorter, distance - 1, hashes);
+    }
+}
+
+vector<uint32_t> TakePrefix(vector<uint32_t> characters, size_t length) {
+    if (characters.size() > length) {
+        characters.resize(length);
+    }
+    return characters;
+}
+
+// Levenshtein distance or max_distance + 1 if it is larger, rows are buffers of the caller
+size_t ComputeDistance(const vector<uint32_t>& lhs, const vector<uint32_t>& rhs, size_t max_distance,
+                       vector<size_t>& previous, vector<size_t>& current) {
+    const size_t length_difference = lhs.size() > rhs.size() ? lhs.size() - rhs.size() : rhs.size() - lhs.size();
+    if (length_difference > max_distance) {
+        return max_distance + 1;
+    }
+    previous.resize(rhs.size() + 1);
+    current.resize(rhs.size() + 1);
+    for (size_t j = 0; j <= rhs.size(); ++j) {
+        previous[j] = j;
+    }
+    for (size_t i = 1; i <= lhs.size(); ++i) {
+        current[0] = i;
+        size_t row_min = current[0];
+        for (size_t j = 1; j <= rhs.size(); ++j) {
+            const size_t substitution = previous[j - 1] + (lhs[i - 1] == rhs[j - 1] ? 0 : 1);
+            current[j] = min({previous[j] + 1, current[j - 1] + 1, substitution});
+            row_min = min(row_min, current[j]);
+        }
+        if (row_min > max_distance) {
+            return max_distance + 1;
+        }
+        swap(previous, current);
+    }
+    return min(previous[rhs.size()], max_distance + 1);
+}
+}
+
+FuzzyIndex::FuzzyIndex(size_t max_distance, size_t prefix_length)
+        : max_distance_(max_distance)
+        , prefix_length_(prefix_length) {
+    if (max_distance == 0 || max_distance > MAX_DISTANCE) {
+        throw invalid_argument("fuzzy distance has to be 1 or 2"s);
+    }
+    if (prefix_length <= max_distance) {
+        throw invalid_argument("fuzzy prefix has to be longer than the distance"s);
+    }
+}
+void FuzzyIndex::AddWord(string_view word) {
+    const auto word_id = static_cast<uint32_t>(words_.size());
+    words_.push_back(word);
+    unordered_set<uint64_t> hashes;
+    CollectDeletions(TakePrefix(SplitCharacters(word), prefix_length_), max_distance_, hashes);
+    for (const uint64_t hash : hashes) {
+        deletions_[hash].push_back(word_id);
+    }
+    stored_ids_ += hashes.size();
+}
+// the word is found among ids stored under its own undeleted prefix
+void FuzzyIndex::RemoveWord(string_view word) {
+    const vector<uint32_t> prefix = TakePrefix(SplitCharacters(word), prefix_length_);
+    const auto own = deletions_.find(HashCharacters(prefix));
+    if (own == deletions_.end()) {
+        return;
+    }
+    const auto id = find_if(own->second.begin(), own->second.end(), [&](uint32_t word_id) {
+        return words_[word_id] == word;
+    });
+    if (id == own->second.end()) {
+        return;
+    }
+    const uint32_t word_id = *id;
+    unordered_set<uint64_t> hashes;
+    CollectDeletions(prefix, max_distance_, hashes);
+    for (const uint64_t hash : hashes) {
+        const auto it = deletions_.find(hash);
+        if (it == deletions_.end()) {
+            continue;
+        }
+        auto& ids = it->second;
+        ids.erase(remove(ids.begin(), ids.end(), word_id), ids.end());
+        if (ids.empty()) {
+            deletions_.erase(it);
+        }
+    }
+    stored_ids_ -= hashes.size();
+    words_[word_id] = {};
+    ++removed_words_;
+}
+vector<FuzzyIndex::Match> FuzzyIndex::FindWords(string_view word, size_t max_distance) const {
+    max_distance = min(max_distance, max_distance_);
+    const vector<uint32_t> characters = SplitCharacters(word);
+    unordered_set<uint64_t> hashes;
+    CollectDeletions(TakePrefix(characters, prefix_length_), max_distance, hashes);
+    vector<uint32_t> candidates;
+    for (const uint64_t hash : hashes) {
+        const auto it = deletions_.find(hash);
+        if (it != deletions_.end()) {
+            candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+        }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+    vector<Match> matches;
+    vector<uint32_t> candidate_characters;
+    vector<size_t> previous_row;
+    vector<size_t> current_row;
+    for (const uint32_t word_id : candidates) {
+        SplitCharacters(words_[word_id], candidate_characters);
+        const size_t distance = ComputeDistance(characters, candidate_characters, max_distance, previous_row, current_row);
+        if (distance <= max_distance) {
+            matches.push_back({words_[word_id], distance});
+        }
+    }
+    sort(matches.begin(), matches.end(), [](const Match& lhs, const Match& rhs) {
+        return lhs.distance != rhs.distance ? lhs.distance < rhs.distance : lhs.word < rhs.word;
+    });
+    return matches;
+}
+size_t FuzzyIndex::GetMaxDistance() const {
+    return max_distance_;
+}
+size_t FuzzyIndex::GetWordCount() const {
+    return words_.size() - removed_words_;
+}
+size_t FuzzyIndex::GetMemoryBytes() const {
+    // node of the hash table with its key and vector, a bucket pointer, stored ids
+    return deletions_.size() * (sizeof(void*) + sizeof(uint64_t) + sizeof(vector<uint32_t>) + sizeof(void*))
+           + stored_ids_ * sizeof(uint32_t) + words_.capacity() * sizeof(string_view);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+// symmetric deletion index for typo-tolerant lookup (SymSpell): every word is stored under
+// all strings obtained from it by deleting up to max_distance characters, a query word
+// generates its own deletions and candidates sharing one are verified by edit distance.
+// Only the first prefix_length characters are used for deletions: a longer prefix makes
+// the index larger, a shorter one gives more candidates to verify.
+// Characters are UTF-8 code points, distance is Levenshtein.
+class FuzzyIndex {
+public:
+    static constexpr size_t MAX_DISTANCE = 2;
+    struct Match {
+        std::string_view word;
+        size_t distance;
+    };
+
+    // throws invalid_argument if max_distance is 0 or above MAX_DISTANCE,
+    // or prefix_length is not above max_distance
+    explicit FuzzyIndex(size_t max_distance = 1, size_t prefix_length = 7);
+
+    // the word has to outlive the index and be added once
+    void AddWord(std::string_view word);
+    // the text is not referenced after the call, unknown words are ignored
+    void RemoveWord(std::string_view word);
+    // indexed words within max_distance (capped by the one of the index),
+    // nearest first and in lexical order among equally near
+    std::vector<Match> FindWords(std::string_view word, size_t max_distance) const;
+
+    size_t GetMaxDistance() const;
+    size_t GetWordCount() const;
+    // approximate heap size of the deletion table
+    size_t GetMemoryBytes() const;
+private:
+    size_t max_distance_;
+    size_t prefix_length_;
+    // removed words leave empty slots, ids are not reused
+    std::vector<std::string_view> words_;
+    size_t removed_words_ = 0;
+    // hash of a deletion -> ids of words producing it, collisions are removed by verification
+    std::unordered_map<uint64_t, std::vector<uint32_t>> deletions_;
+    size_t stored_ids_ = 0;
+};
@@ -0,0 +1,169 @@
+#include "head_term_cache.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+using namespace std;
+HeadTermCache::HeadTermCache(size_t capacity, size_t top_k)
+        : capacity_(capacity)
+        , top_k_(top_k) {
+    if (capacity < top_k) {
+        throw invalid_argument("head term cache has to hold the top"s);
+    }
+}
+HeadTermCache::HeadTermCache(const HeadTermCache& other)
+        : capacity_(other.capacity_)
+        , top_k_(other.top_k_) {
+    lock_guard lock(other.mutex_);
+    entries_ = other.entries_;
+    for (size_t i = 0; i < word_filter_.size(); ++i) {
+        word_filter_[i] = other.word_filter_[i].load();
+    }
+    is_empty_ = entries_.empty();
+}
+HeadTermCache& HeadTermCache::operator=(const HeadTermCache& other) {
+    if (this != &other) {
+        scoped_lock lock(mutex_, other.mutex_);
+        capacity_ = other.capacity_;
+        top_k_ = other.top_k_;
+        entries_ = other.entries_;
+        for (size_t i = 0; i < word_filter_.size(); ++i) {
+            word_filter_[i] = other.word_filter_[i].load();
+        }
+        is_empty_ = entries_.empty();
+    }
+    return *this;
+}
+shared_ptr<const HeadTermCache::Entry> HeadTermCache::Find(string_view word, DocumentStatus status) const {
+    if (!MayContain(word)) {
+        return nullptr;
+    }
+    lock_guard lock(mutex_);
+    const auto it = entries_.find(pair{word, status});
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+shared_ptr<const HeadTermCache::Entry> HeadTermCache::Build(string_view word, DocumentStatus status, vector<Candidate> postings) {
+    auto entry_ptr = make_shared<Entry>();
+    Entry& entry = *entry_ptr;
+    if (postings.size() > capacity_) {
+        nth_element(postings.begin(), postings.begin() + capacity_, postings.end(), IsRankedBefore);
+        entry.excluded_term_freq = max_element(postings.begin() + capacity_, postings.end(), [](const Candidate& lhs, const Candidate& rhs) {
+            return lhs.term_freq < rhs.term_freq;
+        })->term_freq;
+        postings.resize(capacity_);
+    }
+    sort(postings.begin(), postings.end(), IsRankedBefore);
+    entry.candidates = move(postings);
+    TrimTies(entry);
+    const auto [index, bit] = GetWordBit(word);
+    lock_guard lock(mutex_);
+    word_filter_[index] |= bit;
+    is_empty_ = false;
+    const auto it = entries_.find(pair{word, status});
+    if (it == entries_.end()) {
+        entries_.emplace(Key{string(word), status}, entry_ptr);
+    } else {
+        it->second = entry_ptr;
+    }
+    return entry_ptr;
+}
+void HeadTermCache::AddPosting(string_view word, DocumentStatus status, const Candidate& posting) {
+    if (!MayContain(word)) {
+        return;
+    }
+    lock_guard lock(mutex_);
+    const auto it = entries_.find(pair{word, status});
+    if (it == entries_.end()) {
+        return;
+    }
+    Entry& entry = GetMutable(it->second);
+    auto& candidates = entry.candidates;
+    const auto position = upper_bound(candidates.begin(), candidates.end(), posting, IsRankedBefore);
+    // a document after the last candidate can only be taken while nothing is left out
+    if (position == candidates.end() && entry.excluded_term_freq) {
+        entry.excluded_term_freq = max(*entry.excluded_term_freq, posting.term_freq);
+    } else {
+        candidates.insert(position, posting);
+        if (candidates.size() > capacity_) {
+            entry.excluded_term_freq = max(entry.excluded_term_freq.value_or(0.0), candidates.back().term_freq);
+            candidates.pop_back();
+        }
+    }
+    TrimTies(entry);
+}
+void HeadTermCache::RemovePosting(string_view word, DocumentStatus status, int document_id) {
+    if (!MayContain(word)) {
+        return;
+    }
+    lock_guard lock(mutex_);
+    const auto it = entries_.find(pair{word, status});
+    if (it == entries_.end()) {
+        return;
+    }
+    const auto is_removed = [document_id](const Candidate& candidate) {
+        return candidate.document_id == document_id;
+    };
+    if (none_of(it->second->candidates.begin(), it->second->candidates.end(), is_removed)) {
+        return;
+    }
+    auto& candidates = GetMutable(it->second).candidates;
+    candidates.erase(remove_if(candidates.begin(), candidates.end(), is_removed), candidates.end());
+}
+void HeadTermCache::RemoveDocuments(const vector<int>& document_ids) {
+    lock_guard lock(mutex_);
+    const auto is_removed = [&document_ids](const Candidate& candidate) {
+        return binary_search(document_ids.begin(), document_ids.end(), candidate.document_id);
+    };
+    for (auto& [_, entry] : entries_) {
+        if (none_of(entry->candidates.begin(), entry->candidates.end(), is_removed)) {
+            continue;
+        }
+        auto& candidates = GetMutable(entry).candidates;
+        candidates.erase(remove_if(candidates.begin(), candidates.end(), is_removed), candidates.end());
+    }
+}
+bool HeadTermCache::IsEmpty() const {
+    return is_empty_;
+}
+void HeadTermCache::Clear() {
+    lock_guard lock(mutex_);
+    entries_.clear();
+    for (auto& bits : word_filter_) {
+        bits = 0;
+    }
+    is_empty_ = true;
+}
+bool HeadTermCache::IsRankedBefore(const Candidate& lhs, const Candidate& rhs) {
+    if (lhs.term_freq != rhs.term_freq) {
+        return lhs.term_freq > rhs.term_freq;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.document_id < rhs.document_id;
+}
+void HeadTermCache::TrimTies(Entry& entry) const {
+    if (!entry.excluded_term_freq) {
+        return;
+    }
+    while (entry.candidates.size() > top_k_ && entry.candidates.back().term_freq <= *entry.excluded_term_freq) {
+        entry.candidates.pop_back();
+    }
+}
+HeadTermCache::Entry& HeadTermCache::GetMutable(shared_ptr<Entry>& entry) {
+    // under the lock nobody else can take a new reference, so a single owner is us
+    if (entry.use_count() > 1) {
+        entry = make_shared<Entry>(*entry);
+    }
+    return *entry;
+}
+pair<size_t, uint64_t> HeadTermCache::GetWordBit(string_view word) {
+    const size_t hash = std::hash<string_view>{}(word);
+    return {hash / 64 % 64, uint64_t{1} << (hash % 64)};
+}
+bool HeadTermCache::MayContain(string_view word) const {
+    const auto [index, bit] = GetWordBit(word);
+    return (word_filter_[index].load(memory_order_relaxed) & bit) != 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "document.h"
+// best postings of frequent words kept for single word queries, one list per word and status.
+// Within one word relevance is term frequency times the same idf, so the order by
+// term frequency, then rating, then id doesn't depend on idf and survives indexing;
+// the caller checks with the current idf that the list still holds the top.
+// Safe to use from several threads, a copy gets its own lock. Entries handed out
+// are never changed, updates copy an entry still in use.
+class HeadTermCache {
+public:
+    struct Candidate {
+        int document_id;
+        double term_freq;
+        int rating;
+    };
+    struct Entry {
+        // best documents of the status containing the word, in the order above
+        std::vector<Candidate> candidates;
+        // upper bound of term frequency of the documents left out, nullopt if there are none
+        std::optional<double> excluded_term_freq;
+    };
+
+    // entries hold capacity candidates at most, but never drop below top_k because of ties
+    HeadTermCache(size_t capacity, size_t top_k);
+    HeadTermCache(const HeadTermCache& other);
+    HeadTermCache& operator=(const HeadTermCache& other);
+
+    // nullptr if the word isn't cached for the status
+    std::shared_ptr<const Entry> Find(std::string_view word, DocumentStatus status) const;
+    // postings of the word for documents of the status, any order; returns the new entry
+    std::shared_ptr<const Entry> Build(std::string_view word, DocumentStatus status, std::vector<Candidate> postings);
+    // keep existing entries of the word up to date, other words and statuses are not touched
+    void AddPosting(std::string_view word, DocumentStatus status, const Candidate& posting);
+    void RemovePosting(std::string_view word, DocumentStatus status, int document_id);
+    // candidates of the documents are dropped from every entry, ids ascending
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    bool IsEmpty() const;
+    void Clear();
+
+    static bool IsRankedBefore(const Candidate& lhs, const Candidate& rhs);
+private:
+    using Key = std::pair<std::string, DocumentStatus>;
+    // finds by a word view without building a string
+    struct KeyLess {
+        using is_transparent = void;
+        template <typename Lhs, typename Rhs>
+        bool operator()(const Lhs& lhs, const Rhs& rhs) const {
+            return std::pair<std::string_view, DocumentStatus>(lhs) < std::pair<std::string_view, DocumentStatus>(rhs);
+        }
+    };
+
+    // drops candidates tied with the excluded ones, so the list is separated from them
+    void TrimTies(Entry& entry) const;
+    // the entry to change in place, copied first if a reader still holds it
+    static Entry& GetMutable(std::shared_ptr<Entry>& entry);
+    // bit of the word in a filter of cached words, checked without the lock;
+    // a set bit may belong to another word, a clear one never has an entry
+    static std::pair<size_t, uint64_t> GetWordBit(std::string_view word);
+    bool MayContain(std::string_view word) const;
+
+    size_t capacity_;
+    size_t top_k_;
+    std::array<std::atomic<uint64_t>, 64> word_filter_ = {};
+    std::atomic<bool> is_empty_{true};
+    mutable std::mutex mutex_;
+    std::map<Key, std::shared_ptr<Entry>, KeyLess> entries_;
+};
@@ -0,0 +1,109 @@
+#include "impact_index.h"
+#include "document_reordering.h"
+#include <cmath>
+using namespace std;
+ImpactIndex::ImpactIndex(const SearchServer& search_server)
+        : ImpactIndex(search_server, GetIdentityOrder(search_server)) {
+}
+ImpactIndex::ImpactIndex(const SearchServer& search_server, const vector<int>& document_order) {
+    CheckDocumentOrder(search_server, document_order);
+    struct Posting {
+        uint32_t ordinal;
+        double term_freq;
+    };
+    map<string_view, vector<Posting>> word_to_postings;
+    for (const int document_id : document_order) {
+        const uint32_t ordinal = static_cast<uint32_t>(document_ids_.size());
+        document_ids_.push_back(document_id);
+        ratings_.push_back(search_server.GetDocumentRating(document_id));
+        statuses_.push_back(search_server.GetDocumentStatus(document_id));
+        for (const auto& [word, term_freq] : search_server.GetWordFrequencies(document_id)) {
+            word_to_postings[word].push_back({ordinal, term_freq});
+        }
+    }
+
+    // same relevance as SearchServer: tf * log(documents / df)
+    const double document_count = static_cast<double>(document_ids_.size());
+    map<string_view, double> word_to_idf;
+    double max_score = 0.0;
+    for (const auto& [word, postings] : word_to_postings) {
+        const double inverse_document_freq = log(document_count / postings.size());
+        word_to_idf[word] = inverse_document_freq;
+        for (const Posting& posting : postings) {
+            max_score = max(max_score, posting.term_freq * inverse_document_freq);
+        }
+    }
+    impact_scale_ = max_score > 0.0 ? max_score / MAX_IMPACT : 1.0;
+
+    for (const auto& [word, postings] : word_to_postings) {
+        const double inverse_document_freq = word_to_idf.at(word);
+        vector<pair<uint8_t, uint32_t>> impacts;
+        impacts.reserve(postings.size());
+        for (const Posting& posting : postings) {
+            const double score = posting.term_freq * inverse_document_freq;
+            // only a zero score gets zero impact so matching documents still rank above the rest
+            const long impact = score > 0.0 ? clamp(lround(score / impact_scale_), 1L, static_cast<long>(MAX_IMPACT)) : 0L;
+            impacts.push_back({static_cast<uint8_t>(impact), posting.ordinal});
+        }
+        sort(impacts.begin(), impacts.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+        });
+        WordSegments& segments = word_to_segments_[string(word)];
+        for (const auto& [impact, ordinal] : impacts) {
+            const uint32_t position = static_cast<uint32_t>(ordinals_.size());
+            if (segments.empty() || segments.back().impact != impact) {
+                segments.push_back({impact, position, position});
+            }
+            ordinals_.push_back(ordinal);
+            ++segments.back().end;
+        }
+    }
+}
+ImpactSearchResult ImpactIndex::FindTopDocuments(const string_view raw_query, DocumentStatus status,
+                                                 const ImpactSearchOptions& options) const {
+    return FindTopDocumentsImpl(raw_query, [this, status](uint32_t ordinal) {
+        return statuses_[ordinal] == status;
+    }, options);
+}
+ImpactSearchResult ImpactIndex::FindTopDocuments(const string_view raw_query, const ImpactSearchOptions& options) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL, options);
+}
+int ImpactIndex::GetDocumentCount() const {
+    return static_cast<int>(document_ids_.size());
+}
+size_t ImpactIndex::GetPostingCount() const {
+    return ordinals_.size();
+}
+double ImpactIndex::GetImpactScale() const {
+    return impact_scale_;
+}
+bool ImpactIndex::ContainsOrdinal(const Segment& segment, uint32_t ordinal) const {
+    return binary_search(ordinals_.begin() + segment.begin, ordinals_.begin() + segment.end, ordinal);
+}
+ImpactIndex::ScratchLease::ScratchLease(size_t ordinal_count) {
+    ThreadScratches& thread_scratches = GetThreadScratches();
+    if (thread_scratches.depth == thread_scratches.scratches.size()) {
+        thread_scratches.scratches.push_back(make_unique<QueryScratch>());
+    }
+    scratch_ = thread_scratches.scratches[thread_scratches.depth++].get();
+    if (scratch_->accumulators.size() < ordinal_count) {
+        scratch_->accumulators.resize(ordinal_count);
+    }
+    if (++scratch_->generation == 0) {
+        // generations wrapped around, old entries could pass for the new query
+        fill(scratch_->accumulators.begin(), scratch_->accumulators.end(), Accumulator());
+        scratch_->generation = 1;
+    }
+    scratch_->touched.clear();
+    scratch_->top.clear();
+}
+ImpactIndex::ScratchLease::~ScratchLease() {
+    --GetThreadScratches().depth;
+}
+ImpactIndex::QueryScratch& ImpactIndex::ScratchLease::operator*() const {
+    return *scratch_;
+}
+ImpactIndex::ThreadScratches& ImpactIndex::GetThreadScratches() {
+    thread_local ThreadScratches thread_scratches;
+    return thread_scratches;
+}
@@ -0,0 +1,311 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "document.h"
+#include "page_cursor.h"
+#include "search_server.h"
+#include "string_processing.h"
+struct ImpactSearchOptions {
+    size_t top_k = MAX_RESULT_DOCUMENT_COUNT;
+    // postings to score at most, search stops early when it is spent
+    size_t posting_budget = static_cast<size_t>(-1);
+};
+struct ImpactSearchResult {
+    std::vector<Document> documents;
+    // false if the budget was spent before the top became final
+    bool is_exact = true;
+    size_t scored_postings = 0;
+};
+// read-only copy of a SearchServer index for score-at-a-time evaluation:
+// tf * idf of every posting is quantized into an integer impact 0..MAX_IMPACT and
+// postings of a word are grouped into segments of equal impact, highest first.
+// Segments of all query words are scored in order of impact, so search can stop
+// as soon as the rest of postings can't change the top.
+// Relevance of results is the quantized one, it differs from SearchServer by less than
+// (number of query words) * GetImpactScale() / 2
+class ImpactIndex {
+public:
+    static constexpr int MAX_IMPACT = 255;
+
+    explicit ImpactIndex(const SearchServer& search_server);
+    // ordinals are given to documents in document_order (see document_reordering.h),
+    // results and rankings are the same as with the id order
+    ImpactIndex(const SearchServer& search_server, const std::vector<int>& document_order);
+
+    template <typename DocumentPredicate>
+    ImpactSearchResult FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                        const ImpactSearchOptions& options = ImpactSearchOptions()) const {
+        return FindTopDocumentsImpl(raw_query, [&](uint32_t ordinal) {
+            return document_predicate(document_ids_[ordinal], statuses_[ordinal], ratings_[ordinal]);
+        }, options);
+    }
+    ImpactSearchResult FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+                                        const ImpactSearchOptions& options = ImpactSearchOptions()) const;
+    ImpactSearchResult FindTopDocuments(const std::string_view raw_query,
+                                        const ImpactSearchOptions& options = ImpactSearchOptions()) const;
+
+    int GetDocumentCount() const;
+    size_t GetPostingCount() const;
+    // relevance of one impact unit
+    double GetImpactScale() const;
+private:
+    struct Segment {
+        uint8_t impact;
+        // range in ordinals_, ordinals inside a segment are sorted
+        uint32_t begin;
+        uint32_t end;
+    };
+    // segments of a word, impact descending
+    using WordSegments = std::vector<Segment>;
+    // accumulator of a document; it belongs to the running query only if its generation
+    // is the query's one, so nothing is cleared between queries
+    struct Accumulator {
+        uint32_t generation = 0;
+        uint32_t score = 0;
+        bool is_excluded = false;
+        // one of the top_k highest scores so far
+        bool is_top = false;
+    };
+    // buffers of a query, kept by the thread for its next queries
+    struct QueryScratch {
+        std::vector<Accumulator> accumulators;
+        // scored ordinals of the query
+        std::vector<uint32_t> touched;
+        // top_k ordinals with the highest scores so far
+        std::vector<uint32_t> top;
+        uint32_t generation = 0;
+    };
+    // scratch of the calling thread prepared for a new query, a predicate searching again
+    // from inside a query gets a scratch of its own
+    class ScratchLease {
+    public:
+        explicit ScratchLease(size_t ordinal_count);
+        ScratchLease(const ScratchLease&) = delete;
+        ScratchLease& operator=(const ScratchLease&) = delete;
+        ~ScratchLease();
+
+        QueryScratch& operator*() const;
+    private:
+        QueryScratch* scratch_;
+    };
+    // scratches of the calling thread, one per nesting level of queries
+    struct ThreadScratches {
+        std::vector<std::unique_ptr<QueryScratch>> scratches;
+        size_t depth = 0;
+    };
+    static ThreadScratches& GetThreadScratches();
+
+    template <typename OrdinalPredicate>
+    ImpactSearchResult FindTopDocumentsImpl(const std::string_view raw_query, OrdinalPredicate ordinal_predicate,
+                                            const ImpactSearchOptions& options) const;
+    bool ContainsOrdinal(const Segment& segment, uint32_t ordinal) const;
+
+    std::map<std::string, WordSegments, std::less<>> word_to_segments_;
+    std::vector<uint32_t> ordinals_;
+    // document data by ordinal
+    std::vector<int> document_ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    double impact_scale_ = 0.0;
+};
+template <typename OrdinalPredicate>
+ImpactSearchResult ImpactIndex::FindTopDocumentsImpl(const std::string_view raw_query, OrdinalPredicate ordinal_predicate,
+                                                     const ImpactSearchOptions& options) const {
+    const ScratchLease lease(document_ids_.size());
+    QueryScratch& scratch = *lease;
+    std::vector<Accumulator>& accumulators = scratch.accumulators;
+    const uint32_t generation = scratch.generation;
+    std::vector<const WordSegments*> plus_words;
+    for (const std::string_view word : SplitIntoWordsView(raw_query)) {
+        const QueryWord query_word = ParseQueryWord(word);
+        // stop words and unknown words are not in the index
+        const auto it = word_to_segments_.find(query_word.data);
+        if (it == word_to_segments_.end()) {
+            continue;
+        }
+        if (query_word.is_minus) {
+            for (const Segment& segment : it->second) {
+                for (uint32_t i = segment.begin; i < segment.end; ++i) {
+                    Accumulator& accumulator = accumulators[ordinals_[i]];
+                    accumulator = {generation, 0, true, false};
+                }
+            }
+        } else if (std::find(plus_words.begin(), plus_words.end(), &it->second) == plus_words.end()) {
+            plus_words.push_back(&it->second);
+        }
+    }
+
+    // segments of all words by impact descending
+    struct Cursor {
+        const Segment* segment;
+        size_t word;
+    };
+    std::vector<Cursor> cursors;
+    // impact of the next unscored segment of every word
+    std::vector<uint32_t> next_impacts(plus_words.size(), 0);
+    uint32_t remaining = 0;
+    for (size_t word = 0; word < plus_words.size(); ++word) {
+        for (const Segment& segment : *plus_words[word]) {
+            cursors.push_back({&segment, word});
+        }
+        next_impacts[word] = plus_words[word]->front().impact;
+        remaining += next_impacts[word];
+    }
+    std::stable_sort(cursors.begin(), cursors.end(), [](const Cursor& lhs, const Cursor& rhs) {
+        return lhs.segment->impact > rhs.segment->impact;
+    });
+
+    ImpactSearchResult result;
+    const size_t top_k = options.top_k;
+    std::vector<uint32_t>& touched = scratch.touched;
+    // running top: every score outside of it is at most the lowest score inside,
+    // so that one is the k-th highest score
+    std::vector<uint32_t>& top = scratch.top;
+    size_t lowest_top = 0;
+    const auto find_lowest_top = [&] {
+        lowest_top = 0;
+        for (size_t i = 1; i < top.size(); ++i) {
+            if (accumulators[top[i]].score < accumulators[top[lowest_top]].score) {
+                lowest_top = i;
+            }
+        }
+    };
+    // bound of scores outside of the top, exact unless a document moved from outside into the top
+    uint32_t max_outside_score = 0;
+    bool is_outside_bound_exact = true;
+    const auto add_score = [&](uint32_t ordinal, Accumulator& accumulator, uint32_t impact) {
+        accumulator.score += impact;
+        if (accumulator.is_top) {
+            if (top[lowest_top] == ordinal) {
+                find_lowest_top();
+            }
+        } else if (top.size() < top_k) {
+            accumulator.is_top = true;
+            top.push_back(ordinal);
+            find_lowest_top();
+        } else if (top_k != 0 && accumulator.score > accumulators[top[lowest_top]].score) {
+            // the bound may have been the old score of the document moving in
+            is_outside_bound_exact = is_outside_bound_exact && accumulator.score - impact < max_outside_score;
+            Accumulator& replaced = accumulators[top[lowest_top]];
+            replaced.is_top = false;
+            max_outside_score = std::max(max_outside_score, replaced.score);
+            accumulator.is_top = true;
+            top[lowest_top] = ordinal;
+            find_lowest_top();
+        } else {
+            max_outside_score = std::max(max_outside_score, accumulator.score);
+        }
+    };
+    // true when ordinals with the top_k highest scores are known and no other document can pass them
+    const auto is_top_final = [&]() {
+        if (top_k == 0) {
+            return true;
+        }
+        if (top.size() < top_k) {
+            return false;
+        }
+        const uint32_t kth_score = accumulators[top[lowest_top]].score;
+        if (kth_score <= remaining) {
+            return false;
+        }
+        if (touched.size() == top_k) {
+            return true;
+        }
+        if (kth_score > max_outside_score + remaining) {
+            return true;
+        }
+        if (!is_outside_bound_exact) {
+            max_outside_score = 0;
+            for (const uint32_t ordinal : touched) {
+                if (!accumulators[ordinal].is_top) {
+                    max_outside_score = std::max(max_outside_score, accumulators[ordinal].score);
+                }
+            }
+            is_outside_bound_exact = true;
+        }
+        return kth_score > max_outside_score + remaining;
+    };
+
+    // scored segments of every word, the rest is looked up for the final top
+    std::vector<size_t> scored_segments(plus_words.size(), 0);
+    bool is_stopped = false;
+    for (size_t i = 0; i < cursors.size() && !is_stopped; ++i) {
+        const Segment& segment = *cursors[i].segment;
+        const size_t word = cursors[i].word;
+        for (uint32_t posting = segment.begin; posting < segment.end; ++posting) {
+            if (result.scored_postings == options.posting_budget) {
+                result.is_exact = false;
+                is_stopped = true;
+                break;
+            }
+            ++result.scored_postings;
+            const uint32_t ordinal = ordinals_[posting];
+            Accumulator& accumulator = accumulators[ordinal];
+            if (accumulator.generation == generation && accumulator.is_excluded) {
+                continue;
+            }
+            if (!ordinal_predicate(ordinal)) {
+                continue;
+            }
+            if (accumulator.generation != generation) {
+                accumulator = {generation, 0, false, false};
+                touched.push_back(ordinal);
+            }
+            add_score(ordinal, accumulator, segment.impact);
+        }
+        if (is_stopped) {
+            break;
+        }
+        ++scored_segments[word];
+        remaining -= next_impacts[word];
+        next_impacts[word] = scored_segments[word] < plus_words[word]->size()
+                ? (*plus_words[word])[scored_segments[word]].impact : 0;
+        remaining += next_impacts[word];
+        // checked once per impact level
+        if (i + 1 < cursors.size() && cursors[i + 1].segment->impact != segment.impact
+                && is_top_final()) {
+            is_stopped = true;
+        }
+    }
+
+    // ranking order of IsRankedBefore, ties of the running top are broken here;
+    // when stopped early the top is separated by score, so partial scores select it as well
+    const auto by_score = [&](uint32_t lhs, uint32_t rhs) {
+        if (accumulators[lhs].score != accumulators[rhs].score) {
+            return accumulators[lhs].score > accumulators[rhs].score;
+        }
+        if (ratings_[lhs] != ratings_[rhs]) {
+            return ratings_[lhs] > ratings_[rhs];
+        }
+        return document_ids_[lhs] < document_ids_[rhs];
+    };
+    if (touched.size() > top_k) {
+        std::nth_element(touched.begin(), touched.begin() + top_k, touched.end(), by_score);
+        touched.resize(top_k);
+    }
+    if (result.is_exact) {
+        // complete scores of the top from segments left unscored
+        for (const uint32_t ordinal : touched) {
+            for (size_t word = 0; word < plus_words.size(); ++word) {
+                const WordSegments& segments = *plus_words[word];
+                for (size_t j = scored_segments[word]; j < segments.size(); ++j) {
+                    if (ContainsOrdinal(segments[j], ordinal)) {
+                        accumulators[ordinal].score += segments[j].impact;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    for (const uint32_t ordinal : touched) {
+        result.documents.push_back({document_ids_[ordinal], accumulators[ordinal].score * impact_scale_, ratings_[ordinal]});
+    }
+    std::sort(result.documents.begin(), result.documents.end(), IsRankedBefore);
+    return result;
+}
@@ -0,0 +1,143 @@
+#include "instrumentation.h"
+#include <array>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+using namespace std;
+namespace {
+const size_t HISTOGRAM_SIZE = 64;
+const size_t STAGE_COUNT = static_cast<size_t>(Stage::STAGE_COUNT);
+// written only by owner thread, read by DumpInstrumentation
+struct StageCounters {
+    atomic<uint64_t> calls{0};
+    atomic<uint64_t> total_ns{0};
+    atomic<uint64_t> max_ns{0};
+    atomic<uint64_t> items{0};
+    // bucket i holds durations in [2^(i-1), 2^i) ns
+    array<atomic<uint64_t>, HISTOGRAM_SIZE> histogram{};
+};
+struct ThreadCounters {
+    array<StageCounters, STAGE_COUNT> stages;
+};
+// counters of finished threads are kept, so they still show up in dumps
+mutex registry_mutex;
+deque<unique_ptr<ThreadCounters>> registry;
+
+#ifdef SEARCH_SERVER_INSTRUMENTATION
+bool IsEnabledByEnvironment() {
+    const char* value = getenv("SEARCH_SERVER_PROFILE");
+    return value != nullptr && value[0] == '1';
+}
+ThreadCounters& GetThreadCounters() {
+    thread_local ThreadCounters* counters = [] {
+        lock_guard<mutex> guard(registry_mutex);
+        return registry.emplace_back(make_unique<ThreadCounters>()).get();
+    }();
+    return *counters;
+}
+void AddRelaxed(atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+#endif
+}
+
+#ifdef SEARCH_SERVER_INSTRUMENTATION
+namespace instrumentation_detail {
+atomic<bool> enabled{IsEnabledByEnvironment()};
+
+void RecordStage(Stage stage, uint64_t duration_ns) {
+    StageCounters& counters = GetThreadCounters().stages[static_cast<size_t>(stage)];
+    AddRelaxed(counters.calls, 1);
+    AddRelaxed(counters.total_ns, duration_ns);
+    if (duration_ns > counters.max_ns.load(memory_order_relaxed)) {
+        counters.max_ns.store(duration_ns, memory_order_relaxed);
+    }
+    const size_t bucket = duration_ns == 0 ? 0 : 64 - __builtin_clzll(duration_ns);
+    AddRelaxed(counters.histogram[min(bucket, HISTOGRAM_SIZE - 1)], 1);
+}
+void RecordItems(Stage stage, uint64_t items) {
+    AddRelaxed(GetThreadCounters().stages[static_cast<size_t>(stage)].items, items);
+}
+}
+void SetInstrumentationEnabled(bool enabled) {
+    instrumentation_detail::enabled.store(enabled, memory_order_relaxed);
+}
+bool IsInstrumentationEnabled() {
+    return instrumentation_detail::enabled.load(memory_order_relaxed);
+}
+#else
+void SetInstrumentationEnabled(bool) {
+}
+bool IsInstrumentationEnabled() {
+    return false;
+}
+#endif
+
+const char* GetStageName(Stage stage) {
+    switch (stage) {
+        case Stage::PARSE: return "parse";
+        case Stage::POSTING_WALK: return "posting_walk";
+        case Stage::ACCUMULATE: return "accumulate";
+        case Stage::MINUS_FILTER: return "minus_filter";
+        case Stage::MATERIALIZE: return "materialize";
+        case Stage::TOP_K: return "top_k";
+        default: return "unknown";
+    }
+}
+void DumpInstrumentation(ostream& out) {
+    lock_guard<mutex> guard(registry_mutex);
+#ifdef SEARCH_SERVER_INSTRUMENTATION
+    const bool compiled = true;
+#else
+    const bool compiled = false;
+#endif
+    out << "{\"compiled\":" << (compiled ? "true" : "false")
+        << ",\"enabled\":" << (IsInstrumentationEnabled() ? "true" : "false")
+        << ",\"threads\":" << registry.size()
+        << ",\"stages\":{";
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        uint64_t calls = 0, total_ns = 0, max_ns = 0, items = 0;
+        array<uint64_t, HISTOGRAM_SIZE> histogram{};
+        for (const auto& thread_counters : registry) {
+            const StageCounters& counters = thread_counters->stages[stage];
+            calls += counters.calls.load(memory_order_relaxed);
+            total_ns += counters.total_ns.load(memory_order_relaxed);
+            max_ns = max(max_ns, counters.max_ns.load(memory_order_relaxed));
+            items += counters.items.load(memory_order_relaxed);
+            for (size_t i = 0; i < HISTOGRAM_SIZE; ++i) {
+                histogram[i] += counters.histogram[i].load(memory_order_relaxed);
+            }
+        }
+        size_t used_buckets = HISTOGRAM_SIZE;
+        while (used_buckets > 0 && histogram[used_buckets - 1] == 0) {
+            --used_buckets;
+        }
+        out << (stage == 0 ? "" : ",") << '"' << GetStageName(static_cast<Stage>(stage)) << "\":{"
+            << "\"calls\":" << calls
+            << ",\"total_ns\":" << total_ns
+            << ",\"max_ns\":" << max_ns
+            << ",\"items\":" << items
+            << ",\"log2_ns_histogram\":[";
+        for (size_t i = 0; i < used_buckets; ++i) {
+            out << (i == 0 ? "" : ",") << histogram[i];
+        }
+        out << "]}";
+    }
+    out << "}}\n";
+}
+// counters are zeroed in place, racing writers may keep a few increments
+void ResetInstrumentation() {
+    lock_guard<mutex> guard(registry_mutex);
+    for (auto& thread_counters : registry) {
+        for (StageCounters& counters : thread_counters->stages) {
+            counters.calls = 0;
+            counters.total_ns = 0;
+            counters.max_ns = 0;
+            counters.items = 0;
+            for (auto& bucket : counters.histogram) {
+                bucket = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include "log_duration.h"
+// hot path instrumentation of the search pipeline
+// compiled in only with -DSEARCH_SERVER_INSTRUMENTATION, otherwise macros expand to nothing
+// when compiled in, collection is switched at runtime (SetInstrumentationEnabled or
+// SEARCH_SERVER_PROFILE=1 in environment), disabled timers cost one relaxed atomic load
+enum class Stage {
+    PARSE,
+    POSTING_WALK,
+    ACCUMULATE,
+    MINUS_FILTER,
+    MATERIALIZE,
+    TOP_K,
+    STAGE_COUNT,
+};
+const char* GetStageName(Stage stage);
+
+void SetInstrumentationEnabled(bool enabled);
+bool IsInstrumentationEnabled();
+// writes counters of all threads merged per stage as one json object
+void DumpInstrumentation(std::ostream& out);
+void ResetInstrumentation();
+
+#ifdef SEARCH_SERVER_INSTRUMENTATION
+namespace instrumentation_detail {
+extern std::atomic<bool> enabled;
+void RecordStage(Stage stage, uint64_t duration_ns);
+void RecordItems(Stage stage, uint64_t items);
+}
+
+class StageTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StageTimer(Stage stage)
+            : stage_(stage)
+            , active_(instrumentation_detail::enabled.load(std::memory_order_relaxed)) {
+        if (active_) {
+            start_time_ = Clock::now();
+        }
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+    ~StageTimer() {
+        if (active_) {
+            const auto dur = Clock::now() - start_time_;
+            instrumentation_detail::RecordStage(stage_, std::chrono::duration_cast<std::chrono::nanoseconds>(dur).count());
+        }
+    }
+
+private:
+    const Stage stage_;
+    const bool active_;
+    Clock::time_point start_time_;
+};
+
+#define PROFILE_STAGE(stage) StageTimer UNIQUE_VAR_NAME_PROFILE(stage)
+#define PROFILE_ITEMS(stage, count)                                                 \
+    do {                                                                            \
+        if (instrumentation_detail::enabled.load(std::memory_order_relaxed)) {      \
+            instrumentation_detail::RecordItems(stage, count);                      \
+        }                                                                           \
+    } while (false)
+#else
+#define PROFILE_STAGE(stage)
+#define PROFILE_ITEMS(stage, count) do { } while (false)
+#endif
@@ -0,0 +1,209 @@
+#include "corpus_generator.h"
+#include "request_stats.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+// closed-loop load for the search service: every connection keeps --pipeline FIND requests
+// in flight, queries come from the corpus generator with the same options as the server
+namespace {
+struct LoadOptions {
+    string address = "127.0.0.1";
+    uint16_t port = 7700;
+    size_t connections = 4;
+    size_t pipeline = 16;
+    size_t requests = 100000;
+    CorpusOptions corpus;
+    QueryOptions queries;
+};
+
+using Clock = chrono::steady_clock;
+
+LoadOptions ParseOptions(int argc, char* argv[]) {
+    LoadOptions options;
+    for (int i = 1; i < argc; i += 2) {
+        const string key = argv[i];
+        if (i + 1 == argc) {
+            throw invalid_argument("no value for option "s + key);
+        }
+        const string value = argv[i + 1];
+        if (key == "--address"s) {
+            options.address = value;
+        } else if (key == "--port"s) {
+            options.port = static_cast<uint16_t>(stoul(value));
+        } else if (key == "--connections"s) {
+            options.connections = stoul(value);
+        } else if (key == "--pipeline"s) {
+            options.pipeline = stoul(value);
+        } else if (key == "--requests"s) {
+            options.requests = stoul(value);
+        } else if (key == "--documents"s) {
+            options.corpus.document_count = stoul(value);
+        } else if (key == "--vocabulary"s) {
+            options.corpus.vocabulary_size = stoul(value);
+        } else if (key == "--seed"s) {
+            options.corpus.seed = stoull(value);
+        } else if (key == "--queries"s) {
+            options.queries.query_count = stoul(value);
+        } else {
+            throw invalid_argument("unknown option "s + key);
+        }
+    }
+    if (options.connections == 0 || options.pipeline == 0) {
+        throw invalid_argument("connections and pipeline must be positive"s);
+    }
+    return options;
+}
+
+int Connect(const LoadOptions& options) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    inet_pton(AF_INET, options.address.c_str(), &address.sin_addr);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        throw runtime_error("can't connect to "s + options.address + ":"s + to_string(options.port));
+    }
+    const int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return fd;
+}
+void SendAll(int fd, string_view data) {
+    while (!data.empty()) {
+        const ssize_t count = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (count <= 0) {
+            throw runtime_error("connection lost"s);
+        }
+        data.remove_prefix(static_cast<size_t>(count));
+    }
+}
+// reads lines until one starting with a terminal token (END, ERR, PONG, STATS)
+class ResponseReader {
+public:
+    explicit ResponseReader(int fd)
+            : fd_(fd) {
+    }
+    string ReadResponse() {
+        string response;
+        while (true) {
+            const string line = ReadLine();
+            response += line;
+            response += '\n';
+            if (line.rfind("DOC "s, 0) != 0) {
+                return response;
+            }
+        }
+    }
+private:
+    string ReadLine() {
+        while (true) {
+            const size_t end = buffer_.find('\n', position_);
+            if (end != string::npos) {
+                string line = buffer_.substr(position_, end - position_);
+                position_ = end + 1;
+                return line;
+            }
+            buffer_.erase(0, position_);
+            position_ = 0;
+            char chunk[1 << 16];
+            const ssize_t count = read(fd_, chunk, sizeof(chunk));
+            if (count <= 0) {
+                throw runtime_error("connection lost"s);
+            }
+            buffer_.append(chunk, static_cast<size_t>(count));
+        }
+    }
+
+    int fd_;
+    string buffer_;
+    size_t position_ = 0;
+};
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    try {
+        options = ParseOptions(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    CorpusGenerator generator(options.corpus);
+    const vector<string> queries = generator.GenerateQueries(options.queries);
+    atomic<size_t> next_request{0};
+    atomic<size_t> errors{0};
+    mutex histogram_mutex;
+    LatencyHistogram latencies;
+    vector<int> sockets;
+    try {
+        for (size_t worker = 0; worker < options.connections; ++worker) {
+            sockets.push_back(Connect(options));
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    const auto start = Clock::now();
+    vector<thread> workers;
+    for (const int fd : sockets) {
+        workers.emplace_back([&, fd] {
+            ResponseReader reader(fd);
+            LatencyHistogram local_latencies;
+            // send times of requests in flight, responses come in order
+            deque<Clock::time_point> in_flight;
+            const auto send_next = [&] {
+                const size_t request = next_request++;
+                if (request >= options.requests) {
+                    return false;
+                }
+                in_flight.push_back(Clock::now());
+                SendAll(fd, "FIND "s + queries[request % queries.size()] + "\n"s);
+                return true;
+            };
+            try {
+                while (in_flight.size() < options.pipeline && send_next()) {
+                }
+                while (!in_flight.empty()) {
+                    if (reader.ReadResponse().rfind("ERR"s, 0) == 0) {
+                        ++errors;
+                    }
+                    local_latencies.Record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - in_flight.front()).count()));
+                    in_flight.pop_front();
+                    send_next();
+                }
+            } catch (const exception&) {
+                // requests of a lost connection are counted as errors
+                errors += in_flight.size();
+            }
+            close(fd);
+            lock_guard lock(histogram_mutex);
+            latencies.Merge(local_latencies);
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    const double seconds = chrono::duration<double>(Clock::now() - start).count();
+    cout << "requests "s << latencies.GetCount() << ", errors "s << errors.load() << ", "s
+         << latencies.GetCount() / seconds << " qps, p50 "s << latencies.GetPercentile(50) / 1000
+         << " us, p99 "s << latencies.GetPercentile(99) / 1000 << " us, max "s << latencies.GetMax() / 1000 << " us"s << endl;
+    try {
+        const int fd = Connect(options);
+        SendAll(fd, "STATS\n"s);
+        cout << "server: "s << ResponseReader(fd).ReadResponse();
+        close(fd);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
@@ -1,12 +1,128 @@
-#include <iostream>
-#include "request_queue.h"
-#include "paginator.h"
+#include "corpus_generator.h"
 #include "search_server.h"
+#include "search_service.h"
+#include "warm_up.h"
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <string>
 #include <vector>
-#include <map>
-#include "process_queries.h"
 using namespace std;
+// search server over the line protocol of search_service.h
+// documents come from a file (one per line, id is the line number) or from the corpus generator
+// with --warm-up-log the hottest queries of a query log are replayed before the port is opened
+namespace {
+struct ServerOptions {
+    ServiceOptions service;
+    string documents_path;
+    string stop_words;
+    CorpusOptions corpus;
+    string warm_up_log_path;
+    WarmUpOptions warm_up;
+};
+
+SearchService* running_service = nullptr;
+
+void HandleSignal(int) {
+    if (running_service != nullptr) {
+        running_service->Stop();
+    }
+}
+
+ServerOptions ParseOptions(int argc, char* argv[]) {
+    ServerOptions options;
+    for (int i = 1; i < argc; i += 2) {
+        const string key = argv[i];
+        if (i + 1 == argc) {
+            throw invalid_argument("no value for option "s + key);
+        }
+        const string value = argv[i + 1];
+        if (key == "--address"s) {
+            options.service.address = value;
+        } else if (key == "--port"s) {
+            options.service.port = static_cast<uint16_t>(stoul(value));
+        } else if (key == "--max-batch"s) {
+            options.service.max_batch = stoul(value);
+        } else if (key == "--max-unsent-output"s) {
+            options.service.max_unsent_output = stoul(value);
+        } else if (key == "--documents-file"s) {
+            options.documents_path = value;
+        } else if (key == "--stop-words"s) {
+            options.stop_words = value;
+        } else if (key == "--documents"s) {
+            options.corpus.document_count = stoul(value);
+        } else if (key == "--vocabulary"s) {
+            options.corpus.vocabulary_size = stoul(value);
+        } else if (key == "--seed"s) {
+            options.corpus.seed = stoull(value);
+        } else if (key == "--warm-up-log"s) {
+            options.warm_up_log_path = value;
+        } else if (key == "--warm-up-queries"s) {
+            options.warm_up.max_queries = stoul(value);
+        } else {
+            throw invalid_argument("unknown option "s + key);
+        }
+    }
+    return options;
+}
+}
+
+int main(int argc, char* argv[]) {
+    ServerOptions options;
+    try {
+        options = ParseOptions(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    vector<string> documents;
+    string stop_words = options.stop_words;
+    if (options.documents_path.empty()) {
+        CorpusGenerator generator(options.corpus);
+        documents = generator.GenerateDocuments();
+        stop_words = generator.GetStopWordsText();
+    } else {
+        ifstream input(options.documents_path);
+        if (!input) {
+            cerr << "can't open "s << options.documents_path << endl;
+            return 1;
+        }
+        for (string line; getline(input, line);) {
+            documents.push_back(move(line));
+        }
+    }
+    SearchServer search_server(stop_words);
+    vector<DocumentInput> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {}});
+    }
+    search_server.AddDocuments(execution::par, batch);
 
-int main() {
+    if (!options.warm_up_log_path.empty()) {
+        ifstream input(options.warm_up_log_path);
+        if (!input) {
+            cerr << "can't open "s << options.warm_up_log_path << endl;
+            return 1;
+        }
+        QueryLogWarmUp warm_up(search_server, ReadQueryLog(input), options.warm_up);
+        warm_up.Start();
+        while (!warm_up.WaitFor(chrono::seconds(1))) {
+            const WarmUpProgress progress = warm_up.GetProgress();
+            cerr << "warming up: "s << progress.replayed_queries << '/' << progress.total_queries << " queries"s << endl;
+        }
+        const WarmUpProgress progress = warm_up.GetProgress();
+        cerr << "warmed up with "s << progress.replayed_queries << " queries ("s << progress.failed_queries << " failed) in "s
+             << chrono::duration_cast<chrono::milliseconds>(progress.elapsed).count() << " ms"s << endl;
+    }
 
-}
\ No newline at end of file
+    SearchService service(search_server, options.service);
+    running_service = &service;
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    cerr << "serving "s << search_server.GetDocumentCount() << " documents on "s
+         << options.service.address << ':' << service.GetPort() << endl;
+    service.Run();
+    running_service = nullptr;
+    const RequestStatsSnapshot total = service.GetStatistics().GetSnapshot(chrono::hours(24));
+    cerr << "served "s << total.requests << " queries"s << endl;
+}
@@ -0,0 +1,256 @@
+#include "numa_index.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+using namespace std;
+namespace {
+const string NODE_DIRECTORY = "/sys/devices/system/node/"s;
+
+// "0-3,8" -> 0 1 2 3 8, the format of cpu and node lists in sysfs
+vector<int> ParseCpuList(string_view list) {
+    vector<int> cpus;
+    const auto parse_number = [](string_view text) {
+        if (text.empty() || !all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            throw invalid_argument("invalid cpu list"s);
+        }
+        return stoi(string(text));
+    };
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        const string_view range = list.substr(0, comma);
+        const size_t dash = range.find('-');
+        const int first = parse_number(range.substr(0, dash));
+        const int last = dash == string_view::npos ? first : parse_number(range.substr(dash + 1));
+        if (last < first) {
+            throw invalid_argument("invalid cpu list"s);
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        list.remove_prefix(comma == string_view::npos ? list.size() : comma + 1);
+    }
+    if (cpus.empty()) {
+        throw invalid_argument("empty cpu list"s);
+    }
+    return cpus;
+}
+vector<int> GetProcessCpus() {
+    vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        cpus.push_back(0);
+    }
+    return cpus;
+}
+// estimated bytes read per posting: ordinal, term frequency and the document record
+constexpr uint64_t BYTES_PER_POSTING = sizeof(uint32_t) + sizeof(double) + sizeof(FrozenDocument);
+}
+
+NumaTopology DetectNumaTopology() {
+    if (const char* spec = getenv("SEARCH_SERVER_NUMA_TOPOLOGY")) {
+        return ParseNumaTopology(spec);
+    }
+    NumaTopology topology;
+    ifstream online(NODE_DIRECTORY + "online"s);
+    string nodes;
+    if (getline(online, nodes) && !nodes.empty()) {
+        for (const int node : ParseCpuList(nodes)) {
+            ifstream cpu_list(NODE_DIRECTORY + "node"s + to_string(node) + "/cpulist"s);
+            string cpus;
+            // memory-only nodes have no cpus to pin to
+            if (getline(cpu_list, cpus) && !cpus.empty()) {
+                topology.nodes.push_back({node, ParseCpuList(cpus)});
+            }
+        }
+    }
+    if (topology.nodes.empty()) {
+        topology.nodes.push_back({0, GetProcessCpus()});
+    }
+    return topology;
+}
+NumaTopology ParseNumaTopology(string_view spec) {
+    NumaTopology topology;
+    topology.is_simulated = true;
+    while (true) {
+        const size_t separator = spec.find(';');
+        topology.nodes.push_back({static_cast<int>(topology.nodes.size()), ParseCpuList(spec.substr(0, separator))});
+        if (separator == string_view::npos) {
+            break;
+        }
+        spec.remove_prefix(separator + 1);
+    }
+    return topology;
+}
+NumaTopology SimulateNumaTopology(size_t node_count) {
+    if (node_count == 0) {
+        throw invalid_argument("topology needs a node"s);
+    }
+    const vector<int> cpus = GetProcessCpus();
+    NumaTopology topology;
+    topology.is_simulated = true;
+    for (size_t node = 0; node < node_count; ++node) {
+        NumaNode numa_node;
+        numa_node.id = static_cast<int>(node);
+        if (cpus.size() >= node_count) {
+            numa_node.cpus.assign(cpus.begin() + node * cpus.size() / node_count, cpus.begin() + (node + 1) * cpus.size() / node_count);
+        } else {
+            numa_node.cpus.push_back(cpus[node % cpus.size()]);
+        }
+        topology.nodes.push_back(move(numa_node));
+    }
+    return topology;
+}
+bool PinCurrentThread(const vector<int>& cpus) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    bool is_empty = true;
+    for (const int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+            CPU_SET(cpu, &set);
+            is_empty = false;
+        }
+    }
+    return !is_empty && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+double NumaNodeStatistics::GetBandwidth() const {
+    return busy_time.count() == 0 ? 0.0 : bytes_read * 1e9 / busy_time.count();
+}
+
+NumaReplicatedIndex::NumaReplicatedIndex(const SearchServer& search_server, NumaTopology topology)
+        : topology_(move(topology))
+        , replicas_(topology_.nodes.size())
+        , counters_(make_unique<NodeCounters[]>(topology_.nodes.size())) {
+    if (topology_.nodes.empty()) {
+        throw invalid_argument("topology needs a node"s);
+    }
+    const vector<char> image = BuildFrozenIndex(search_server);
+    try {
+        PlaceReplicas(image);
+    } catch (...) {
+        UnmapReplicas();
+        throw;
+    }
+}
+// placement threads run one after another, each copy is touched first on its node
+void NumaReplicatedIndex::PlaceReplicas(const vector<char>& image) {
+    for (size_t node = 0; node < replicas_.size(); ++node) {
+        Replica& replica = replicas_[node];
+        thread placement([&] {
+            PinCurrentThread(topology_.nodes[node].cpus);
+            void* data = mmap(nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data == MAP_FAILED) {
+                return;
+            }
+            memcpy(data, image.data(), image.size());
+            mprotect(data, image.size(), PROT_READ);
+            replica.data = data;
+            replica.size = image.size();
+        });
+        placement.join();
+        if (replica.data == nullptr) {
+            throw runtime_error("can't allocate replica for node "s + to_string(topology_.nodes[node].id));
+        }
+        replica.view = make_unique<FrozenIndexView>(static_cast<const char*>(replica.data), replica.size);
+    }
+}
+NumaReplicatedIndex::~NumaReplicatedIndex() {
+    UnmapReplicas();
+}
+void NumaReplicatedIndex::UnmapReplicas() {
+    for (Replica& replica : replicas_) {
+        if (replica.data != nullptr) {
+            munmap(replica.data, replica.size);
+            replica.data = nullptr;
+        }
+    }
+}
+const NumaTopology& NumaReplicatedIndex::GetTopology() const {
+    return topology_;
+}
+const FrozenIndexView& NumaReplicatedIndex::GetReplica(size_t node_index) const {
+    return *replicas_.at(node_index).view;
+}
+size_t NumaReplicatedIndex::GetReplicaBytes() const {
+    return replicas_.front().size;
+}
+vector<vector<Document>> NumaReplicatedIndex::ProcessQueries(const vector<string>& queries, size_t workers_per_node) const {
+    vector<vector<Document>> results(queries.size());
+    atomic<size_t> next_query{0};
+    mutex error_mutex;
+    exception_ptr error;
+    vector<thread> workers;
+    for (size_t node = 0; node < replicas_.size(); ++node) {
+        const size_t worker_count = workers_per_node != 0 ? workers_per_node : topology_.nodes[node].cpus.size();
+        for (size_t worker = 0; worker < worker_count; ++worker) {
+            workers.emplace_back([&, node] {
+                PinCurrentThread(topology_.nodes[node].cpus);
+                const FrozenIndexView& replica = *replicas_[node].view;
+                NodeCounters& counters = counters_[node];
+                const auto start = chrono::steady_clock::now();
+                size_t query_count = 0;
+                uint64_t bytes_read = 0;
+                try {
+                    for (size_t query = next_query++; query < queries.size(); query = next_query++) {
+                        results[query] = replica.FindTopDocuments(queries[query]);
+                        bytes_read += replica.EstimateQueryCost(queries[query]) * BYTES_PER_POSTING;
+                        ++query_count;
+                    }
+                } catch (...) {
+                    lock_guard lock(error_mutex);
+                    if (!error) {
+                        error = current_exception();
+                    }
+                    next_query = queries.size();
+                }
+                counters.queries += query_count;
+                counters.bytes_read += bytes_read;
+                counters.busy_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            });
+        }
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    return results;
+}
+vector<NumaNodeStatistics> NumaReplicatedIndex::GetNodeStatistics() const {
+    vector<NumaNodeStatistics> statistics;
+    for (size_t node = 0; node < replicas_.size(); ++node) {
+        const NodeCounters& counters = counters_[node];
+        statistics.push_back({topology_.nodes[node].id, counters.queries.load(), counters.bytes_read.load(),
+                              chrono::nanoseconds(counters.busy_ns.load())});
+    }
+    return statistics;
+}
+void NumaReplicatedIndex::ResetNodeStatistics() {
+    for (size_t node = 0; node < replicas_.size(); ++node) {
+        counters_[node].queries = 0;
+        counters_[node].bytes_read = 0;
+        counters_[node].busy_ns = 0;
+    }
+}
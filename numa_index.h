@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "document.h"
+#include "frozen_index.h"
+#include "search_server.h"
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+};
+struct NumaTopology {
+    std::vector<NumaNode> nodes;
+    // set for topologies which don't come from the machine
+    bool is_simulated = false;
+};
+// nodes of /sys/devices/system/node, one node with all cpus of the process where there are none;
+// SEARCH_SERVER_NUMA_TOPOLOGY in environment replaces it with ParseNumaTopology of its value
+NumaTopology DetectNumaTopology();
+// cpu lists of nodes separated by ';' in the format of sysfs: "0-3,8;4-7";
+// throws invalid_argument
+NumaTopology ParseNumaTopology(std::string_view spec);
+// cpus of the process dealt to node_count nodes in contiguous ranges, nodes share cpus
+// when there are fewer cpus than nodes; throws invalid_argument for zero nodes
+NumaTopology SimulateNumaTopology(size_t node_count);
+// cpus absent from the affinity mask of the process are ignored,
+// false if none is left or the call fails, the thread stays where it was then
+bool PinCurrentThread(const std::vector<int>& cpus);
+
+struct NumaNodeStatistics {
+    int node_id = 0;
+    size_t queries = 0;
+    // postings, their term frequencies and documents touched, estimated from query costs
+    uint64_t bytes_read = 0;
+    std::chrono::nanoseconds busy_time{0};
+
+    // bytes per second of busy time
+    double GetBandwidth() const;
+};
+
+// one frozen image of the server per node, copied by a thread pinned to the node, so with
+// first touch placement of the kernel its pages are local to the node; workers of a node
+// read only its replica. The server is not referenced after construction
+class NumaReplicatedIndex {
+public:
+    NumaReplicatedIndex(const SearchServer& search_server, NumaTopology topology);
+    NumaReplicatedIndex(const NumaReplicatedIndex&) = delete;
+    NumaReplicatedIndex& operator=(const NumaReplicatedIndex&) = delete;
+    ~NumaReplicatedIndex();
+
+    const NumaTopology& GetTopology() const;
+    const FrozenIndexView& GetReplica(size_t node_index) const;
+    // size of one replica
+    size_t GetReplicaBytes() const;
+
+    // queries are taken from one shared queue by workers_per_node threads per node
+    // (0 for one per cpu of the node) pinned to the cpus of their node, each worker answers
+    // from the replica of its node; results are in the order of queries
+    std::vector<std::vector<Document>> ProcessQueries(const std::vector<std::string>& queries,
+                                                      size_t workers_per_node = 0) const;
+    // accumulated over ProcessQueries calls, in the order of topology nodes
+    std::vector<NumaNodeStatistics> GetNodeStatistics() const;
+    void ResetNodeStatistics();
+private:
+    struct Replica {
+        void* data = nullptr;
+        size_t size = 0;
+        std::unique_ptr<FrozenIndexView> view;
+    };
+    struct alignas(64) NodeCounters {
+        std::atomic<size_t> queries{0};
+        std::atomic<uint64_t> bytes_read{0};
+        std::atomic<int64_t> busy_ns{0};
+    };
+
+    void PlaceReplicas(const std::vector<char>& image);
+    void UnmapReplicas();
+
+    NumaTopology topology_;
+    std::vector<Replica> replicas_;
+    std::unique_ptr<NodeCounters[]> counters_;
+};
@@ -0,0 +1,73 @@
+#include "page_cursor.h"
+#include "search_server.h"
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+namespace {
+// relevance is compared in steps of the tolerance: close relevances are ranked by rating like
+// in FindTopDocuments, but unlike a plain tolerance the order stays transitive,
+// so pages neither skip nor repeat documents
+int64_t GetRelevanceStep(double relevance) {
+    return static_cast<int64_t>(floor(relevance / SearchServer::RELEVANCE_TOLERANCE));
+}
+}
+bool IsRankedBefore(const Document& lhs, const Document& rhs) {
+    const int64_t lhs_step = GetRelevanceStep(lhs.relevance);
+    const int64_t rhs_step = GetRelevanceStep(rhs.relevance);
+    if (lhs_step != rhs_step) {
+        return lhs_step > rhs_step;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+bool IsAfterCursor(const PageCursor& cursor, const Document& document) {
+    if (cursor.IsStart()) {
+        return true;
+    }
+    return IsRankedBefore(Document(cursor.id, cursor.relevance, cursor.rating), document);
+}
+// relevance is kept bit-exact so the next page starts exactly where the last one stopped
+// format: <relevance bits hex>.<rating>.<id>
+// start cursor is an empty string
+string EncodePageCursor(const PageCursor& cursor) {
+    if (cursor.IsStart()) {
+        return string();
+    }
+    uint64_t bits;
+    memcpy(&bits, &cursor.relevance, sizeof(bits));
+    char buffer[24];
+    string res(buffer, to_chars(buffer, buffer + sizeof(buffer), bits, 16).ptr);
+    res += '.';
+    res.append(buffer, to_chars(buffer, buffer + sizeof(buffer), cursor.rating).ptr);
+    res += '.';
+    res.append(buffer, to_chars(buffer, buffer + sizeof(buffer), cursor.id).ptr);
+    return res;
+}
+PageCursor DecodePageCursor(string_view text) {
+    if (text.empty()) {
+        return PageCursor();
+    }
+    PageCursor cursor;
+    uint64_t bits = 0;
+    const char* begin = text.data();
+    const char* end = text.data() + text.size();
+    auto res = from_chars(begin, end, bits, 16);
+    if (res.ec != errc() || res.ptr == end || *res.ptr != '.') {
+        throw invalid_argument("page cursor is corrupted"s);
+    }
+    res = from_chars(res.ptr + 1, end, cursor.rating);
+    if (res.ec != errc() || res.ptr == end || *res.ptr != '.') {
+        throw invalid_argument("page cursor is corrupted"s);
+    }
+    res = from_chars(res.ptr + 1, end, cursor.id);
+    if (res.ec != errc() || res.ptr != end || cursor.id < 0) {
+        throw invalid_argument("page cursor is corrupted"s);
+    }
+    memcpy(&cursor.relevance, &bits, sizeof(bits));
+    return cursor;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "document.h"
+// position of the last document of a page in the ranking order:
+// relevance desc, rating desc, id asc
+// default constructed cursor points before the first result
+struct PageCursor {
+    PageCursor() = default;
+    explicit PageCursor(const Document& last_document)
+            : relevance(last_document.relevance)
+            , rating(last_document.rating)
+            , id(last_document.id) {
+    }
+    bool IsStart() const {
+        return id < 0;
+    }
+
+    double relevance = 0.0;
+    int rating = 0;
+    int id = -1;
+};
+struct DocumentPage {
+    std::vector<Document> documents;
+    PageCursor next;
+    bool has_more = false;
+};
+// total ranking order used for pages, ties of FindTopDocuments are broken by id
+bool IsRankedBefore(const Document& lhs, const Document& rhs);
+// true if document goes strictly after the cursor in ranking order
+bool IsAfterCursor(const PageCursor& cursor, const Document& document);
+// opaque text form to hand out to clients
+std::string EncodePageCursor(const PageCursor& cursor);
+PageCursor DecodePageCursor(std::string_view text);
@@ -4,19 +4,128 @@
 
 #include "process_queries.h"
 
+namespace {
+// an exception escaping a parallel algorithm terminates the program, so errors are carried out
+// of it and the first one is rethrown
+void RethrowFirstError(const std::vector<std::exception_ptr>& errors) {
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+}
+
 std::vector<std::vector<Document>> ProcessQueries(
         const SearchServer& search_server,
         const std::vector<std::string>& queries) {
     std::vector<std::vector<Document>> res(queries.size());
-    std::transform(std::execution::par,
-                   queries.begin(), queries.end(),
-                   res.begin(),
-                   [&](const std::string& el){
-                       return search_server.FindTopDocuments(el);
-                   });
+    std::vector<std::exception_ptr> errors(queries.size());
+    std::vector<size_t> indexes(queries.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  indexes.begin(), indexes.end(),
+                  [&](size_t i){
+                      try {
+                          res[i] = search_server.FindTopDocuments(queries[i]);
+                      } catch (...) {
+                          errors[i] = std::current_exception();
+                      }
+                  });
+    RethrowFirstError(errors);
+    return res;
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries,
+        RequestStatistics& stats) {
+    std::vector<std::vector<Document>> res(queries.size());
+    std::vector<std::exception_ptr> errors(queries.size());
+    std::vector<size_t> indexes(queries.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  indexes.begin(), indexes.end(),
+                  [&](size_t i){
+                      try {
+                          const auto start = RequestStatistics::Clock::now();
+                          res[i] = search_server.FindTopDocuments(queries[i]);
+                          stats.Record(start, RequestStatistics::Clock::now() - start, res[i].size());
+                      } catch (...) {
+                          errors[i] = std::current_exception();
+                      }
+                  });
+    RethrowFirstError(errors);
     return res;
 }
 
+// admission waits on the calling thread, never on a worker of the parallel algorithm:
+// queries are run in waves, the first query of a wave may wait for running queries
+// (of other callers too) and the next ones join it while their cost fits without waiting
+std::vector<std::optional<PartialResult>> ProcessQueries(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries,
+        AdmissionController& admission,
+        SearchBudget::Clock::duration query_timeout,
+        size_t max_postings) {
+    std::vector<std::optional<PartialResult>> res(queries.size());
+    std::vector<std::exception_ptr> errors(queries.size());
+    std::vector<size_t> costs(queries.size());
+    std::vector<size_t> indexes(queries.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  indexes.begin(), indexes.end(),
+                  [&](size_t i){
+                      try {
+                          costs[i] = std::min(search_server.EstimateQueryCost(queries[i]), max_postings);
+                      } catch (...) {
+                          errors[i] = std::current_exception();
+                      }
+                  });
+    RethrowFirstError(errors);
+
+    struct AdmittedQuery {
+        size_t index;
+        AdmissionController::Ticket ticket;
+        SearchBudget budget;
+    };
+    size_t next = 0;
+    while (next < queries.size()) {
+        std::vector<AdmittedQuery> wave;
+        while (next < queries.size()) {
+            auto ticket = wave.empty() ? admission.Admit(costs[next]) : admission.TryAdmit(costs[next]);
+            if (!ticket && !wave.empty()) {
+                break;
+            }
+            if (ticket) {
+                SearchBudget budget = SearchBudget::WithTimeout(query_timeout);
+                budget.max_postings = max_postings;
+                wave.push_back({next, std::move(ticket), budget});
+            }
+            // a shed query keeps nullopt
+            ++next;
+        }
+        std::for_each(std::execution::par,
+                      wave.begin(), wave.end(),
+                      [&](AdmittedQuery& query){
+                          try {
+                              res[query.index] = search_server.FindTopDocuments(queries[query.index], query.budget);
+                          } catch (...) {
+                              errors[query.index] = std::current_exception();
+                          }
+                          query.ticket.Release();
+                      });
+    }
+    RethrowFirstError(errors);
+    return res;
+}
+
+std::vector<std::vector<Document>> ProcessQueriesBatched(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries) {
+    return search_server.FindTopDocumentsBatch(std::execution::par, queries);
+}
+
 std::list<Document> ProcessQueriesJoined(
         const SearchServer& search_server,
         const std::vector<std::string>& queries) {
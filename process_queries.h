@@ -2,9 +2,14 @@
 #include <vector>
 #include "document.h"
 #include "search_server.h"
+#include "request_stats.h"
+#include "admission_control.h"
+#include "search_budget.h"
+#include <optional>
 #include <string>
 #include <algorithm>
 #include <numeric>
+#include <exception>
 #include <execution>
 #include <list>
 #include <iostream>
@@ -12,6 +17,29 @@ std::vector<std::vector<Document>> ProcessQueries(
         const SearchServer& search_server,
         const std::vector<std::string>& queries);
 
+// same as above, latency and hit count of every query are recorded to stats
+std::vector<std::vector<Document>> ProcessQueries(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries,
+        RequestStatistics& stats);
+
+// every query is admitted by its estimated cost (capped by max_postings of the budget) and
+// runs within its own copy of the budget, the timeout starts on admission;
+// nullopt is returned for shed queries. Waiting for admission happens on the calling thread,
+// an invalid query throws before anything is admitted
+std::vector<std::optional<PartialResult>> ProcessQueries(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries,
+        AdmissionController& admission,
+        SearchBudget::Clock::duration query_timeout,
+        size_t max_postings = std::numeric_limits<size_t>::max());
+
+// same results as ProcessQueries, queries sharing words share walks of their posting lists,
+// see SearchServer::FindTopDocumentsBatch; pays off for large offline batches
+std::vector<std::vector<Document>> ProcessQueriesBatched(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries);
+
 std::list<Document> ProcessQueriesJoined(
         const SearchServer& search_server,
         const std::vector<std::string>& queries);
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "query_plan.h"
+using namespace std;
+const char* GetStrategyName(QueryStrategy strategy) {
+    switch (strategy) {
+        case QueryStrategy::EMPTY: return "empty";
+        case QueryStrategy::TERM_AT_A_TIME: return "term-at-a-time";
+        case QueryStrategy::DOCUMENT_AT_A_TIME: return "document-at-a-time";
+        case QueryStrategy::DENSE_ACCUMULATOR: return "dense-accumulator";
+        default: return "unknown";
+    }
+}
+ostream& operator<<(ostream& out, const QueryPlan& plan) {
+    out << "mode = "s << (plan.mode == QueryMode::ALL ? "ALL"s : "ANY"s)
+        << ", strategy = "s << GetStrategyName(plan.strategy)
+        << ", estimated postings = "s << plan.estimated_postings;
+    if (plan.probes_skipped_words) {
+        out << ", skipped impact bound = "s << plan.skipped_impact_bound;
+    }
+    out << '\n';
+    for (const TermStatistics& term : plan.terms) {
+        out << "  "s << (term.is_minus ? "-"s : ""s) << term.word
+            << ": df = "s << term.document_freq
+            << ", idf = "s << term.inverse_document_freq
+            << ", max impact = "s << term.max_impact;
+        if (term.is_high_frequency) {
+            out << ", high frequency"s;
+        }
+        if (term.is_skipped) {
+            out << ", skipped"s;
+        }
+        if (!term.note.empty()) {
+            out << " ("s << term.note << ')';
+        }
+        out << '\n';
+    }
+    return out;
+}
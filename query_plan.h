@@ -0,0 +1,47 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+// ANY - document has to contain at least one plus word, ALL - every plus word
+enum class QueryMode {
+    ANY,
+    ALL,
+};
+enum class QueryStrategy {
+    // result is known to be empty without walking postings
+    EMPTY,
+    // posting lists are walked one by one into a map of accumulators
+    TERM_AT_A_TIME,
+    // posting lists are intersected, shortest first
+    DOCUMENT_AT_A_TIME,
+    // accumulators and match flags are flat arrays indexed by document id
+    DENSE_ACCUMULATOR,
+};
+struct TermStatistics {
+    std::string word;
+    bool is_minus = false;
+    size_t document_freq = 0;
+    double inverse_document_freq = 0.0;
+    // upper bound of the word contribution to relevance
+    double max_impact = 0.0;
+    // contained in more than half of documents
+    bool is_high_frequency = false;
+    // posting list of the word is not walked
+    bool is_skipped = false;
+    std::string note;
+};
+struct QueryPlan {
+    QueryMode mode = QueryMode::ANY;
+    QueryStrategy strategy = QueryStrategy::EMPTY;
+    // plus words in traversal order, then minus words
+    std::vector<TermStatistics> terms;
+    // postings of words which are walked
+    size_t estimated_postings = 0;
+    // skipped plus words are probed for candidates of walked ones
+    bool probes_skipped_words = false;
+    // upper bound of relevance of documents containing skipped plus words only
+    double skipped_impact_bound = 0.0;
+};
+const char* GetStrategyName(QueryStrategy strategy);
+// human readable explanation, one line per word
+std::ostream& operator<<(std::ostream& out, const QueryPlan& plan);
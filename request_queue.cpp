@@ -3,21 +3,29 @@ using namespace std;
 RequestQueue::RequestQueue(const SearchServer& search_server) :
         search_server_(search_server),time_(0),empty_req_num_(0) {
 }
+RequestQueue::RequestQueue(const SearchServer& search_server, RequestStatistics& stats) :
+        search_server_(search_server),stats_(&stats),time_(0),empty_req_num_(0) {
+}
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
+    const auto start = RequestStatistics::Clock::now();
     vector<Document> res = search_server_.FindTopDocuments(raw_query, status);
-    time_incr_and_check(res);
+    time_incr_and_check(res, start);
     return res;
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
+    const auto start = RequestStatistics::Clock::now();
     vector<Document> res = search_server_.FindTopDocuments(raw_query);
-    time_incr_and_check(res);
+    time_incr_and_check(res, start);
     return res;
 }
 int RequestQueue::GetNoResultRequests() const {
     return empty_req_num_;
 }
-void RequestQueue::time_incr_and_check(std::vector<Document> resp){
+void RequestQueue::time_incr_and_check(const std::vector<Document>& resp, RequestStatistics::Clock::time_point start){
+    if (stats_ != nullptr){
+        stats_->Record(start, RequestStatistics::Clock::now() - start, resp.size());
+    }
     ++time_;
     if (time_ > sec_in_day_){
         QueryResult old_resp = requests_.front();
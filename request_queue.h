@@ -4,13 +4,17 @@
 #include <deque>
 #include "document.h"
 #include "search_server.h"
+#include "request_stats.h"
 class RequestQueue {
 public:
     explicit RequestQueue(const SearchServer& search_server);
+    // additionally reports wall-clock latency and hit count of every request to stats
+    RequestQueue(const SearchServer& search_server, RequestStatistics& stats);
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+        const auto start = RequestStatistics::Clock::now();
         std::vector<Document> res = search_server_.FindTopDocuments(raw_query, document_predicate);
-        time_incr_and_check(res);
+        time_incr_and_check(res, start);
         return res;
     }
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
@@ -20,9 +24,10 @@ private:
     struct QueryResult {
         bool is_empty;
     };
-    void time_incr_and_check(std::vector<Document> resp);
+    void time_incr_and_check(const std::vector<Document>& resp, RequestStatistics::Clock::time_point start);
     std::deque<QueryResult> requests_;
     const SearchServer& search_server_;
+    RequestStatistics* stats_ = nullptr;
     const static int sec_in_day_ = 1440;
     int time_;
     int empty_req_num_;
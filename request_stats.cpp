@@ -0,0 +1,212 @@
+#include "request_stats.h"
+#include <algorithm>
+#include <utility>
+using namespace std;
+void LatencyHistogram::Record(uint64_t value) {
+    ++counts_[GetBucketIndex(value)];
+    ++count_;
+    max_ = max(max_, value);
+}
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    max_ = max(max_, other.max_);
+}
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    const double clamped = min(max(percentile, 0.0), 100.0);
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(clamped / 100.0 * count_ + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return min(GetBucketUpperBound(i), max_);
+        }
+    }
+    return max_;
+}
+uint64_t LatencyHistogram::GetCount() const {
+    return count_;
+}
+uint64_t LatencyHistogram::GetMax() const {
+    return max_;
+}
+// values below SUB_BUCKET_COUNT are stored exactly,
+// others by position of the highest bit and next SUB_BUCKET_BITS bits
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    const int high_bit = 63 - __builtin_clzll(value);
+    const int shift = high_bit - SUB_BUCKET_BITS;
+    const size_t sub_bucket = static_cast<size_t>(value >> shift) - SUB_BUCKET_COUNT;
+    return (static_cast<size_t>(shift) + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const int shift = static_cast<int>(index / SUB_BUCKET_COUNT) - 1;
+    const uint64_t sub_bucket = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+namespace {
+atomic<uint64_t> next_statistics_id{1};
+}
+RequestStatistics::RequestStatistics(size_t ring_capacity)
+        : ring_capacity_(max<size_t>(ring_capacity, 1))
+        , instance_id_(next_statistics_id.fetch_add(1))
+        , rings_(make_shared<RingList>()) {
+}
+// hands the ring back when its thread exits, if the instance is still alive
+class RequestStatistics::RingOwner {
+public:
+    RingOwner(uint64_t instance_id, const shared_ptr<RingList>& rings, Ring* ring)
+            : instance_id_(instance_id)
+            , rings_(rings)
+            , ring_(ring) {
+    }
+    RingOwner(RingOwner&& other) noexcept = default;
+    RingOwner& operator=(RingOwner&& other) noexcept = default;
+    ~RingOwner() {
+        if (const auto rings = rings_.lock()) {
+            lock_guard<mutex> guard(rings->mutex);
+            ring_->has_writer = false;
+        }
+    }
+
+    uint64_t GetInstanceId() const {
+        return instance_id_;
+    }
+    bool IsInstanceAlive() const {
+        return !rings_.expired();
+    }
+    Ring& GetRing() const {
+        return *ring_;
+    }
+private:
+    uint64_t instance_id_;
+    weak_ptr<RingList> rings_;
+    Ring* ring_;
+};
+// ids are never reused, so owners of destroyed instances are never matched, they are dropped
+// on the next miss
+RequestStatistics::Ring& RequestStatistics::GetThreadRing() {
+    thread_local vector<RingOwner> thread_rings;
+    for (const RingOwner& owner : thread_rings) {
+        if (owner.GetInstanceId() == instance_id_) {
+            return owner.GetRing();
+        }
+    }
+    thread_rings.erase(remove_if(thread_rings.begin(), thread_rings.end(), [](const RingOwner& owner) {
+        return !owner.IsInstanceAlive();
+    }), thread_rings.end());
+    Ring* ring = nullptr;
+    {
+        lock_guard<mutex> guard(rings_->mutex);
+        for (const auto& free_ring : rings_->rings) {
+            if (!free_ring->has_writer) {
+                ring = free_ring.get();
+                break;
+            }
+        }
+        if (ring == nullptr) {
+            ring = rings_->rings.emplace_back(make_unique<Ring>(ring_capacity_)).get();
+        }
+        ring->has_writer = true;
+    }
+    thread_rings.emplace_back(instance_id_, rings_, ring);
+    return *ring;
+}
+// odd sequence marks slot being written, readers skip it or retry later
+void RequestStatistics::Record(Clock::time_point start, Clock::duration latency, size_t hit_count) {
+    Ring& ring = GetThreadRing();
+    const uint64_t position = ring.head.load(memory_order_relaxed);
+    Slot& slot = ring.slots[position % ring.slots.size()];
+    const uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+    slot.sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.start_ns.store(chrono::duration_cast<chrono::nanoseconds>(start.time_since_epoch()).count(), memory_order_relaxed);
+    slot.latency_ns.store(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(latency).count()), memory_order_relaxed);
+    slot.hits.store(hit_count, memory_order_relaxed);
+    slot.sequence.store(sequence + 2, memory_order_release);
+    ring.head.store(position + 1, memory_order_release);
+    const int64_t start_ns = chrono::duration_cast<chrono::nanoseconds>(start.time_since_epoch()).count();
+    if (start_ns > ring.latest_start_ns.load(memory_order_relaxed)) {
+        ring.latest_start_ns.store(start_ns, memory_order_relaxed);
+    }
+}
+RequestStatsSnapshot RequestStatistics::GetSnapshot(Clock::duration window) const {
+    vector<const Ring*> rings;
+    {
+        lock_guard<mutex> guard(rings_->mutex);
+        for (const auto& ring : rings_->rings) {
+            rings.push_back(ring.get());
+        }
+    }
+    const int64_t now_ns = chrono::duration_cast<chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    const int64_t window_ns = chrono::duration_cast<chrono::nanoseconds>(window).count();
+    const int64_t window_start_ns = now_ns - window_ns;
+
+    RequestStatsSnapshot snapshot;
+    snapshot.window = chrono::nanoseconds(window_ns);
+    LatencyHistogram histogram;
+    // records of a ring which overwrote a part of the window cover the time since its oldest one
+    int64_t covered_start_ns = window_start_ns;
+    vector<int64_t> request_starts_ns;
+    for (const Ring* ring : rings) {
+        if (ring->latest_start_ns.load(memory_order_relaxed) < window_start_ns) {
+            continue;
+        }
+        const uint64_t head = ring->head.load(memory_order_acquire);
+        const uint64_t capacity = ring->slots.size();
+        const uint64_t first = head > capacity ? head - capacity : 0;
+        int64_t oldest_ns = now_ns;
+        for (uint64_t position = first; position < head; ++position) {
+            const Slot& slot = ring->slots[position % capacity];
+            const uint64_t sequence = slot.sequence.load(memory_order_acquire);
+            if (sequence % 2 != 0) {
+                continue;
+            }
+            const int64_t start_ns = slot.start_ns.load(memory_order_relaxed);
+            const uint64_t latency_ns = slot.latency_ns.load(memory_order_relaxed);
+            const uint64_t hits = slot.hits.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.sequence.load(memory_order_relaxed) != sequence) {
+                continue;
+            }
+            oldest_ns = min(oldest_ns, start_ns);
+            if (start_ns < window_start_ns) {
+                continue;
+            }
+            ++snapshot.requests;
+            request_starts_ns.push_back(start_ns);
+            snapshot.total_hits += hits;
+            if (hits == 0) {
+                ++snapshot.empty_requests;
+            }
+            histogram.Record(latency_ns);
+        }
+        if (first > 0 && oldest_ns > window_start_ns) {
+            snapshot.is_complete = false;
+            covered_start_ns = max(covered_start_ns, oldest_ns);
+        }
+    }
+    if (now_ns > covered_start_ns) {
+        const auto covered_requests = count_if(request_starts_ns.begin(), request_starts_ns.end(), [covered_start_ns](int64_t start_ns) {
+            return start_ns >= covered_start_ns;
+        });
+        snapshot.qps = covered_requests * 1e9 / (now_ns - covered_start_ns);
+    }
+    snapshot.p50_ns = histogram.GetPercentile(50);
+    snapshot.p90_ns = histogram.GetPercentile(90);
+    snapshot.p99_ns = histogram.GetPercentile(99);
+    snapshot.p999_ns = histogram.GetPercentile(99.9);
+    snapshot.max_ns = histogram.GetMax();
+    return snapshot;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+// HDR-style histogram: every power of two is split into 2^SUB_BUCKET_BITS linear sub-buckets,
+// so relative error of any percentile is below 1 / 2^SUB_BUCKET_BITS
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    void Record(uint64_t value);
+    void Merge(const LatencyHistogram& other);
+    // returns upper bound of the bucket holding requested percentile, percentile in [0, 100]
+    uint64_t GetPercentile(double percentile) const;
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+private:
+    static size_t GetBucketIndex(uint64_t value);
+    static uint64_t GetBucketUpperBound(size_t index);
+
+    std::array<uint64_t, BUCKET_COUNT> counts_ = {};
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct RequestStatsSnapshot {
+    std::chrono::nanoseconds window{0};
+    uint64_t requests = 0;
+    uint64_t empty_requests = 0;
+    uint64_t total_hits = 0;
+    // requests per second over the part of the window all rings still cover
+    double qps = 0.0;
+    uint64_t p50_ns = 0;
+    uint64_t p90_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+    uint64_t max_ns = 0;
+    // false if some thread overwrote records that still belong to the window
+    bool is_complete = true;
+};
+
+// thread-safe request statistics
+// every writer thread gets its own single-producer ring buffer, records are published
+// through a per-slot sequence number, so neither writers nor readers take locks on the hot path
+// (the mutex is taken once per thread on first Record and by readers to list rings).
+// A ring of an exited thread keeps its records and is taken over by the next new writer thread,
+// so there are no more rings than writer threads alive at once
+class RequestStatistics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestStatistics(size_t ring_capacity = 1 << 14);
+    RequestStatistics(const RequestStatistics&) = delete;
+    RequestStatistics& operator=(const RequestStatistics&) = delete;
+
+    void Record(Clock::time_point start, Clock::duration latency, size_t hit_count);
+    // aggregates requests started within last window
+    RequestStatsSnapshot GetSnapshot(Clock::duration window) const;
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<int64_t> start_ns{0};
+        std::atomic<uint64_t> latency_ns{0};
+        std::atomic<uint64_t> hits{0};
+    };
+    struct Ring {
+        explicit Ring(size_t capacity) : slots(capacity) {
+        }
+        std::vector<Slot> slots;
+        std::atomic<uint64_t> head{0};
+        // readers skip rings without requests started in the window
+        std::atomic<int64_t> latest_start_ns{std::numeric_limits<int64_t>::min()};
+        // guarded by the mutex of RingList
+        bool has_writer = true;
+    };
+    // shared with writer threads, which hand their rings back on exit even after the instance is gone
+    struct RingList {
+        std::mutex mutex;
+        std::deque<std::unique_ptr<Ring>> rings;
+    };
+    // thread_local owner of a ring, defined in request_stats.cpp
+    class RingOwner;
+    Ring& GetThreadRing();
+
+    const size_t ring_capacity_;
+    const uint64_t instance_id_;
+    const std::shared_ptr<RingList> rings_;
+};
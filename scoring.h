@@ -0,0 +1,67 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+// scorers are plain types chosen at compile time, every engine of SearchServer is a template
+// over the scorer and calls it inline in its posting loop:
+//   static constexpr bool USES_DOCUMENT_LENGTH
+//       false lets engines skip lengths and norms of documents altogether
+//   double GetTermWeight(const CollectionStatistics&, size_t document_freq) const
+//       factor shared by all postings of a word, computed once per query word
+//   double GetDocumentNorm(const CollectionStatistics&, uint32_t document_length) const
+//       factor shared by all postings of a document, computed once per document and query
+//       (once per document and batch for FindTopDocumentsBatch)
+//   double Score(double term_freq, uint32_t document_length, double document_norm, double term_weight) const
+//       contribution of one posting; term_freq is the share of the word among
+//       the words of the document, document_length counts words without stop words
+//   double GetMaxScore(double max_term_freq, double term_weight) const
+//       upper bound of Score for a word, used to skip words and to order them under a budget
+struct CollectionStatistics {
+    size_t document_count = 0;
+    double average_document_length = 0.0;
+};
+// relevance of SearchServer: tf * log(documents / df)
+struct TfIdfScorer {
+    static constexpr bool USES_DOCUMENT_LENGTH = false;
+
+    double GetTermWeight(const CollectionStatistics& statistics, size_t document_freq) const {
+        return std::log(statistics.document_count * 1.0 / document_freq);
+    }
+    double GetDocumentNorm(const CollectionStatistics&, uint32_t) const {
+        return 0.0;
+    }
+    double Score(double term_freq, uint32_t, double, double term_weight) const {
+        return term_freq * term_weight;
+    }
+    double GetMaxScore(double max_term_freq, double term_weight) const {
+        return max_term_freq * term_weight;
+    }
+};
+// Okapi BM25 with the idf of Lucene, which is never negative
+struct Bm25Scorer {
+    static constexpr bool USES_DOCUMENT_LENGTH = true;
+    double k1 = 1.2;
+    double b = 0.75;
+
+    double GetTermWeight(const CollectionStatistics& statistics, size_t document_freq) const {
+        return std::log(1.0 + (statistics.document_count - document_freq + 0.5) / (document_freq + 0.5));
+    }
+    double GetDocumentNorm(const CollectionStatistics& statistics, uint32_t document_length) const {
+        return k1 * (1.0 - b + b * document_length / statistics.average_document_length);
+    }
+    double Score(double term_freq, uint32_t document_length, double document_norm, double term_weight) const {
+        const double count = term_freq * document_length;
+        return term_weight * count * (k1 + 1.0) / (count + document_norm);
+    }
+    // count / (count + norm) is below 1 whatever the length
+    double GetMaxScore(double, double term_weight) const {
+        return term_weight * (k1 + 1.0);
+    }
+};
+// policy argument of SearchServer::FindTopDocuments selecting the scorer
+template <typename Scorer>
+struct ScoringPolicy {
+    Scorer scorer;
+};
+inline constexpr ScoringPolicy<TfIdfScorer> TF_IDF_SCORING{};
+inline constexpr ScoringPolicy<Bm25Scorer> BM25_SCORING{};
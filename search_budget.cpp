@@ -0,0 +1,18 @@
+#include "search_budget.h"
+using namespace std;
+SearchBudget SearchBudget::WithTimeout(Clock::duration timeout) {
+    SearchBudget budget;
+    budget.deadline = Clock::now() + timeout;
+    return budget;
+}
+SearchBudget SearchBudget::WithPostings(size_t max_postings) {
+    SearchBudget budget;
+    budget.max_postings = max_postings;
+    return budget;
+}
+bool BudgetTracker::IsOutOfTime() const {
+    if (budget_.cancelled != nullptr && budget_.cancelled->load(memory_order_relaxed)) {
+        return true;
+    }
+    return budget_.deadline != SearchBudget::Clock::time_point::max() && SearchBudget::Clock::now() >= budget_.deadline;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "document.h"
+// limits of work one query may do, default constructed budget is unlimited
+struct SearchBudget {
+    using Clock = std::chrono::steady_clock;
+
+    static SearchBudget WithTimeout(Clock::duration timeout);
+    static SearchBudget WithPostings(size_t max_postings);
+
+    Clock::time_point deadline = Clock::time_point::max();
+    size_t max_postings = std::numeric_limits<size_t>::max();
+    // set from another thread to stop the query, checked together with the deadline
+    const std::atomic<bool>* cancelled = nullptr;
+};
+// best documents found before the budget ran out
+struct PartialResult {
+    std::vector<Document> documents;
+    // true if some postings were not walked
+    bool is_partial = false;
+    size_t scored_postings = 0;
+};
+// counts postings against a budget, the clock and the cancel flag are looked at
+// once per CHECK_INTERVAL postings to keep the hot loop cheap
+class BudgetTracker {
+public:
+    static constexpr size_t CHECK_INTERVAL = 1024;
+
+    explicit BudgetTracker(const SearchBudget& budget)
+            : budget_(budget)
+            , is_exhausted_(IsOutOfTime()) {
+    }
+    // false once the budget is spent, the posting is not counted then
+    bool Spend() {
+        if (is_exhausted_ || spent_ == budget_.max_postings) {
+            is_exhausted_ = true;
+            return false;
+        }
+        if (++spent_ % CHECK_INTERVAL == 0 && IsOutOfTime()) {
+            is_exhausted_ = true;
+        }
+        return true;
+    }
+    bool IsExhausted() const {
+        return is_exhausted_;
+    }
+    size_t GetSpentPostings() const {
+        return spent_;
+    }
+private:
+    bool IsOutOfTime() const;
+
+    const SearchBudget& budget_;
+    size_t spent_ = 0;
+    bool is_exhausted_ = false;
+};
@@ -1,4 +1,8 @@
 #include "search_server.h"
+#include "binary_io.h"
+#include <exception>
+#include <cctype>
+#include <unordered_map>
 using namespace std;
 SearchServer::SearchServer(const string& stop_words_text)
         : SearchServer(SplitIntoWords(stop_words_text)) {
@@ -7,31 +11,123 @@ SearchServer::SearchServer(const string_view stop_words_text)
         : SearchServer(SplitIntoWordsView(stop_words_text)) {
 }
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
+    CheckNewDocumentId(document_id);
+    IndexDocument(document_id, ComputeTermFrequencies(document), status, ComputeAverageRating(ratings));
+}
+void SearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    AddDocuments(execution::seq, documents);
+}
+void SearchServer::AddDocuments(const execution::sequenced_policy&, const vector<DocumentInput>& documents) {
+    set<int> batch_ids;
+    for (const DocumentInput& document : documents) {
+        CheckNewDocumentId(document.id);
+        if (!batch_ids.insert(document.id).second) {
+            throw invalid_argument("id for adding doc isn't correct"s);
+        }
+    }
+    vector<DocumentTerms> word_freqs;
+    word_freqs.reserve(documents.size());
+    for (const DocumentInput& document : documents) {
+        word_freqs.push_back(ComputeTermFrequencies(document.text));
+    }
+    for (size_t i = 0; i < documents.size(); ++i) {
+        IndexDocument(documents[i].id, word_freqs[i], documents[i].status, ComputeAverageRating(documents[i].ratings));
+    }
+}
+void SearchServer::AddDocuments(const execution::parallel_policy&, const vector<DocumentInput>& documents) {
+    set<int> batch_ids;
+    for (const DocumentInput& document : documents) {
+        CheckNewDocumentId(document.id);
+        if (!batch_ids.insert(document.id).second) {
+            throw invalid_argument("id for adding doc isn't correct"s);
+        }
+    }
+    vector<DocumentTerms> word_freqs(documents.size());
+    // an exception escaping a parallel algorithm terminates the program, so errors are carried out
+    vector<exception_ptr> errors(documents.size());
+    vector<size_t> indexes(documents.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        try {
+            word_freqs[i] = ComputeTermFrequencies(documents[i].text);
+        } catch (...) {
+            errors[i] = current_exception();
+        }
+    });
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+    for (size_t i = 0; i < documents.size(); ++i) {
+        IndexDocument(documents[i].id, word_freqs[i], documents[i].status, ComputeAverageRating(documents[i].ratings));
+    }
+}
+SearchServer::DocumentTerms SearchServer::ComputeTermFrequencies(const string_view text) const {
+    const vector<string_view> words = SplitIntoWordsNoStop(text);
+    const double inv_word_count = 1.0 / words.size();
+    DocumentTerms terms;
+    for (const string_view word : words) {
+        terms.word_freqs[word] += inv_word_count;
+    }
+    terms.length = static_cast<uint32_t>(words.size());
+    return terms;
+}
+void SearchServer::CheckNewDocumentId(int document_id) const {
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw invalid_argument("id for adding doc isn't correct"s);
     }
-    vector<string> words = SplitIntoWordsNoStop(document);
-    const double inv_word_count = 1.0 / words.size();
-    for (const string& word : words) {
-        auto it = vocab_.insert(word);
-        word_to_document_freqs_[*it.first][document_id] += inv_word_count;
-        doc_to_word_freq[document_id][*it.first] += inv_word_count;
+}
+void SearchServer::IndexDocument(int document_id, const DocumentTerms& terms, DocumentStatus status, int rating) {
+    auto& document_freqs = doc_to_word_freq[document_id];
+    for (const auto& [word, term_freq] : terms.word_freqs) {
+        auto it = vocab_.find(word);
+        if (it == vocab_.end()) {
+            it = vocab_.emplace(word).first;
+        }
+        const auto [postings, is_new_word] = word_to_document_freqs_.try_emplace(*it);
+        if (is_new_word) {
+            atomic_store(&term_index_, shared_ptr<const TermIndex>());
+            if (fuzzy_index_) {
+                fuzzy_index_->AddWord(*it);
+            }
+        }
+        postings->second[document_id] = term_freq;
+        document_freqs.emplace_hint(document_freqs.end(), *it, term_freq);
+        if (!head_term_cache_.IsEmpty()) {
+            head_term_cache_.AddPosting(*it, status, {document_id, term_freq, rating});
+        }
+        double& max_freq = word_to_max_freq_[*it];
+        max_freq = max(max_freq, term_freq);
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+    documents_.emplace(document_id, DocumentData{rating, status, terms.length});
+    total_document_length_ += terms.length;
     document_ids_.emplace(document_id);
 }
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
-    return SearchServer::FindTopDocuments(raw_query,
-                                          [status](int document_id, DocumentStatus document_status, int rating) {
-                                              return document_status == status;});
+    const Query query = ParseQuery(raw_query);
+    if (auto documents = FindHeadTermTopDocuments(query, status)) {
+        return move(*documents);
+    }
+    auto matched_documents = FindAllDocuments(query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+    SelectTopDocuments(execution::seq, matched_documents);
+    return matched_documents;
 }
 vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_policy&, const string_view raw_query, DocumentStatus status) const {
     return SearchServer::FindTopDocuments(raw_query,status);
 }
 vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy&, const string_view raw_query, DocumentStatus status) const {
-    return SearchServer::FindTopDocuments(execution::par, raw_query,
-                                          [status](int document_id, DocumentStatus document_status, int rating) {
-                                              return document_status == status;});
+    const Query query = ParseQuery(raw_query);
+    if (auto documents = FindHeadTermTopDocuments(query, status)) {
+        return move(*documents);
+    }
+    auto matched_documents = FindAllDocuments(execution::par, query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+    SelectTopDocuments(execution::par, matched_documents);
+    return matched_documents;
 }
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) const {
     return SearchServer::FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
@@ -42,11 +138,228 @@ vector<Document> SearchServer::FindTopDocuments(const execution::sequenced_polic
 vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy&, const string_view raw_query) const {
     return SearchServer::FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
 }
+vector<Document> SearchServer::FindTopDocuments(const AdaptivePolicy& policy, const string_view raw_query, DocumentStatus status) const {
+    return SearchServer::FindTopDocuments(policy, raw_query,
+                                          [status](int document_id, DocumentStatus document_status, int rating) {
+                                              return document_status == status;});
+}
+vector<Document> SearchServer::FindTopDocuments(const AdaptivePolicy& policy, const string_view raw_query) const {
+    return SearchServer::FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
+vector<Document> SearchServer::FindTopDocuments(ExecutionMode mode, const string_view raw_query, DocumentStatus status) const {
+    return SearchServer::FindTopDocuments(mode, raw_query,
+                                          [status](int document_id, DocumentStatus document_status, int rating) {
+                                              return document_status == status;});
+}
+vector<Document> SearchServer::FindTopDocuments(ExecutionMode mode, const string_view raw_query) const {
+    return SearchServer::FindTopDocuments(mode, raw_query, DocumentStatus::ACTUAL);
+}
+vector<Document> SearchServer::FindTopDocuments(QueryMode mode, const string_view raw_query, DocumentStatus status) const {
+    return SearchServer::FindTopDocuments(mode, raw_query,
+                                          [status](int document_id, DocumentStatus document_status, int rating) {
+                                              return document_status == status;});
+}
+vector<Document> SearchServer::FindTopDocuments(QueryMode mode, const string_view raw_query) const {
+    return SearchServer::FindTopDocuments(mode, raw_query, DocumentStatus::ACTUAL);
+}
+PartialResult SearchServer::FindTopDocuments(const string_view raw_query, const SearchBudget& budget, DocumentStatus status) const {
+    return FindTopDocuments(raw_query, budget, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+}
+PartialResult SearchServer::FindTopDocuments(const string_view raw_query, const SearchBudget& budget) const {
+    return FindTopDocuments(raw_query, budget, DocumentStatus::ACTUAL);
+}
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status) const {
+    return FindTopDocumentsBatch(raw_queries, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+}
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries) const {
+    return FindTopDocumentsBatch(raw_queries, DocumentStatus::ACTUAL);
+}
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const execution::parallel_policy&, const vector<string>& raw_queries, DocumentStatus status) const {
+    return FindTopDocumentsBatch(execution::par, raw_queries, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+}
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const execution::parallel_policy&, const vector<string>& raw_queries) const {
+    return FindTopDocumentsBatch(execution::par, raw_queries, DocumentStatus::ACTUAL);
+}
+FacetedResult SearchServer::FindTopDocumentsWithFacets(const string_view raw_query, DocumentStatus status, int rating_bucket_width) const {
+    return FindTopDocumentsWithFacets(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, rating_bucket_width);
+}
+FacetedResult SearchServer::FindTopDocumentsWithFacets(const execution::parallel_policy&, const string_view raw_query, DocumentStatus status,
+                                                       int rating_bucket_width) const {
+    return FindTopDocumentsWithFacets(execution::par, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, rating_bucket_width);
+}
+// buckets start at multiples of the width, negative ratings included
+int SearchServer::GetRatingBucket(int rating, int bucket_width) {
+    const int bucket = rating / bucket_width - (rating % bucket_width < 0 ? 1 : 0);
+    return bucket * bucket_width;
+}
+void SearchServer::MergeFacetCounts(FacetCounts& target, const FacetCounts& source) {
+    target.total_matches += source.total_matches;
+    for (size_t status = 0; status < target.by_status.size(); ++status) {
+        target.by_status[status] += source.by_status[status];
+    }
+    for (const auto [bucket, count] : source.by_rating) {
+        target.by_rating[bucket] += count;
+    }
+}
+vector<string_view> SearchServer::FindWordsByPrefix(const string_view prefix, size_t max_words) const {
+    const auto term_index = GetTermIndex();
+    const auto [first, last] = term_index->dictionary.FindPrefixRange(prefix);
+    vector<const WordPostings*> matched;
+    for (uint32_t term_id = first; term_id < last; ++term_id) {
+        if (!term_index->postings[term_id]->second.empty()) {
+            matched.push_back(term_index->postings[term_id]);
+        }
+    }
+    const auto by_frequency = [](const WordPostings* lhs, const WordPostings* rhs) {
+        if (lhs->second.size() != rhs->second.size()) {
+            return lhs->second.size() > rhs->second.size();
+        }
+        return lhs->first < rhs->first;
+    };
+    const size_t count = min(max_words, matched.size());
+    partial_sort(matched.begin(), matched.begin() + count, matched.end(), by_frequency);
+    vector<string_view> words;
+    words.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        words.push_back(matched[i]->first);
+    }
+    return words;
+}
+optional<vector<Document>> SearchServer::FindHeadTermTopDocuments(const Query& query, DocumentStatus status) const {
+    if (query.plus_words.size() != 1 || !query.minus_words.empty()) {
+        return nullopt;
+    }
+    const string_view word = *query.plus_words.begin();
+    const auto postings = word_to_document_freqs_.find(word);
+    if (postings == word_to_document_freqs_.end() || postings->second.size() < HEAD_TERM_MIN_DOCUMENTS) {
+        return nullopt;
+    }
+    auto entry = head_term_cache_.Find(word, status);
+    // built on first use and again when removals took the list below the top
+    if (!entry || (entry->excluded_term_freq && entry->candidates.size() < MAX_RESULT_DOCUMENT_COUNT)) {
+        vector<HeadTermCache::Candidate> candidates;
+        for (const auto [document_id, term_freq] : postings->second) {
+            const auto& document_data = documents_.at(document_id);
+            if (document_data.status == status) {
+                candidates.push_back({document_id, term_freq, document_data.rating});
+            }
+        }
+        entry = head_term_cache_.Build(word, status, move(candidates));
+    }
+    // every left out document has to be ranked after every candidate, so the relevance
+    // gap has to be above the tie tolerance of SelectTopDocuments
+    const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+    if (entry->excluded_term_freq
+        && (entry->candidates.size() < MAX_RESULT_DOCUMENT_COUNT
+            || (entry->candidates.back().term_freq - *entry->excluded_term_freq) * inverse_document_freq < RELEVANCE_TOLERANCE)) {
+        return nullopt;
+    }
+    vector<Document> documents;
+    documents.reserve(entry->candidates.size());
+    for (const HeadTermCache::Candidate& candidate : entry->candidates) {
+        documents.push_back({candidate.document_id, candidate.term_freq * inverse_document_freq, candidate.rating});
+    }
+    SelectTopDocuments(execution::seq, documents);
+    return documents;
+}
+void SearchServer::EnableFuzzyMatching(size_t max_distance, size_t prefix_length) {
+    FuzzyIndex fuzzy_index(max_distance, prefix_length);
+    for (const auto& [word, _] : word_to_document_freqs_) {
+        fuzzy_index.AddWord(word);
+    }
+    fuzzy_index_ = move(fuzzy_index);
+}
+vector<FuzzyIndex::Match> SearchServer::FindSimilarWords(const string_view word, size_t max_distance) const {
+    if (!fuzzy_index_) {
+        throw invalid_argument("fuzzy matching is not enabled"s);
+    }
+    // (document frequency, match), words of removed documents stay in the fuzzy index
+    vector<pair<size_t, FuzzyIndex::Match>> live_matches;
+    for (const FuzzyIndex::Match& match : fuzzy_index_->FindWords(word, max_distance)) {
+        const size_t document_freq = word_to_document_freqs_.at(match.word).size();
+        if (document_freq > 0) {
+            live_matches.push_back({document_freq, match});
+        }
+    }
+    stable_sort(live_matches.begin(), live_matches.end(), [](const auto& lhs, const auto& rhs) {
+        if (lhs.second.distance != rhs.second.distance) {
+            return lhs.second.distance < rhs.second.distance;
+        }
+        return lhs.first > rhs.first;
+    });
+    vector<FuzzyIndex::Match> matches;
+    matches.reserve(live_matches.size());
+    for (const auto& [_, match] : live_matches) {
+        matches.push_back(match);
+    }
+    return matches;
+}
+shared_ptr<const SearchServer::TermIndex> SearchServer::GetTermIndex() const {
+    auto term_index = atomic_load(&term_index_);
+    if (!term_index) {
+        auto built = make_shared<TermIndex>();
+        vector<string_view> words;
+        words.reserve(word_to_document_freqs_.size());
+        for (const auto& word_postings : word_to_document_freqs_) {
+            words.push_back(word_postings.first);
+            built->postings.push_back(&word_postings);
+        }
+        built->dictionary = TermDictionary(words);
+        term_index = move(built);
+        atomic_store(&term_index_, term_index);
+    }
+    return term_index;
+}
+size_t SearchServer::EstimateQueryCost(const string_view raw_query) const {
+    const Query query = ParseQuery(raw_query);
+    size_t cost = 0;
+    for (const auto* words : {&query.plus_words, &query.minus_words}) {
+        for (const string_view word : *words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it != word_to_document_freqs_.end()) {
+                cost += it->second.size();
+            }
+        }
+    }
+    return cost;
+}
+QueryPlan SearchServer::ExplainQuery(const string_view raw_query, QueryMode mode) const {
+    return PlanQuery(ParseQuery(raw_query), mode);
+}
+DocumentPage SearchServer::FindNextPage(const string_view raw_query, size_t page_size, const PageCursor& cursor, DocumentStatus status) const {
+    return SearchServer::FindNextPage(raw_query, page_size, cursor,
+                                      [status](int document_id, DocumentStatus document_status, int rating) {
+                                          return document_status == status;});
+}
+DocumentPage SearchServer::FindNextPage(const string_view raw_query, size_t page_size, const PageCursor& cursor) const {
+    return SearchServer::FindNextPage(raw_query, page_size, cursor, DocumentStatus::ACTUAL);
+}
 int SearchServer::GetDocumentCount() const {
     return static_cast<int>(documents_.size());
 }
+bool SearchServer::HasDocument(int document_id) const {
+    return documents_.count(document_id) > 0;
+}
+void SearchServer::CheckDocumentText(const string_view document) const {
+    ComputeTermFrequencies(document);
+}
+int SearchServer::GetDocumentRating(int document_id) const {
+    return documents_.at(document_id).rating;
+}
+DocumentStatus SearchServer::GetDocumentStatus(int document_id) const {
+    return documents_.at(document_id).status;
+}
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
-    //LOG_DURATION_STREAM("Operation time", std::cout);
     Query query = ParseQuery(raw_query);
     vector<string_view> matched_words;
     for (const string_view word : query.plus_words) {
@@ -82,20 +395,14 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
 bool SearchServer::IsStopWord(const string_view word) const {
     return stop_words_.count(word) > 0;
 }
-bool SearchServer::IsValidWord(const string_view word) {
-    // A valid word must not contain special characters
-    return none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-    });
-}
-vector<string> SearchServer::SplitIntoWordsNoStop(const string_view text) const {
-    vector<string> words;
+vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view text) const {
+    vector<string_view> words;
     for (const string_view word : SplitIntoWordsView(text)) {
         if (!IsValidWord(word)) {
             throw invalid_argument("there's spec symbs in words"s);
         }
         if (!IsStopWord(word)) {
-            words.push_back(string(word));
+            words.push_back(word);
         }
     }
     return words;
@@ -110,26 +417,35 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     }
     return rating_sum / static_cast<int>(ratings.size());
 }
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
-    if (text.empty()) {
-        throw invalid_argument("after minus there're no words"s);
-    }
-    bool is_minus = false;
-    if (text[0] == '-') {
-        is_minus = true;
-        text = text.substr(1);
-    }
-    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
-        throw invalid_argument("after minus there're no words"s);
-    }
-
-    return QueryWord{text, is_minus, IsStopWord(text)};
-}
 SearchServer::Query SearchServer::ParseQuery(const string_view text) const {
+    PROFILE_STAGE(Stage::PARSE);
     Query query;
     for (const string_view word : SplitIntoWordsView(text)) {
         const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
+        const string_view data = query_word.data;
+        const bool has_distance = data.size() > 2 && data[data.size() - 2] == '~' && isdigit(static_cast<unsigned char>(data.back()));
+        // without the fuzzy index '~' is a part of the word like before
+        if (fuzzy_index_ && (has_distance || (data.size() > 1 && data.back() == '~'))) {
+            const size_t max_distance = has_distance ? static_cast<size_t>(data.back() - '0') : fuzzy_index_->GetMaxDistance();
+            if (max_distance > fuzzy_index_->GetMaxDistance()) {
+                throw invalid_argument("fuzzy distance is above the one of the index"s);
+            }
+            const auto matches = FindSimilarWords(data.substr(0, data.size() - (has_distance ? 2 : 1)), max_distance);
+            for (size_t i = 0; i < matches.size(); ++i) {
+                if (!query_word.is_minus && (i == MAX_FUZZY_EXPANSIONS || matches[i].distance > matches[0].distance)) {
+                    break;
+                }
+                (query_word.is_minus ? query.minus_words : query.plus_words).insert(matches[i].word);
+            }
+        } else if (query_word.data.size() > 1 && query_word.data.back() == '*') {
+            // always a prefix term, see MAX_PREFIX_EXPANSIONS
+            const string_view prefix = query_word.data.substr(0, query_word.data.size() - 1);
+            auto& words = query_word.is_minus ? query.minus_words : query.plus_words;
+            // every matching word has to exclude its documents, only plus words are capped
+            for (const string_view expanded_word : FindWordsByPrefix(prefix, query_word.is_minus ? numeric_limits<size_t>::max() : MAX_PREFIX_EXPANSIONS)) {
+                words.insert(expanded_word);
+            }
+        } else if (!IsStopWord(query_word.data)) {
             if (query_word.is_minus) {
                 query.minus_words.insert(query_word.data);
             } else {
@@ -142,6 +458,163 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text) const {
 double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
     return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
 }
+// ANY: words known to be useless are skipped, high frequency words of low impact are
+//      only probed for candidates of other words (exactness is checked on execution),
+//      dense accumulators are used when postings cover a large share of the id range
+// ALL: posting lists are intersected shortest first, words of every document are skipped
+QueryPlan SearchServer::PlanQuery(const Query& query, QueryMode mode) const {
+    QueryPlan plan;
+    plan.mode = mode;
+    const size_t document_count = documents_.size();
+    const auto make_statistics = [&](const string_view word, bool is_minus) {
+        TermStatistics term;
+        term.word = string(word);
+        term.is_minus = is_minus;
+        const auto it = word_to_document_freqs_.find(word);
+        if (it == word_to_document_freqs_.end() || it->second.empty()) {
+            term.is_skipped = true;
+            term.note = "not in index"s;
+            return term;
+        }
+        term.document_freq = it->second.size();
+        term.inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+        term.max_impact = word_to_max_freq_.at(word) * term.inverse_document_freq;
+        term.is_high_frequency = term.document_freq * 2 > document_count;
+        return term;
+    };
+    vector<TermStatistics> plus_terms;
+    for (const string_view word : query.plus_words) {
+        TermStatistics term = make_statistics(word, false);
+        if (!term.is_skipped && query.minus_words.count(word) > 0) {
+            term.is_skipped = true;
+            term.note = "is minus word too"s;
+        }
+        plus_terms.push_back(move(term));
+    }
+    vector<TermStatistics> minus_terms;
+    for (const string_view word : query.minus_words) {
+        minus_terms.push_back(make_statistics(word, true));
+    }
+    const auto is_active = [](const TermStatistics& term) {
+        return !term.is_skipped;
+    };
+    const size_t active_count = count_if(plus_terms.begin(), plus_terms.end(), is_active);
+
+    if (mode == QueryMode::ALL) {
+        // any missing word or a word which is minus too leaves nothing to intersect
+        if (plus_terms.empty() || active_count < plus_terms.size()) {
+            plan.strategy = QueryStrategy::EMPTY;
+        } else {
+            plan.strategy = QueryStrategy::DOCUMENT_AT_A_TIME;
+            sort(plus_terms.begin(), plus_terms.end(), [](const TermStatistics& lhs, const TermStatistics& rhs) {
+                return lhs.document_freq < rhs.document_freq;
+            });
+            // idf of such word is zero, it neither filters nor scores; the shortest list is always kept
+            for (size_t i = 1; i < plus_terms.size(); ++i) {
+                if (plus_terms[i].document_freq == document_count) {
+                    plus_terms[i].is_skipped = true;
+                    plus_terms[i].note = "in every document"s;
+                }
+            }
+        }
+    } else if (active_count == 0) {
+        plan.strategy = QueryStrategy::EMPTY;
+    } else {
+        plan.strategy = QueryStrategy::TERM_AT_A_TIME;
+        double strongest_impact = 0.0;
+        for (const TermStatistics& term : plus_terms) {
+            if (is_active(term)) {
+                strongest_impact = max(strongest_impact, term.max_impact);
+            }
+        }
+        vector<TermStatistics*> by_impact;
+        for (TermStatistics& term : plus_terms) {
+            if (is_active(term)) {
+                by_impact.push_back(&term);
+            }
+        }
+        sort(by_impact.begin(), by_impact.end(), [](const TermStatistics* lhs, const TermStatistics* rhs) {
+            return lhs->max_impact < rhs->max_impact;
+        });
+        // weakest high frequency words are skipped while together they stay well below the strongest word
+        for (size_t i = 0; i + 1 < by_impact.size(); ++i) {
+            TermStatistics& term = *by_impact[i];
+            if (!term.is_high_frequency || (plan.skipped_impact_bound + term.max_impact) * 2 >= strongest_impact) {
+                break;
+            }
+            term.is_skipped = true;
+            term.note = "probed for candidates only"s;
+            plan.probes_skipped_words = true;
+            plan.skipped_impact_bound += term.max_impact;
+        }
+        if (!plan.probes_skipped_words) {
+            size_t plus_postings = 0;
+            for (const TermStatistics& term : plus_terms) {
+                plus_postings += is_active(term) ? term.document_freq : 0;
+            }
+            const size_t id_count = static_cast<size_t>(documents_.rbegin()->first - documents_.begin()->first) + 1;
+            const size_t max_dense_ids = size_t(1) << 24;
+            if (id_count <= max_dense_ids && plus_postings * 4 >= id_count) {
+                plan.strategy = QueryStrategy::DENSE_ACCUMULATOR;
+            }
+        }
+    }
+    for (const auto* terms : {&plus_terms, &minus_terms}) {
+        for (const TermStatistics& term : *terms) {
+            if (!term.is_skipped) {
+                plan.estimated_postings += term.document_freq;
+            }
+        }
+    }
+    if (plan.strategy == QueryStrategy::EMPTY) {
+        plan.estimated_postings = 0;
+    }
+    plan.terms = move(plus_terms);
+    move(minus_terms.begin(), minus_terms.end(), back_inserter(plan.terms));
+    return plan;
+}
+SearchServer::Query SearchServer::PruneQuery(const Query& query, const QueryPlan& plan) {
+    Query pruned = query;
+    for (const TermStatistics& term : plan.terms) {
+        if (!term.is_minus && term.is_skipped) {
+            pruned.plus_words.erase(term.word);
+        }
+    }
+    return pruned;
+}
+SearchServer::PostingIterator SearchServer::SeekPosting(const map<int, double>& postings, PostingIterator it, int document_id) {
+    const int linear_steps = 8;
+    for (int step = 0; step < linear_steps; ++step, ++it) {
+        if (it == postings.end() || it->first >= document_id) {
+            return it;
+        }
+    }
+    return postings.lower_bound(document_id);
+}
+// work is estimated as the number of postings to walk:
+// short queries stay sequential, one huge list is split by documents,
+// many long lists are walked in parallel by words
+ExecutionMode SearchServer::ChooseExecutionMode(const Query& query) const {
+    const ExecutionThresholds thresholds = GetExecutionThresholds();
+    size_t total_postings = 0;
+    size_t longest_postings = 0;
+    for (const auto* words : {&query.plus_words, &query.minus_words}) {
+        for (const string_view word : *words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it != word_to_document_freqs_.end()) {
+                total_postings += it->second.size();
+                longest_postings = max(longest_postings, it->second.size());
+            }
+        }
+    }
+    if (longest_postings >= thresholds.sharded_min_postings) {
+        return ExecutionMode::SHARDED;
+    }
+    if (query.plus_words.size() > 1 && total_postings >= thresholds.parallel_terms_min_postings) {
+        return ExecutionMode::PARALLEL_TERMS;
+    }
+    return ExecutionMode::SEQUENTIAL;
+}
 std::set<int>::const_iterator SearchServer::begin() const {
     return document_ids_.begin();
 }
@@ -168,9 +641,15 @@ const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id
 //                                n - num of docs on server
 void SearchServer::RemoveDocument(int document_id){
     if (doc_to_word_freq.count(document_id) != 0){
+        const DocumentStatus status = documents_.at(document_id).status;
+        const bool has_head_terms = !head_term_cache_.IsEmpty();
         for (const auto& [word, word_freq]: doc_to_word_freq.at(document_id)){
             word_to_document_freqs_.at(word).erase(document_id);
+            if (has_head_terms) {
+                head_term_cache_.RemovePosting(word, status, document_id);
+            }
         }
+        total_document_length_ -= documents_.at(document_id).length;
         doc_to_word_freq.erase(document_id);
         documents_.erase(document_id);
         document_ids_.erase(document_id);
@@ -179,6 +658,14 @@ void SearchServer::RemoveDocument(int document_id){
 void SearchServer::RemoveDocument(const execution::sequenced_policy&, int document_id) {
     RemoveDocument(document_id);
 }
+void SearchServer::RemoveDocument(const AdaptivePolicy&, int document_id) {
+    const auto it = doc_to_word_freq.find(document_id);
+    if (it != doc_to_word_freq.end() && it->second.size() >= GetExecutionThresholds().parallel_remove_min_words) {
+        RemoveDocument(execution::par, document_id);
+    } else {
+        RemoveDocument(document_id);
+    }
+}
 void SearchServer::RemoveDocument(const execution::parallel_policy&, int document_id) {
     if (doc_to_word_freq.count(document_id) != 0){
         vector<string_view> words_;
@@ -192,8 +679,197 @@ void SearchServer::RemoveDocument(const execution::parallel_policy&, int documen
                  [&](const auto& w_){
                      word_to_document_freqs_.at(w_).erase(document_id);
                  });
+        if (!head_term_cache_.IsEmpty()) {
+            const DocumentStatus status = documents_.at(document_id).status;
+            for (const string_view word : words_) {
+                head_term_cache_.RemovePosting(word, status, document_id);
+            }
+        }
+        total_document_length_ -= documents_.at(document_id).length;
         doc_to_word_freq.erase(document_id);
         documents_.erase(document_id);
         document_ids_.erase(document_id);
     }
-}
\ No newline at end of file
+}
+RemovalStatistics SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    return RemoveDocuments(execution::seq, document_ids);
+}
+RemovalStatistics SearchServer::RemoveDocuments(const execution::sequenced_policy&, const vector<int>& document_ids) {
+    auto [removed_ids, removals] = GroupRemovals(document_ids);
+    for_each(removals.begin(), removals.end(), CompactPostings);
+    return FinishRemoval(removed_ids, removals);
+}
+// lists are distinct maps, so they are compacted in parallel without locks
+RemovalStatistics SearchServer::RemoveDocuments(const execution::parallel_policy&, const vector<int>& document_ids) {
+    auto [removed_ids, removals] = GroupRemovals(document_ids);
+    for_each(execution::par, removals.begin(), removals.end(), CompactPostings);
+    return FinishRemoval(removed_ids, removals);
+}
+pair<vector<int>, vector<SearchServer::PostingRemoval>> SearchServer::GroupRemovals(const vector<int>& document_ids) {
+    vector<int> removed_ids;
+    for (const int document_id : document_ids) {
+        if (documents_.count(document_id) != 0) {
+            removed_ids.push_back(document_id);
+        }
+    }
+    sort(removed_ids.begin(), removed_ids.end());
+    removed_ids.erase(unique(removed_ids.begin(), removed_ids.end()), removed_ids.end());
+    vector<PostingRemoval> removals;
+    unordered_map<string_view, size_t> word_to_removal;
+    for (const int document_id : removed_ids) {
+        for (const auto& [word, _] : doc_to_word_freq.at(document_id)) {
+            const auto [it, is_new_word] = word_to_removal.emplace(word, removals.size());
+            if (is_new_word) {
+                removals.push_back({word_to_document_freqs_.find(word), {}});
+            }
+            removals[it->second].document_ids.push_back(document_id);
+        }
+    }
+    return {move(removed_ids), move(removals)};
+}
+// few removals are erased by key, many by one walk along the list
+void SearchServer::CompactPostings(PostingRemoval& removal) {
+    map<int, double>& postings = removal.word->second;
+    if (removal.document_ids.size() * 16 < postings.size()) {
+        for (const int document_id : removal.document_ids) {
+            postings.erase(document_id);
+        }
+        return;
+    }
+    auto posting = postings.begin();
+    for (const int document_id : removal.document_ids) {
+        while (posting->first < document_id) {
+            ++posting;
+        }
+        posting = postings.erase(posting);
+    }
+}
+// heap node of a std::map or std::set: three links and a color next to the value
+template <typename Value>
+static constexpr size_t GetTreeNodeBytes() {
+    return 4 * sizeof(void*) + sizeof(Value);
+}
+RemovalStatistics SearchServer::FinishRemoval(const vector<int>& document_ids, const vector<PostingRemoval>& removals) {
+    RemovalStatistics statistics;
+    statistics.removed_documents = document_ids.size();
+    for (const PostingRemoval& removal : removals) {
+        statistics.removed_postings += removal.document_ids.size();
+    }
+    statistics.reclaimed_bytes += statistics.removed_postings * GetTreeNodeBytes<pair<const int, double>>();
+    if (!head_term_cache_.IsEmpty()) {
+        head_term_cache_.RemoveDocuments(document_ids);
+    }
+    for (const int document_id : document_ids) {
+        const auto forward = doc_to_word_freq.find(document_id);
+        statistics.reclaimed_bytes += forward->second.size() * GetTreeNodeBytes<pair<const string_view, double>>()
+                                      + GetTreeNodeBytes<pair<const int, map<string_view, double>>>()
+                                      + GetTreeNodeBytes<pair<const int, DocumentData>>() + GetTreeNodeBytes<int>();
+        total_document_length_ -= documents_.at(document_id).length;
+        doc_to_word_freq.erase(forward);
+        documents_.erase(document_id);
+        document_ids_.erase(document_id);
+    }
+    // maps are keyed by views of vocab_, so its string goes last
+    for (const PostingRemoval& removal : removals) {
+        if (!removal.word->second.empty()) {
+            continue;
+        }
+        const auto text = vocab_.find(removal.word->first);
+        if (fuzzy_index_) {
+            fuzzy_index_->RemoveWord(*text);
+        }
+        word_to_max_freq_.erase(*text);
+        word_to_document_freqs_.erase(removal.word);
+        // short strings are stored inside the node
+        statistics.reclaimed_bytes += GetTreeNodeBytes<pair<const string_view, map<int, double>>>()
+                                      + GetTreeNodeBytes<pair<const string_view, double>>() + GetTreeNodeBytes<string>()
+                                      + (text->capacity() >= sizeof(string) ? text->capacity() + 1 : 0);
+        vocab_.erase(text);
+        ++statistics.erased_words;
+    }
+    if (statistics.erased_words > 0) {
+        atomic_store(&term_index_, shared_ptr<const TermIndex>());
+    }
+    return statistics;
+}
+CollectionStatistics SearchServer::GetCollectionStatistics() const {
+    CollectionStatistics statistics;
+    statistics.document_count = documents_.size();
+    if (!documents_.empty()) {
+        statistics.average_document_length = static_cast<double>(total_document_length_) / documents_.size();
+    }
+    return statistics;
+}
+// layout: magic, stop words, words of the vocabulary, then documents with their length
+// and (vocabulary index, term frequency) pairs; numbers are raw host-order values
+static const uint64_t SNAPSHOT_MAGIC = 0x31504e5353525653;  // "SVRSSNP1"
+void SearchServer::SaveSnapshot(ostream& output) const {
+    WriteBinary(output, SNAPSHOT_MAGIC);
+    WriteBinary(output, static_cast<uint32_t>(stop_words_.size()));
+    for (const string& word : stop_words_) {
+        WriteBinaryString(output, word);
+    }
+    map<string_view, uint32_t> word_to_index;
+    for (const auto& [word, postings] : word_to_document_freqs_) {
+        if (!postings.empty()) {
+            word_to_index.emplace(word, static_cast<uint32_t>(word_to_index.size()));
+        }
+    }
+    WriteBinary(output, static_cast<uint32_t>(word_to_index.size()));
+    for (const auto& [word, _] : word_to_index) {
+        WriteBinaryString(output, word);
+    }
+    WriteBinary(output, static_cast<uint32_t>(documents_.size()));
+    for (const auto& [document_id, document_data] : documents_) {
+        WriteBinary(output, document_id);
+        WriteBinary(output, static_cast<int32_t>(document_data.status));
+        WriteBinary(output, document_data.rating);
+        WriteBinary(output, document_data.length);
+        const auto& word_freqs = doc_to_word_freq.at(document_id);
+        WriteBinary(output, static_cast<uint32_t>(word_freqs.size()));
+        for (const auto& [word, term_freq] : word_freqs) {
+            WriteBinary(output, word_to_index.at(word));
+            WriteBinary(output, term_freq);
+        }
+    }
+    if (!output) {
+        throw runtime_error("can't write snapshot"s);
+    }
+}
+void SearchServer::LoadSnapshot(istream& input) {
+    if (!documents_.empty()) {
+        throw invalid_argument("snapshot can be loaded into an empty server only"s);
+    }
+    if (ReadBinary<uint64_t>(input) != SNAPSHOT_MAGIC) {
+        throw runtime_error("snapshot is corrupted"s);
+    }
+    set<string, less<>> stop_words;
+    for (uint32_t count = ReadBinary<uint32_t>(input); count > 0; --count) {
+        stop_words.insert(ReadBinaryString(input));
+    }
+    if (stop_words != stop_words_) {
+        throw invalid_argument("snapshot stop words differ"s);
+    }
+    vector<string> words(ReadBinary<uint32_t>(input));
+    for (string& word : words) {
+        word = ReadBinaryString(input);
+    }
+    for (uint32_t count = ReadBinary<uint32_t>(input); count > 0; --count) {
+        const int document_id = ReadBinary<int>(input);
+        const auto status = static_cast<DocumentStatus>(ReadBinary<int32_t>(input));
+        const int rating = ReadBinary<int>(input);
+        DocumentTerms terms;
+        terms.length = ReadBinary<uint32_t>(input);
+        auto& word_freqs = terms.word_freqs;
+        for (uint32_t word_count = ReadBinary<uint32_t>(input); word_count > 0; --word_count) {
+            const uint32_t index = ReadBinary<uint32_t>(input);
+            const double term_freq = ReadBinary<double>(input);
+            if (index >= words.size()) {
+                throw runtime_error("snapshot is corrupted"s);
+            }
+            word_freqs.emplace(words[index], term_freq);
+        }
+        CheckNewDocumentId(document_id);
+        IndexDocument(document_id, terms, status, rating);
+    }
+}
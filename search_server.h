@@ -8,11 +8,57 @@
 #include <algorithm>
 #include <cmath>
 #include <utility>
-#include "log_duration.h"
+#include "instrumentation.h"
 #include <execution>
 #include <iostream>
 #include "concurrent_map.h"
+#include "page_cursor.h"
+#include "adaptive_execution.h"
+#include "query_plan.h"
+#include "search_budget.h"
+#include "term_dictionary.h"
+#include "fuzzy_index.h"
+#include "head_term_cache.h"
+#include "scoring.h"
+#include "simd_kernels.h"
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <type_traits>
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
+// arguments of AddDocument for batch indexing
+struct DocumentInput {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+// result of SearchServer::RemoveDocuments
+struct RemovalStatistics {
+    size_t removed_documents = 0;
+    size_t removed_postings = 0;
+    // words left without postings, erased from the index with their text
+    size_t erased_words = 0;
+    // estimated from node sizes of the containers
+    size_t reclaimed_bytes = 0;
+};
+// counts of documents matching a query, see SearchServer::FindTopDocumentsWithFacets
+struct FacetCounts {
+    size_t total_matches = 0;
+    // indexed by DocumentStatus
+    std::array<size_t, 4> by_status{};
+    // lowest rating of a bucket -> documents
+    std::map<int, size_t> by_rating;
+};
+struct FacetedResult {
+    std::vector<Document> documents;
+    FacetCounts facets;
+};
 class SearchServer {
 public:
     // Defines an invalid document id
@@ -29,37 +75,23 @@ public:
     explicit SearchServer(const std::string_view stop_words_text);
     //void AddDocument(int document_id, const std::string& document, DocumentStatus status, const std::vector<int>& ratings);
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // all documents are checked before the index is touched, so a failed batch adds nothing;
+    // parallel version splits texts in parallel and merges them into the index sequentially
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+    void AddDocuments(const std::execution::sequenced_policy&, const std::vector<DocumentInput>& documents);
+    void AddDocuments(const std::execution::parallel_policy&, const std::vector<DocumentInput>& documents);
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
-        //LOG_DURATION_STREAM("Operation time", std::cout);
         Query query = ParseQuery(raw_query);
         auto matched_documents = FindAllDocuments(query, document_predicate);
-        sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
+        SelectTopDocuments(std::execution::seq, matched_documents);
         return matched_documents;
     }
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentPredicate document_predicate) const {
         Query query = ParseQuery(raw_query);
         auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
-        sort(std::execution::par, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
+        SelectTopDocuments(std::execution::par, matched_documents);
         return matched_documents;
     }
     template <typename DocumentPredicate>
@@ -67,6 +99,8 @@ public:
         return FindTopDocuments(raw_query,document_predicate);
     }
 
+    // single word queries of frequent words (HEAD_TERM_MIN_DOCUMENTS postings at least) are
+    // answered from precomputed best postings kept up to date by indexing and removal
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentStatus status) const;
@@ -75,7 +109,221 @@ public:
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query) const;
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query) const;
 
+    // execution mode is chosen by posting list lengths of the query words, see adaptive_execution.h
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const AdaptivePolicy&, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+        const Query query = ParseQuery(raw_query);
+        return FindTopDocumentsInMode(ChooseExecutionMode(query), query, document_predicate);
+    }
+    std::vector<Document> FindTopDocuments(const AdaptivePolicy&, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const AdaptivePolicy&, const std::string_view raw_query) const;
+    // forced execution mode, for calibration and benchmarks
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionMode mode, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+        return FindTopDocumentsInMode(mode, ParseQuery(raw_query), document_predicate);
+    }
+    std::vector<Document> FindTopDocuments(ExecutionMode mode, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(ExecutionMode mode, const std::string_view raw_query) const;
+
+    // returns page_size documents going strictly after the cursor
+    // posting lists are merged document at a time, so only page_size + 1 candidates are kept
+    // in memory whatever the number of matches, no full sort of matches
+    template <typename DocumentPredicate>
+    DocumentPage FindNextPage(const std::string_view raw_query, size_t page_size, const PageCursor& cursor, DocumentPredicate document_predicate) const {
+        if (page_size == 0) {
+            throw std::invalid_argument("page size must be positive");
+        }
+        const Query query = ParseQuery(raw_query);
+        const CollectionStatistics statistics = GetCollectionStatistics();
+        const TfIdfScorer scorer;
+        struct PostingCursor {
+            std::map<int, double>::const_iterator it;
+            std::map<int, double>::const_iterator end;
+            double term_weight;
+        };
+        // in query order, relevance is summed like in ComputeDocumentRelevance
+        std::vector<PostingCursor> plus_postings;
+        std::vector<PostingCursor> minus_postings;
+        for (const std::string_view word : query.plus_words) {
+            if (const auto it = word_to_document_freqs_.find(word); it != word_to_document_freqs_.end()) {
+                plus_postings.push_back({it->second.begin(), it->second.end(), scorer.GetTermWeight(statistics, it->second.size())});
+            }
+        }
+        for (const std::string_view word : query.minus_words) {
+            if (const auto it = word_to_document_freqs_.find(word); it != word_to_document_freqs_.end()) {
+                minus_postings.push_back({it->second.begin(), it->second.end(), 0.0});
+            }
+        }
+        // top of the heap is the worst of kept candidates
+        std::priority_queue<Document, std::vector<Document>, decltype(&IsRankedBefore)> candidates(&IsRankedBefore);
+        while (true) {
+            int document_id = INT_MAX;
+            bool has_postings = false;
+            for (const PostingCursor& postings : plus_postings) {
+                if (postings.it != postings.end && postings.it->first <= document_id) {
+                    document_id = postings.it->first;
+                    has_postings = true;
+                }
+            }
+            if (!has_postings) {
+                break;
+            }
+            const auto& document_data = documents_.at(document_id);
+            const double document_norm = scorer.GetDocumentNorm(statistics, document_data.length);
+            double relevance = 0.0;
+            for (PostingCursor& postings : plus_postings) {
+                if (postings.it != postings.end && postings.it->first == document_id) {
+                    relevance += scorer.Score(postings.it->second, document_data.length, document_norm, postings.term_weight);
+                    ++postings.it;
+                }
+            }
+            bool is_excluded = false;
+            for (PostingCursor& postings : minus_postings) {
+                while (postings.it != postings.end && postings.it->first < document_id) {
+                    ++postings.it;
+                }
+                is_excluded = is_excluded || (postings.it != postings.end && postings.it->first == document_id);
+            }
+            if (is_excluded || !document_predicate(document_id, document_data.status, document_data.rating)) {
+                continue;
+            }
+            const Document document(document_id, relevance, document_data.rating);
+            if (!IsAfterCursor(cursor, document)) {
+                continue;
+            }
+            if (candidates.size() <= page_size) {
+                candidates.push(document);
+            } else if (IsRankedBefore(document, candidates.top())) {
+                candidates.pop();
+                candidates.push(document);
+            }
+        }
+        DocumentPage page;
+        if (candidates.size() > page_size) {
+            page.has_more = true;
+            candidates.pop();
+        }
+        page.documents.resize(candidates.size());
+        for (auto it = page.documents.rbegin(); it != page.documents.rend(); ++it) {
+            *it = candidates.top();
+            candidates.pop();
+        }
+        page.next = page.documents.empty() ? cursor : PageCursor(page.documents.back());
+        return page;
+    }
+    DocumentPage FindNextPage(const std::string_view raw_query, size_t page_size, const PageCursor& cursor, DocumentStatus status) const;
+    DocumentPage FindNextPage(const std::string_view raw_query, size_t page_size, const PageCursor& cursor = PageCursor()) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(QueryMode mode, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+        const Query query = ParseQuery(raw_query);
+        auto matched_documents = ExecutePlan(query, PlanQuery(query, mode), document_predicate);
+        SelectTopDocuments(std::execution::seq, matched_documents);
+        return matched_documents;
+    }
+    std::vector<Document> FindTopDocuments(QueryMode mode, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(QueryMode mode, const std::string_view raw_query) const;
+    // stops walking postings when the budget is spent and returns the best documents found so far,
+    // words are walked from the largest possible contribution down
+    template <typename DocumentPredicate>
+    PartialResult FindTopDocuments(const std::string_view raw_query, const SearchBudget& budget, DocumentPredicate document_predicate) const {
+        return FindTopDocumentsWithinBudget(ParseQuery(raw_query), budget, document_predicate);
+    }
+    PartialResult FindTopDocuments(const std::string_view raw_query, const SearchBudget& budget, DocumentStatus status) const;
+    PartialResult FindTopDocuments(const std::string_view raw_query, const SearchBudget& budget) const;
+    // queries are evaluated together: a posting list shared by several queries is walked once
+    // per group of queries in blocks, and every block is scattered to accumulators of all queries
+    // of the group using the word; relevance of every result is the one FindTopDocuments gives,
+    // only documents tied exactly may come in another order
+    template <typename DocumentPredicate>
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentPredicate document_predicate) const {
+        return EvaluateQueryBatch(1, raw_queries, document_predicate);
+    }
+    // groups of queries are evaluated in parallel, accumulator memory is split between them
+    template <typename DocumentPredicate>
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::execution::parallel_policy&, const std::vector<std::string>& raw_queries, DocumentPredicate document_predicate) const {
+        return EvaluateQueryBatch(std::max(1u, std::thread::hardware_concurrency()), raw_queries, document_predicate);
+    }
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentStatus status) const;
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries) const;
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::execution::parallel_policy&, const std::vector<std::string>& raw_queries, DocumentStatus status) const;
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::execution::parallel_policy&, const std::vector<std::string>& raw_queries) const;
+    // top documents accepted by the predicate together with counts of all documents matching
+    // the words of the query whatever the predicate: in total, by status and by rating in buckets
+    // of rating_bucket_width; counted in the walk which scores, the parallel version walks
+    // ranges of documents in parallel and merges their counts
+    template <typename DocumentPredicate>
+    FacetedResult FindTopDocumentsWithFacets(const std::string_view raw_query, DocumentPredicate document_predicate, int rating_bucket_width = 1) const {
+        return FindWithFacets(ParseQuery(raw_query), document_predicate, rating_bucket_width, 1);
+    }
+    template <typename DocumentPredicate>
+    FacetedResult FindTopDocumentsWithFacets(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentPredicate document_predicate, int rating_bucket_width = 1) const {
+        const size_t shard_count = std::max(1u, std::thread::hardware_concurrency()) * 4;
+        return FindWithFacets(ParseQuery(raw_query), document_predicate, rating_bucket_width, shard_count);
+    }
+    FacetedResult FindTopDocumentsWithFacets(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, int rating_bucket_width = 1) const;
+    FacetedResult FindTopDocumentsWithFacets(const std::execution::parallel_policy&, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, int rating_bucket_width = 1) const;
+    // relevance by the scorer of the policy (see scoring.h), evaluated by the planned engines
+    // of the other overloads; TF_IDF_SCORING is the relevance of the other overloads and
+    // takes their path, the head term cache included
+    template <typename Scorer, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const ScoringPolicy<Scorer>& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+        const Query query = ParseQuery(raw_query);
+        auto matched_documents = FindAllDocuments(query, document_predicate, policy.scorer);
+        SelectTopDocuments(std::execution::seq, matched_documents);
+        return matched_documents;
+    }
+    template <typename Scorer>
+    std::vector<Document> FindTopDocuments(const ScoringPolicy<Scorer>& policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const {
+        if constexpr (std::is_same_v<Scorer, TfIdfScorer>) {
+            return FindTopDocuments(raw_query, status);
+        } else {
+            return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+                return document_status == status;
+            });
+        }
+    }
+    template <typename Scorer, typename DocumentPredicate>
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const ScoringPolicy<Scorer>& policy, const std::vector<std::string>& raw_queries, DocumentPredicate document_predicate) const {
+        return EvaluateQueryBatch(1, raw_queries, document_predicate, policy.scorer);
+    }
+    template <typename Scorer, typename DocumentPredicate>
+    FacetedResult FindTopDocumentsWithFacets(const ScoringPolicy<Scorer>& policy, const std::string_view raw_query, DocumentPredicate document_predicate, int rating_bucket_width = 1) const {
+        return FindWithFacets(ParseQuery(raw_query), document_predicate, rating_bucket_width, 1, policy.scorer);
+    }
+    CollectionStatistics GetCollectionStatistics() const;
+    // `word*` in a query stands for indexed words starting with word: plus terms expand to
+    // this many words of the largest document frequency, minus terms to all of them.
+    // Unlike '~', a trailing '*' is not gated by an option: it always makes a prefix term,
+    // so an indexed word ending in '*' can no longer be searched for as it is
+    // (before prefix terms such a query word matched it literally)
+    inline static constexpr size_t MAX_PREFIX_EXPANSIONS = 64;
+    // indexed words starting with prefix, at most max_words of them, more frequent first
+    // and in lexical order among equally frequent
+    std::vector<std::string_view> FindWordsByPrefix(const std::string_view prefix, size_t max_words = MAX_PREFIX_EXPANSIONS) const;
+    // `word~` and `word~N` in a query stand for indexed words within edit distance N
+    // (the distance of the fuzzy index by default): plus terms expand to the nearest ones,
+    // at most this many of the largest document frequency, minus terms to all of them.
+    // Without EnableFuzzyMatching such terms are plain words
+    inline static constexpr size_t MAX_FUZZY_EXPANSIONS = 8;
+    inline static constexpr size_t HEAD_TERM_MIN_DOCUMENTS = 1024;
+    // builds the deletion index of the vocabulary, indexing keeps it up to date afterwards;
+    // see FuzzyIndex for the arguments
+    void EnableFuzzyMatching(size_t max_distance = 1, size_t prefix_length = 7);
+    // indexed words within max_distance of word, nearest first, then more frequent first
+    std::vector<FuzzyIndex::Match> FindSimilarWords(const std::string_view word, size_t max_distance) const;
+    // postings a full walk of the query touches, used as a cost for admission control
+    size_t EstimateQueryCost(const std::string_view raw_query) const;
+    // plan which sequential FindTopDocuments would run for the query, print it with operator<<
+    QueryPlan ExplainQuery(const std::string_view raw_query, QueryMode mode = QueryMode::ANY) const;
+
     int GetDocumentCount() const;
+    bool HasDocument(int document_id) const;
+    // throws invalid_argument if AddDocument would reject the text, nothing is changed
+    void CheckDocumentText(const std::string_view document) const;
+    // document has to exist
+    int GetDocumentRating(int document_id) const;
+    DocumentStatus GetDocumentStatus(int document_id) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const;
@@ -87,20 +335,78 @@ public:
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
+    // parallel removal is used for documents with large forward index only
+    void RemoveDocument(const AdaptivePolicy&, int document_id);
+    // unknown ids are ignored; removals are grouped by word, so every posting list is walked
+    // once for all its removed documents (lists in parallel for the parallel version), and
+    // words left without postings are erased, unlike with RemoveDocument
+    RemovalStatistics RemoveDocuments(const std::vector<int>& document_ids);
+    RemovalStatistics RemoveDocuments(const std::execution::sequenced_policy&, const std::vector<int>& document_ids);
+    RemovalStatistics RemoveDocuments(const std::execution::parallel_policy&, const std::vector<int>& document_ids);
+
+    // binary image of stop words, documents and term frequencies, loading restores
+    // relevance bit for bit; it can only be loaded into an empty server with the same stop words
+    void SaveSnapshot(std::ostream& output) const;
+    void LoadSnapshot(std::istream& input);
+
+    // relevances closer than this are equal and ranked by rating
+    inline static constexpr double RELEVANCE_TOLERANCE = 1e-6;
+    // ranking of FindTopDocuments, shared by indexes derived from SearchServer (frozen_index.h)
+    template <typename ExecutionPolicy>
+    static void SelectTopDocuments(ExecutionPolicy&& policy, std::vector<Document>& matched_documents) {
+        PROFILE_STAGE(Stage::TOP_K);
+        sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
+            if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_TOLERANCE) {
+                return lhs.rating > rhs.rating;
+            } else {
+                return lhs.relevance > rhs.relevance;
+            }
+        });
+        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
+    }
 private:
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        // words without stop words
+        uint32_t length;
     };
     const std::set<std::string,std::less<>> stop_words_;
     std::set<std::string,std::less<>> vocab_;
     std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
     std::map<int,std::map<std::string_view, double>> doc_to_word_freq;
+    // upper bound of term frequency of the word, not lowered on removal
+    std::map<std::string_view, double> word_to_max_freq_;
     std::map<int, DocumentData> documents_;
     std::set<int> document_ids_;
+    uint64_t total_document_length_ = 0;
+    using WordPostings = std::pair<const std::string_view, std::map<int, double>>;
+    // dictionary of indexed words and their posting lists by term id; built by the first
+    // prefix search and dropped when a new word is indexed or RemoveDocuments erases words,
+    // RemoveDocument keeps it valid because emptied lists stay in the index and lists are read live
+    struct TermIndex {
+        TermDictionary dictionary;
+        std::vector<const WordPostings*> postings;
+    };
+    mutable std::shared_ptr<const TermIndex> term_index_;
+    std::optional<FuzzyIndex> fuzzy_index_;
+    // filled by head term queries, extra candidates let removals pass before a rebuild
+    mutable HeadTermCache head_term_cache_{4 * MAX_RESULT_DOCUMENT_COUNT, MAX_RESULT_DOCUMENT_COUNT};
+
+    // removed documents of one posting list, ids ascending
+    struct PostingRemoval {
+        std::map<std::string_view, std::map<int, double>>::iterator word;
+        std::vector<int> document_ids;
+    };
+    // known ids among document_ids, ascending, and their postings grouped by word
+    std::pair<std::vector<int>, std::vector<PostingRemoval>> GroupRemovals(const std::vector<int>& document_ids);
+    static void CompactPostings(PostingRemoval& removal);
+    // drops the documents and erases emptied words after the lists are compacted
+    RemovalStatistics FinishRemoval(const std::vector<int>& document_ids, const std::vector<PostingRemoval>& removals);
 
     bool IsStopWord(const std::string_view word) const;
-    static bool IsValidWord(const std::string_view word);
     // now here can pass as string as string_view
     template <typename StringContainer>
     static std::set<std::string,std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
@@ -115,38 +421,277 @@ private:
         }
         return non_empty_strings;
     }
-    std::vector<std::string> SplitIntoWordsNoStop(const std::string_view text) const;
-    static int ComputeAverageRating(const std::vector<int>& ratings);
-    struct QueryWord {
-        std::string_view data;
-        bool is_minus;
-        bool is_stop;
+    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    struct DocumentTerms {
+        // words point into text
+        std::map<std::string_view, double> word_freqs;
+        uint32_t length = 0;
     };
-    QueryWord ParseQueryWord(std::string_view text) const;
+    DocumentTerms ComputeTermFrequencies(const std::string_view text) const;
+    void CheckNewDocumentId(int document_id) const;
+    void IndexDocument(int document_id, const DocumentTerms& terms, DocumentStatus status, int rating);
+    static int ComputeAverageRating(const std::vector<int>& ratings);
     struct Query {
         std::set<std::string_view> plus_words;
         std::set<std::string_view> minus_words;
     };
     Query ParseQuery(const std::string_view text) const;
+    // nullopt if the query is not a single head term or the cached list can't prove
+    // its top with the current idf, the caller evaluates the query then
+    std::optional<std::vector<Document>> FindHeadTermTopDocuments(const Query& query, DocumentStatus status) const;
+    // const searches may build it concurrently, an index is never changed once published
+    std::shared_ptr<const TermIndex> GetTermIndex() const;
 
     // Existence required
     double ComputeWordInverseDocumentFreq(const std::string_view word) const;
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-        std::map<int, double> document_to_relevance;
+    ExecutionMode ChooseExecutionMode(const Query& query) const;
+    QueryPlan PlanQuery(const Query& query, QueryMode mode) const;
+    // query without plus words skipped by the plan
+    static Query PruneQuery(const Query& query, const QueryPlan& plan);
+    using PostingIterator = std::map<int, double>::const_iterator;
+    // first posting with id >= document_id starting from it:
+    // a few linear steps for dense lists, then logarithmic search in the tree
+    static PostingIterator SeekPosting(const std::map<int, double>& postings, PostingIterator it, int document_id);
+
+    // postings scattered to the queries of a group at once, 16 KiB of contributions
+    inline static constexpr size_t BATCH_BLOCK_SIZE = 1024;
+    // relevance and state arrays of all queries evaluated at the same time
+    inline static constexpr size_t BATCH_ACCUMULATOR_BYTES = size_t{64} << 20;
+    // documents by ordinal, shared by all query groups of a batch;
+    // lengths and norms are filled for scorers using document lengths only
+    struct BatchDocuments {
+        CollectionStatistics statistics;
+        std::vector<int> ids;
+        std::vector<int> ratings;
+        std::vector<uint8_t> is_accepted;
+        std::vector<uint32_t> lengths;
+        std::vector<double> norms;
+    };
+
+    static int GetRatingBucket(int rating, int bucket_width);
+    static void MergeFacetCounts(FacetCounts& target, const FacetCounts& source);
+
+    // every range of ids is walked by its own task with its own counts; a document is counted
+    // and tested by the predicate at its first posting. Accumulators are arrays over the id
+    // range when postings cover a large part of it, as in FindAllDocumentsDense, maps otherwise
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    FacetedResult FindWithFacets(const Query& query, DocumentPredicate document_predicate, int rating_bucket_width, size_t shard_count,
+                                 const Scorer& scorer = Scorer()) const {
+        using namespace std::string_literals;
+        if (rating_bucket_width <= 0) {
+            throw std::invalid_argument("rating bucket width has to be positive"s);
+        }
+        FacetedResult result;
+        if (documents_.empty()) {
+            return result;
+        }
+        enum : uint8_t { NOT_MATCHED, EXCLUDED, REJECTED, ACCEPTED };
+        const CollectionStatistics statistics = GetCollectionStatistics();
+        const int first_id = documents_.begin()->first;
+        const size_t id_count = static_cast<size_t>(documents_.rbegin()->first - first_id) + 1;
+        size_t plus_postings = 0;
         for (const std::string_view word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
+            const auto it = word_to_document_freqs_.find(word);
+            plus_postings += it == word_to_document_freqs_.end() ? 0 : it->second.size();
+        }
+        const bool is_dense = id_count <= (size_t(1) << 24) && plus_postings * 4 >= id_count;
+        shard_count = std::min(shard_count, id_count);
+        std::vector<FacetCounts> shard_facets(shard_count);
+        // dense accumulators are shared, shards write to their own ranges
+        std::vector<double> relevance(is_dense ? id_count : 0, 0.0);
+        std::vector<uint8_t> state(is_dense ? id_count : 0, NOT_MATCHED);
+        // length and norm of a document are kept from its first posting
+        const bool keeps_lengths = is_dense && Scorer::USES_DOCUMENT_LENGTH;
+        std::vector<uint32_t> lengths(keeps_lengths ? id_count : 0);
+        std::vector<double> norms(keeps_lengths ? id_count : 0);
+        struct Accumulator {
+            double relevance = 0.0;
+            uint8_t state = NOT_MATCHED;
+            uint32_t length = 0;
+            double norm = 0.0;
+        };
+        struct AccumulatorRef {
+            double& relevance;
+            uint8_t& state;
+            uint32_t* length;
+            double* norm;
+        };
+        std::vector<std::map<int, Accumulator>> shard_accumulators(is_dense ? 0 : shard_count);
+        const auto walk_shard = [&](size_t shard) {
+            const int shard_begin = first_id + static_cast<int>(id_count * shard / shard_count);
+            const size_t shard_end = id_count * (shard + 1) / shard_count;
+            const auto get_range = [&](const std::map<int, double>& postings) {
+                return std::pair{postings.lower_bound(shard_begin),
+                                 shard_end < id_count ? postings.lower_bound(first_id + static_cast<int>(shard_end)) : postings.end()};
+            };
+            const auto get_accumulator = [&](int document_id) -> AccumulatorRef {
+                if (is_dense) {
+                    const size_t index = static_cast<size_t>(document_id - first_id);
+                    if (keeps_lengths) {
+                        return {relevance[index], state[index], &lengths[index], &norms[index]};
+                    }
+                    return {relevance[index], state[index], nullptr, nullptr};
+                }
+                Accumulator& accumulator = shard_accumulators[shard][document_id];
+                return {accumulator.relevance, accumulator.state, &accumulator.length, &accumulator.norm};
+            };
+            for (const std::string_view word : query.minus_words) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    continue;
+                }
+                const auto [begin, end] = get_range(it->second);
+                for (auto posting = begin; posting != end; ++posting) {
+                    get_accumulator(posting->first).state = EXCLUDED;
+                }
             }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id] += term_freq * inverse_document_freq;
+            FacetCounts& facets = shard_facets[shard];
+            for (const std::string_view word : query.plus_words) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    continue;
+                }
+                const double term_weight = scorer.GetTermWeight(statistics, it->second.size());
+                const auto [begin, end] = get_range(it->second);
+                for (auto posting = begin; posting != end; ++posting) {
+                    const AccumulatorRef accumulator = get_accumulator(posting->first);
+                    if (accumulator.state == NOT_MATCHED) {
+                        const DocumentData& data = documents_.at(posting->first);
+                        ++facets.total_matches;
+                        ++facets.by_status[static_cast<size_t>(data.status)];
+                        ++facets.by_rating[GetRatingBucket(data.rating, rating_bucket_width)];
+                        accumulator.state = document_predicate(posting->first, data.status, data.rating) ? ACCEPTED : REJECTED;
+                        if constexpr (Scorer::USES_DOCUMENT_LENGTH) {
+                            *accumulator.length = data.length;
+                            *accumulator.norm = scorer.GetDocumentNorm(statistics, data.length);
+                        }
+                    }
+                    if (accumulator.state == ACCEPTED) {
+                        if constexpr (Scorer::USES_DOCUMENT_LENGTH) {
+                            accumulator.relevance += scorer.Score(posting->second, *accumulator.length, *accumulator.norm, term_weight);
+                        } else {
+                            accumulator.relevance += scorer.Score(posting->second, 0, 0.0, term_weight);
+                        }
+                    }
                 }
             }
+        };
+        {
+            PROFILE_STAGE(Stage::POSTING_WALK);
+            if (shard_count == 1) {
+                walk_shard(0);
+            } else {
+                std::vector<size_t> shards(shard_count);
+                std::iota(shards.begin(), shards.end(), 0);
+                std::for_each(std::execution::par, shards.begin(), shards.end(), walk_shard);
+            }
         }
-
+        PROFILE_STAGE(Stage::MATERIALIZE);
+        for (const FacetCounts& facets : shard_facets) {
+            MergeFacetCounts(result.facets, facets);
+        }
+        if (is_dense) {
+            for (const uint32_t index : SelectTopCandidates(relevance.data(), state.data(), ACCEPTED, id_count,
+                                                            MAX_RESULT_DOCUMENT_COUNT, RELEVANCE_TOLERANCE)) {
+                const int document_id = first_id + static_cast<int>(index);
+                result.documents.push_back({document_id, relevance[index], documents_.at(document_id).rating});
+            }
+        } else {
+            for (const auto& accumulators : shard_accumulators) {
+                for (const auto& [document_id, accumulator] : accumulators) {
+                    if (accumulator.state == ACCEPTED) {
+                        result.documents.push_back({document_id, accumulator.relevance, documents_.at(document_id).rating});
+                    }
+                }
+            }
+        }
+        SelectTopDocuments(std::execution::seq, result.documents);
+        return result;
+    }
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsInMode(ExecutionMode mode, const Query& query, DocumentPredicate document_predicate) const {
+        std::vector<Document> matched_documents;
+        switch (mode) {
+            case ExecutionMode::SEQUENTIAL:
+                matched_documents = FindAllDocuments(query, document_predicate);
+                SelectTopDocuments(std::execution::seq, matched_documents);
+                break;
+            case ExecutionMode::PARALLEL_TERMS:
+                matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
+                SelectTopDocuments(std::execution::par, matched_documents);
+                break;
+            case ExecutionMode::SHARDED:
+                matched_documents = FindAllDocumentsSharded(query, document_predicate);
+                SelectTopDocuments(std::execution::par, matched_documents);
+                break;
+        }
+        return matched_documents;
+    }
+    // result is only guaranteed to contain top MAX_RESULT_DOCUMENT_COUNT documents,
+    // plans skipping words return candidates for the top only
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate, const Scorer& scorer = Scorer()) const {
+        return ExecutePlan(query, PlanQuery(query, QueryMode::ANY), document_predicate, scorer);
+    }
+    // plans are made for tf-idf: words in every document are skipped by ALL plans as they
+    // score nothing, other scorers keep them
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    std::vector<Document> ExecutePlan(const Query& query, const QueryPlan& plan, DocumentPredicate document_predicate, const Scorer& scorer = Scorer()) const {
+        switch (plan.strategy) {
+            case QueryStrategy::EMPTY:
+                return {};
+            case QueryStrategy::DOCUMENT_AT_A_TIME:
+                if constexpr (std::is_same_v<Scorer, TfIdfScorer>) {
+                    return FindAllDocumentsConjunctive(PruneQuery(query, plan), document_predicate, scorer);
+                } else {
+                    return FindAllDocumentsConjunctive(query, document_predicate, scorer);
+                }
+            case QueryStrategy::DENSE_ACCUMULATOR:
+                return FindAllDocumentsDense(query, document_predicate, scorer);
+            case QueryStrategy::TERM_AT_A_TIME:
+                break;
+        }
+        if (plan.probes_skipped_words) {
+            if (auto candidates = FindTopCandidates(query, plan, document_predicate, scorer)) {
+                return std::move(*candidates);
+            }
+        }
+        const auto document_to_relevance = ComputeDocumentRelevance(query, document_predicate, scorer);
+        PROFILE_STAGE(Stage::MATERIALIZE);
+        std::vector<Document> matched_documents;
+        for (const auto [document_id, relevance] : document_to_relevance) {
+            matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+        }
+        return matched_documents;
+    }
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    std::map<int, double> ComputeDocumentRelevance(const Query& query, DocumentPredicate document_predicate, const Scorer& scorer = Scorer()) const {
+        const CollectionStatistics statistics = GetCollectionStatistics();
+        std::map<int, double> document_to_relevance;
+        {
+            // accumulation into the map is fused with the walk here
+            PROFILE_STAGE(Stage::POSTING_WALK);
+            for (const std::string_view word : query.plus_words) {
+                if (word_to_document_freqs_.count(word) == 0) {
+                    continue;
+                }
+                const auto& postings = word_to_document_freqs_.at(word);
+                const double term_weight = scorer.GetTermWeight(statistics, postings.size());
+                PROFILE_ITEMS(Stage::POSTING_WALK, postings.size());
+                for (const auto [document_id, term_freq] : postings) {
+                    const auto& document_data = documents_.at(document_id);
+                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                        if constexpr (Scorer::USES_DOCUMENT_LENGTH) {
+                            document_to_relevance[document_id] += scorer.Score(term_freq, document_data.length,
+                                                                               scorer.GetDocumentNorm(statistics, document_data.length), term_weight);
+                        } else {
+                            document_to_relevance[document_id] += scorer.Score(term_freq, 0, 0.0, term_weight);
+                        }
+                    }
+                }
+            }
+        }
+        PROFILE_STAGE(Stage::MINUS_FILTER);
         for (const std::string_view word : query.minus_words) {
             if (word_to_document_freqs_.count(word) == 0) {
                 continue;
@@ -155,45 +700,588 @@ private:
                 document_to_relevance.erase(document_id);
             }
         }
-
+        return document_to_relevance;
+    }
+    template <typename DocumentPredicate>
+    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
+        ConcurrentMap<int,double> document_to_relevance(10);
+        {
+            PROFILE_STAGE(Stage::POSTING_WALK);
+            std::for_each(
+                    std::execution::par,
+                    query.plus_words.begin(),
+                    query.plus_words.end(),
+                    [&](const std::string_view word) {
+                        if (word_to_document_freqs_.count(word) != 0) {
+                            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+                            const auto& postings = word_to_document_freqs_.at(word);
+                            PROFILE_ITEMS(Stage::POSTING_WALK, postings.size());
+                            for (const auto [document_id, term_freq] : postings) {
+                                const auto& document_data = documents_.at(document_id);
+                                if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+                                }
+                            }
+                        }
+                    });
+        }
+        {
+            PROFILE_STAGE(Stage::MINUS_FILTER);
+            std::for_each(
+                    std::execution::par,
+                    query.minus_words.begin(),
+                    query.minus_words.end(),
+                    [&](const std::string_view word) {
+                        if (word_to_document_freqs_.count(word) != 0) {
+                            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
+                                document_to_relevance.erase(document_id);
+                            }
+                        }
+                    });
+        }
+        std::map<int, double> merged_relevance;
+        {
+            // merge of per-bucket accumulators
+            PROFILE_STAGE(Stage::ACCUMULATE);
+            merged_relevance = document_to_relevance.BuildOrdinaryMap();
+        }
+        PROFILE_STAGE(Stage::MATERIALIZE);
         std::vector<Document> matched_documents;
-        for (const auto [document_id, relevance] : document_to_relevance) {
+        for (const auto [document_id, relevance] : merged_relevance) {
             matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
         }
         return matched_documents;
     }
+    // only words walked by the plan produce candidates, skipped ones are probed for them;
+    // the result is exact if top candidates beat any document made of skipped words only,
+    // otherwise nullopt is returned and the caller walks all lists
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    std::optional<std::vector<Document>> FindTopCandidates(const Query& query, const QueryPlan& plan, DocumentPredicate document_predicate,
+                                                           const Scorer& scorer = Scorer()) const {
+        const auto candidates = ComputeDocumentRelevance(PruneQuery(query, plan), document_predicate, scorer);
+        if (candidates.size() < MAX_RESULT_DOCUMENT_COUNT) {
+            return std::nullopt;
+        }
+        const CollectionStatistics statistics = GetCollectionStatistics();
+        std::vector<std::pair<const std::map<int, double>*, double>> postings;
+        for (const std::string_view word : query.plus_words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it != word_to_document_freqs_.end() && !it->second.empty()) {
+                postings.push_back({&it->second, scorer.GetTermWeight(statistics, it->second.size())});
+            }
+        }
+        // the plan bounds tf-idf impacts, skipped words are bounded again for other scorers
+        double skipped_impact_bound = plan.skipped_impact_bound;
+        if constexpr (!std::is_same_v<Scorer, TfIdfScorer>) {
+            skipped_impact_bound = 0.0;
+            for (const TermStatistics& term : plan.terms) {
+                if (!term.is_minus && term.is_skipped && term.document_freq > 0 && query.minus_words.count(term.word) == 0) {
+                    skipped_impact_bound += scorer.GetMaxScore(word_to_max_freq_.at(term.word), scorer.GetTermWeight(statistics, term.document_freq));
+                }
+            }
+        }
+        PROFILE_STAGE(Stage::MATERIALIZE);
+        std::vector<Document> matched_documents;
+        matched_documents.reserve(candidates.size());
+        for (const auto& [document_id, _] : candidates) {
+            const auto& document_data = documents_.at(document_id);
+            const double document_norm = scorer.GetDocumentNorm(statistics, document_data.length);
+            // summed in query order like in ComputeDocumentRelevance
+            double relevance = 0.0;
+            for (const auto& [word_postings, term_weight] : postings) {
+                const auto it = word_postings->find(document_id);
+                if (it != word_postings->end()) {
+                    relevance += scorer.Score(it->second, document_data.length, document_norm, term_weight);
+                }
+            }
+            matched_documents.push_back({document_id, relevance, document_data.rating});
+        }
+        std::nth_element(matched_documents.begin(), matched_documents.begin() + (MAX_RESULT_DOCUMENT_COUNT - 1), matched_documents.end(),
+                         [](const Document& lhs, const Document& rhs) {
+                             return lhs.relevance > rhs.relevance;
+                         });
+        if (matched_documents[MAX_RESULT_DOCUMENT_COUNT - 1].relevance <= skipped_impact_bound + RELEVANCE_TOLERANCE) {
+            return std::nullopt;
+        }
+        return matched_documents;
+    }
+    // accumulators are arrays over the id range, chosen when postings cover a large part of it;
+    // contributions are added by blocks with ScatterAdd and only candidates for the top
+    // found by SelectTopCandidates are returned. A document is tested by the predicate
+    // at its first posting, its length and norm are kept from there
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    std::vector<Document> FindAllDocumentsDense(const Query& query, DocumentPredicate document_predicate, const Scorer& scorer = Scorer()) const {
+        const CollectionStatistics statistics = GetCollectionStatistics();
+        const int first_id = documents_.begin()->first;
+        const size_t id_count = static_cast<size_t>(documents_.rbegin()->first - first_id) + 1;
+        enum : uint8_t { NOT_MATCHED, MATCHED, EXCLUDED, REJECTED };
+        std::vector<double> relevance(id_count, 0.0);
+        std::vector<uint8_t> state(id_count, NOT_MATCHED);
+        std::vector<uint32_t> lengths(Scorer::USES_DOCUMENT_LENGTH ? id_count : 0);
+        std::vector<double> norms(Scorer::USES_DOCUMENT_LENGTH ? id_count : 0);
+        {
+            PROFILE_STAGE(Stage::MINUS_FILTER);
+            for (const std::string_view word : query.minus_words) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    continue;
+                }
+                for (const auto& [document_id, _] : it->second) {
+                    state[document_id - first_id] = EXCLUDED;
+                }
+            }
+        }
+        {
+            PROFILE_STAGE(Stage::POSTING_WALK);
+            std::vector<uint32_t> block_indices;
+            std::vector<double> block_contributions;
+            block_indices.reserve(BATCH_BLOCK_SIZE);
+            block_contributions.reserve(BATCH_BLOCK_SIZE);
+            for (const std::string_view word : query.plus_words) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    continue;
+                }
+                const double term_weight = scorer.GetTermWeight(statistics, it->second.size());
+                PROFILE_ITEMS(Stage::POSTING_WALK, it->second.size());
+                for (const auto [document_id, term_freq] : it->second) {
+                    const size_t index = static_cast<size_t>(document_id - first_id);
+                    if (state[index] == NOT_MATCHED) {
+                        const auto& document_data = documents_.at(document_id);
+                        state[index] = document_predicate(document_id, document_data.status, document_data.rating) ? MATCHED : REJECTED;
+                        if constexpr (Scorer::USES_DOCUMENT_LENGTH) {
+                            lengths[index] = document_data.length;
+                            norms[index] = scorer.GetDocumentNorm(statistics, document_data.length);
+                        }
+                    }
+                    if (state[index] == MATCHED) {
+                        block_indices.push_back(static_cast<uint32_t>(index));
+                        if constexpr (Scorer::USES_DOCUMENT_LENGTH) {
+                            block_contributions.push_back(scorer.Score(term_freq, lengths[index], norms[index], term_weight));
+                        } else {
+                            block_contributions.push_back(scorer.Score(term_freq, 0, 0.0, term_weight));
+                        }
+                    }
+                    if (block_indices.size() == BATCH_BLOCK_SIZE) {
+                        ScatterAdd(relevance.data(), block_indices.data(), block_contributions.data(), block_indices.size());
+                        block_indices.clear();
+                        block_contributions.clear();
+                    }
+                }
+                ScatterAdd(relevance.data(), block_indices.data(), block_contributions.data(), block_indices.size());
+                block_indices.clear();
+                block_contributions.clear();
+            }
+        }
+        PROFILE_STAGE(Stage::MATERIALIZE);
+        std::vector<Document> matched_documents;
+        for (const uint32_t index : SelectTopCandidates(relevance.data(), state.data(), MATCHED, id_count,
+                                                        MAX_RESULT_DOCUMENT_COUNT, RELEVANCE_TOLERANCE)) {
+            const int document_id = first_id + static_cast<int>(index);
+            matched_documents.push_back({document_id, relevance[index], documents_.at(document_id).rating});
+        }
+        return matched_documents;
+    }
+    // intersection of posting lists, shortest list leads and the others seek to its documents,
+    // so work is proportional to the shortest list, not to the sum of lists
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    std::vector<Document> FindAllDocumentsConjunctive(const Query& query, DocumentPredicate document_predicate, const Scorer& scorer = Scorer()) const {
+        const CollectionStatistics statistics = GetCollectionStatistics();
+        struct Term {
+            const std::map<int, double>* postings;
+            double term_weight;
+            // position of the word in query.plus_words
+            size_t index;
+        };
+        std::vector<Term> terms;
+        for (const std::string_view word : query.plus_words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it == word_to_document_freqs_.end() || it->second.empty()) {
+                return {};
+            }
+            terms.push_back({&it->second, scorer.GetTermWeight(statistics, it->second.size()), terms.size()});
+        }
+        if (terms.empty()) {
+            return {};
+        }
+        std::sort(terms.begin(), terms.end(), [](const Term& lhs, const Term& rhs) {
+            return lhs.postings->size() < rhs.postings->size();
+        });
+        std::vector<const std::map<int, double>*> minus_postings;
+        for (const std::string_view word : query.minus_words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it != word_to_document_freqs_.end()) {
+                minus_postings.push_back(&it->second);
+            }
+        }
+        PROFILE_STAGE(Stage::POSTING_WALK);
+        std::vector<PostingIterator> cursors;
+        for (const Term& term : terms) {
+            cursors.push_back(term.postings->begin());
+        }
+        std::vector<double> term_freqs(terms.size());
+        std::vector<Document> matched_documents;
+        while (cursors[0] != terms[0].postings->end()) {
+            int target = cursors[0]->first;
+            bool is_matched = true;
+            for (size_t i = 1; i < terms.size(); ++i) {
+                cursors[i] = SeekPosting(*terms[i].postings, cursors[i], target);
+                if (cursors[i] == terms[i].postings->end()) {
+                    return matched_documents;
+                }
+                if (cursors[i]->first != target) {
+                    target = cursors[i]->first;
+                    is_matched = false;
+                    break;
+                }
+            }
+            if (!is_matched) {
+                cursors[0] = SeekPosting(*terms[0].postings, cursors[0], target);
+                continue;
+            }
+            const auto& document_data = documents_.at(target);
+            const bool is_excluded = std::any_of(minus_postings.begin(), minus_postings.end(), [target](const auto* postings) {
+                return postings->count(target) > 0;
+            });
+            if (!is_excluded && document_predicate(target, document_data.status, document_data.rating)) {
+                const double document_norm = scorer.GetDocumentNorm(statistics, document_data.length);
+                for (size_t i = 0; i < terms.size(); ++i) {
+                    term_freqs[terms[i].index] = scorer.Score(cursors[i]->second, document_data.length, document_norm, terms[i].term_weight);
+                }
+                // summed in query order like in FindAllDocuments
+                double relevance = 0.0;
+                for (const double term_relevance : term_freqs) {
+                    relevance += term_relevance;
+                }
+                matched_documents.push_back({target, relevance, document_data.rating});
+            }
+            ++cursors[0];
+        }
+        return matched_documents;
+    }
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
-        ConcurrentMap<int,double> document_to_relevance(10);
-        std::for_each(
-                std::execution::par,
-                query.plus_words.begin(),
-                query.plus_words.end(),
-                [&](const std::string_view word) {
-                    if (word_to_document_freqs_.count(word) != 0) {
-                        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                            const auto& document_data = documents_.at(document_id);
-                            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                                document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                            }
+    PartialResult FindTopDocumentsWithinBudget(const Query& query, const SearchBudget& budget, DocumentPredicate document_predicate) const {
+        struct Term {
+            const std::map<int, double>* postings;
+            double inverse_document_freq;
+            double max_impact;
+        };
+        std::vector<Term> terms;
+        for (const std::string_view word : query.plus_words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it != word_to_document_freqs_.end() && !it->second.empty()) {
+                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+                terms.push_back({&it->second, inverse_document_freq, inverse_document_freq * word_to_max_freq_.at(word)});
+            }
+        }
+        // query order is kept in terms for the final relevance
+        std::vector<const Term*> walk_order;
+        for (const Term& term : terms) {
+            walk_order.push_back(&term);
+        }
+        std::stable_sort(walk_order.begin(), walk_order.end(), [](const Term* lhs, const Term* rhs) {
+            return lhs->max_impact > rhs->max_impact;
+        });
+
+        BudgetTracker tracker(budget);
+        std::map<int, double> document_to_relevance;
+        {
+            PROFILE_STAGE(Stage::POSTING_WALK);
+            for (const Term* term : walk_order) {
+                for (const auto [document_id, term_freq] : *term->postings) {
+                    if (!tracker.Spend()) {
+                        break;
+                    }
+                    const auto& document_data = documents_.at(document_id);
+                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                        document_to_relevance[document_id] += term_freq * term->inverse_document_freq;
+                    }
+                }
+                if (tracker.IsExhausted()) {
+                    break;
+                }
+            }
+        }
+        PartialResult result;
+        result.is_partial = tracker.IsExhausted();
+        result.scored_postings = tracker.GetSpentPostings();
+        {
+            // minus lists are probed for candidates only, so a long one can't blow the budget
+            PROFILE_STAGE(Stage::MINUS_FILTER);
+            for (const std::string_view word : query.minus_words) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    continue;
+                }
+                for (auto candidate = document_to_relevance.begin(); candidate != document_to_relevance.end();) {
+                    if (it->second.count(candidate->first) > 0) {
+                        candidate = document_to_relevance.erase(candidate);
+                    } else {
+                        ++candidate;
+                    }
+                }
+            }
+        }
+        {
+            PROFILE_STAGE(Stage::MATERIALIZE);
+            for (const auto [document_id, relevance] : document_to_relevance) {
+                result.documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+            }
+        }
+        SelectTopDocuments(std::execution::seq, result.documents);
+        // relevance of the top is completed with words not walked and summed in query order
+        // like in ComputeDocumentRelevance
+        for (Document& document : result.documents) {
+            document.relevance = 0.0;
+            for (const Term& term : terms) {
+                const auto it = term.postings->find(document.id);
+                if (it != term.postings->end()) {
+                    document.relevance += it->second * term.inverse_document_freq;
+                }
+            }
+        }
+        SelectTopDocuments(std::execution::seq, result.documents);
+        return result;
+    }
+    template <typename DocumentPredicate, typename Scorer = TfIdfScorer>
+    std::vector<std::vector<Document>> EvaluateQueryBatch(size_t parallelism, const std::vector<std::string>& raw_queries, DocumentPredicate document_predicate,
+                                                          const Scorer& scorer = Scorer()) const {
+        std::vector<Query> queries;
+        queries.reserve(raw_queries.size());
+        for (const std::string& raw_query : raw_queries) {
+            queries.push_back(ParseQuery(raw_query));
+        }
+        std::vector<std::vector<Document>> results(queries.size());
+        if (queries.empty() || documents_.empty()) {
+            return results;
+        }
+        // accumulators are indexed by document ordinal, so sparse ids cost nothing;
+        // the predicate and the norm are evaluated once per document, not once per posting
+        BatchDocuments batch_documents;
+        batch_documents.statistics = GetCollectionStatistics();
+        batch_documents.ids.reserve(documents_.size());
+        batch_documents.ratings.reserve(documents_.size());
+        batch_documents.is_accepted.reserve(documents_.size());
+        for (const auto& [document_id, document_data] : documents_) {
+            batch_documents.ids.push_back(document_id);
+            batch_documents.ratings.push_back(document_data.rating);
+            batch_documents.is_accepted.push_back(document_predicate(document_id, document_data.status, document_data.rating));
+            if constexpr (Scorer::USES_DOCUMENT_LENGTH) {
+                batch_documents.lengths.push_back(document_data.length);
+                batch_documents.norms.push_back(scorer.GetDocumentNorm(batch_documents.statistics, document_data.length));
+            }
+        }
+        const size_t query_bytes = documents_.size() * (sizeof(double) + sizeof(uint8_t));
+        const size_t group_size = std::max<size_t>(1, std::min(BATCH_ACCUMULATOR_BYTES / parallelism / query_bytes,
+                                                               (queries.size() + parallelism - 1) / parallelism));
+        std::vector<size_t> group_firsts;
+        for (size_t first = 0; first < queries.size(); first += group_size) {
+            group_firsts.push_back(first);
+        }
+        const auto evaluate_group = [&](size_t first) {
+            EvaluateQueryGroup(queries, first, std::min(first + group_size, queries.size()), batch_documents, results, scorer);
+        };
+        if (parallelism > 1) {
+            std::for_each(std::execution::par, group_firsts.begin(), group_firsts.end(), evaluate_group);
+        } else {
+            std::for_each(group_firsts.begin(), group_firsts.end(), evaluate_group);
+        }
+        return results;
+    }
+    // words of the group are walked in lexical order, so every query gets its contributions
+    // in the order of its plus_words and relevance is summed like in ComputeDocumentRelevance
+    template <typename Scorer>
+    void EvaluateQueryGroup(const std::vector<Query>& queries, size_t first, size_t last, const BatchDocuments& batch_documents,
+                            std::vector<std::vector<Document>>& results, const Scorer& scorer) const {
+        enum : uint8_t { NOT_MATCHED, MATCHED, EXCLUDED };
+        const std::vector<int>& document_ids = batch_documents.ids;
+        const size_t document_count = document_ids.size();
+        const size_t group_size = last - first;
+        std::vector<double> relevance(group_size * document_count, 0.0);
+        std::vector<uint8_t> state(group_size * document_count, NOT_MATCHED);
+        std::vector<std::vector<uint32_t>> matched(group_size);
+        // positions in the group of queries using the word
+        std::map<std::string_view, std::vector<size_t>> plus_word_queries;
+        std::map<std::string_view, std::vector<size_t>> minus_word_queries;
+        for (size_t query = first; query < last; ++query) {
+            for (const std::string_view word : queries[query].plus_words) {
+                plus_word_queries[word].push_back(query - first);
+            }
+            for (const std::string_view word : queries[query].minus_words) {
+                minus_word_queries[word].push_back(query - first);
+            }
+        }
+        // ordinals of a block are distinct, so it is added with one ScatterAdd per query
+        std::vector<uint32_t> block_ordinals;
+        std::vector<double> block_contributions;
+        block_ordinals.reserve(BATCH_BLOCK_SIZE);
+        block_contributions.reserve(BATCH_BLOCK_SIZE);
+        // fills the block with the next postings of the list, ids of a list go up,
+        // so the ordinal of each one is searched forward from the previous one
+        const auto fill_block = [&](PostingIterator& posting, PostingIterator end, double term_weight, bool is_filtered) {
+            block_ordinals.clear();
+            block_contributions.clear();
+            auto ordinal = document_ids.begin();
+            for (; posting != end && block_ordinals.size() < BATCH_BLOCK_SIZE; ++posting) {
+                const auto [document_id, term_freq] = *posting;
+                size_t step = 1;
+                auto bound = ordinal;
+                while (bound != document_ids.end() && *bound < document_id) {
+                    ordinal = bound;
+                    bound = static_cast<size_t>(document_ids.end() - bound) > step ? bound + step : document_ids.end();
+                    step *= 2;
+                }
+                ordinal = std::lower_bound(ordinal, bound, document_id);
+                const auto index = static_cast<uint32_t>(ordinal - document_ids.begin());
+                if (!is_filtered) {
+                    block_ordinals.push_back(index);
+                } else if (batch_documents.is_accepted[index]) {
+                    block_ordinals.push_back(index);
+                    if constexpr (Scorer::USES_DOCUMENT_LENGTH) {
+                        block_contributions.push_back(scorer.Score(term_freq, batch_documents.lengths[index], batch_documents.norms[index], term_weight));
+                    } else {
+                        block_contributions.push_back(scorer.Score(term_freq, 0, 0.0, term_weight));
+                    }
+                }
+            }
+        };
+        {
+            PROFILE_STAGE(Stage::MINUS_FILTER);
+            for (const auto& [word, word_queries] : minus_word_queries) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    continue;
+                }
+                for (auto posting = it->second.begin(); posting != it->second.end();) {
+                    fill_block(posting, it->second.end(), 0.0, false);
+                    for (const size_t query : word_queries) {
+                        uint8_t* const query_state = state.data() + query * document_count;
+                        for (const uint32_t ordinal : block_ordinals) {
+                            query_state[ordinal] = EXCLUDED;
                         }
                     }
-                });
-        std::for_each(
-                std::execution::par,
-                query.minus_words.begin(),
-                query.minus_words.end(),
-                [&](const std::string_view word) {
-                    if (word_to_document_freqs_.count(word) != 0) {
-                        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                            document_to_relevance.erase(document_id);
+                }
+            }
+        }
+        {
+            PROFILE_STAGE(Stage::POSTING_WALK);
+            for (const auto& [word, word_queries] : plus_word_queries) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    continue;
+                }
+                const double term_weight = scorer.GetTermWeight(batch_documents.statistics, it->second.size());
+                PROFILE_ITEMS(Stage::POSTING_WALK, it->second.size());
+                for (auto posting = it->second.begin(); posting != it->second.end();) {
+                    fill_block(posting, it->second.end(), term_weight, true);
+                    for (const size_t query : word_queries) {
+                        double* const query_relevance = relevance.data() + query * document_count;
+                        uint8_t* const query_state = state.data() + query * document_count;
+                        // sums of excluded documents are added too, they are never read
+                        for (const uint32_t ordinal : block_ordinals) {
+                            if (query_state[ordinal] == NOT_MATCHED) {
+                                query_state[ordinal] = MATCHED;
+                                matched[query].push_back(ordinal);
+                            }
                         }
+                        ScatterAdd(query_relevance, block_ordinals.data(), block_contributions.data(), block_ordinals.size());
                     }
-                });
+                }
+            }
+        }
+        PROFILE_STAGE(Stage::MATERIALIZE);
+        for (size_t query = 0; query < group_size; ++query) {
+            // id order as in the single query search: candidates for the top of many matches
+            // are collected by a scan of the arrays, few matches are sorted
+            std::vector<uint32_t>& ordinals = matched[query];
+            if (ordinals.size() * 16 > document_count) {
+                ordinals = SelectTopCandidates(relevance.data() + query * document_count, state.data() + query * document_count,
+                                               MATCHED, document_count, MAX_RESULT_DOCUMENT_COUNT, RELEVANCE_TOLERANCE);
+            } else {
+                std::sort(ordinals.begin(), ordinals.end());
+            }
+            std::vector<Document>& matched_documents = results[first + query];
+            matched_documents.reserve(ordinals.size());
+            for (const uint32_t ordinal : ordinals) {
+                matched_documents.push_back({document_ids[ordinal], relevance[query * document_count + ordinal], batch_documents.ratings[ordinal]});
+            }
+            SelectTopDocuments(std::execution::seq, matched_documents);
+        }
+    }
+    // documents are split into id ranges by the longest posting list of the query,
+    // every range is scored by its own task, so no locks are needed and
+    // relevance is summed in the same order as in sequential version
+    template <typename DocumentPredicate>
+    std::vector<Document> FindAllDocumentsSharded(const Query& query, DocumentPredicate document_predicate) const {
+        const std::map<int, double>* longest_postings = nullptr;
+        for (const std::string_view word : query.plus_words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it != word_to_document_freqs_.end()
+                && (longest_postings == nullptr || it->second.size() > longest_postings->size())) {
+                longest_postings = &it->second;
+            }
+        }
+        if (longest_postings == nullptr) {
+            return {};
+        }
+        const size_t shard_count = std::max(1u, std::thread::hardware_concurrency()) * 4;
+        const size_t step = longest_postings->size() / shard_count + 1;
+        // first document id of every shard
+        std::vector<int> borders = {INT_MIN};
+        size_t position = 0;
+        for (const auto& [document_id, _] : *longest_postings) {
+            if (position > 0 && position % step == 0) {
+                borders.push_back(document_id);
+            }
+            ++position;
+        }
+        std::vector<std::map<int, double>> shards(borders.size());
+        std::vector<size_t> shard_indexes(shards.size());
+        std::iota(shard_indexes.begin(), shard_indexes.end(), 0);
+        {
+            PROFILE_STAGE(Stage::POSTING_WALK);
+            std::for_each(
+                    std::execution::par,
+                    shard_indexes.begin(),
+                    shard_indexes.end(),
+                    [&](size_t shard) {
+                        const auto get_range = [&](const std::map<int, double>& postings) {
+                            return std::pair{postings.lower_bound(borders[shard]),
+                                             shard + 1 < borders.size() ? postings.lower_bound(borders[shard + 1]) : postings.end()};
+                        };
+                        auto& document_to_relevance = shards[shard];
+                        for (const std::string_view word : query.plus_words) {
+                            const auto postings = word_to_document_freqs_.find(word);
+                            if (postings == word_to_document_freqs_.end()) {
+                                continue;
+                            }
+                            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+                            const auto [first, last] = get_range(postings->second);
+                            for (auto it = first; it != last; ++it) {
+                                const auto& document_data = documents_.at(it->first);
+                                if (document_predicate(it->first, document_data.status, document_data.rating)) {
+                                    document_to_relevance[it->first] += it->second * inverse_document_freq;
+                                }
+                            }
+                        }
+                        for (const std::string_view word : query.minus_words) {
+                            const auto postings = word_to_document_freqs_.find(word);
+                            if (postings == word_to_document_freqs_.end()) {
+                                continue;
+                            }
+                            const auto [first, last] = get_range(postings->second);
+                            for (auto it = first; it != last; ++it) {
+                                document_to_relevance.erase(it->first);
+                            }
+                        }
+                    });
+        }
+        PROFILE_STAGE(Stage::MATERIALIZE);
         std::vector<Document> matched_documents;
-        for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-            matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+        for (const auto& document_to_relevance : shards) {
+            for (const auto [document_id, relevance] : document_to_relevance) {
+                matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+            }
         }
         return matched_documents;
     }
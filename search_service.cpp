@@ -0,0 +1,317 @@
+#include "search_service.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace std;
+namespace {
+void AppendNumber(string& output, double value) {
+    char buffer[32];
+    output.append(buffer, to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+void AppendNumber(string& output, long long value) {
+    char buffer[24];
+    output.append(buffer, to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+}  // namespace
+
+SearchService::SearchService(const SearchServer& search_server, const ServiceOptions& options)
+        : search_server_(search_server)
+        , options_(options) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd_ < 0 || epoll_fd_ < 0 || stop_fd_ < 0) {
+        throw runtime_error("can't create service sockets"s);
+    }
+    const int enable = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.address.c_str(), &address.sin_addr) != 1) {
+        throw invalid_argument("wrong address "s + options_.address);
+    }
+    socklen_t address_size = sizeof(address);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listen_fd_, SOMAXCONN) != 0
+        || getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &address_size) != 0) {
+        throw runtime_error("can't listen on "s + options_.address + ":"s + to_string(options_.port));
+    }
+    port_ = ntohs(address.sin_port);
+    for (const int fd : {listen_fd_, stop_fd_}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+SearchService::~SearchService() {
+    for (const auto& [fd, _] : connections_) {
+        close(fd);
+    }
+    close(listen_fd_);
+    close(epoll_fd_);
+    close(stop_fd_);
+}
+uint16_t SearchService::GetPort() const {
+    return port_;
+}
+void SearchService::Stop() {
+    const uint64_t value = 1;
+    // nothing to do if the counter is full, the loop is stopping anyway
+    [[maybe_unused]] const ssize_t written = write(stop_fd_, &value, sizeof(value));
+}
+const RequestStatistics& SearchService::GetStatistics() const {
+    return stats_;
+}
+void SearchService::Run() {
+    vector<epoll_event> events(256);
+    vector<Request> requests;
+    // connections with complete lines left over after a full batch
+    vector<int> pending;
+    while (true) {
+        const int count = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), pending.empty() ? -1 : 0);
+        if (count < 0 && errno != EINTR) {
+            throw runtime_error("epoll_wait failed"s);
+        }
+        vector<int> ready;
+        ready.swap(pending);
+        for (int i = 0; i < max(count, 0); ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == stop_fd_) {
+                return;
+            }
+            if (fd == listen_fd_) {
+                AcceptConnections();
+                continue;
+            }
+            Connection& connection = connections_.at(fd);
+            if (events[i].events & EPOLLOUT) {
+                FlushOutput(connection);
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !ReadInput(connection)) {
+                connection.is_closing = true;
+            }
+            ready.push_back(fd);
+        }
+        sort(ready.begin(), ready.end());
+        ready.erase(unique(ready.begin(), ready.end()), ready.end());
+
+        requests.clear();
+        for (const int fd : ready) {
+            // a connection with full output waits for EPOLLOUT to go on
+            Connection& connection = connections_.at(fd);
+            if (!IsOutputFull(connection) && ParseRequests(connection, requests)) {
+                pending.push_back(fd);
+            }
+        }
+        ProcessBatch(requests);
+        for (const int fd : ready) {
+            Connection& connection = connections_.at(fd);
+            // parsed lines are dropped only now, requests pointed into them
+            connection.input.erase(0, connection.parsed);
+            connection.parsed = 0;
+            FlushOutput(connection);
+            const bool has_unsent = connection.written < connection.output.size();
+            if (connection.is_closing && !has_unsent && find(pending.begin(), pending.end(), fd) == pending.end()) {
+                CloseConnection(fd);
+            } else {
+                UpdateEvents(connection);
+            }
+        }
+    }
+}
+void SearchService::AcceptConnections() {
+    while (true) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        const int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        Connection& connection = connections_[fd];
+        connection.fd = fd;
+        connection.events = EPOLLIN | EPOLLRDHUP;
+        epoll_event event{};
+        event.events = connection.events;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+bool SearchService::ReadInput(Connection& connection) {
+    char buffer[1 << 16];
+    // the rest stays in the socket until these lines are parsed, epoll reports it again
+    while (connection.input.size() - connection.parsed <= options_.max_line) {
+        const ssize_t count = read(connection.fd, buffer, sizeof(buffer));
+        if (count > 0) {
+            connection.input.append(buffer, static_cast<size_t>(count));
+            continue;
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    return true;
+}
+bool SearchService::ParseRequests(Connection& connection, vector<Request>& requests) {
+    const string_view input(connection.input);
+    while (requests.size() < options_.max_batch) {
+        const size_t end = input.find('\n', connection.parsed);
+        if (end == string_view::npos) {
+            if (input.size() - connection.parsed > options_.max_line) {
+                connection.is_closing = true;
+            }
+            return false;
+        }
+        string_view line = input.substr(connection.parsed, end - connection.parsed);
+        connection.parsed = end + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        const string_view command = line.substr(0, line.find(' '));
+        const string_view argument = command.size() < line.size() ? line.substr(command.size() + 1) : string_view();
+        if (command == "FIND"sv) {
+            requests.push_back({&connection, RequestType::FIND, argument});
+        } else if (command == "STATS"sv) {
+            requests.push_back({&connection, RequestType::STATS, {}});
+        } else if (command == "PING"sv) {
+            requests.push_back({&connection, RequestType::PING, {}});
+        } else {
+            requests.push_back({&connection, RequestType::ERROR, "unknown command"sv});
+        }
+    }
+    return connection.input.find('\n', connection.parsed) != string::npos;
+}
+void SearchService::ProcessBatch(const vector<Request>& requests) {
+    if (requests.empty()) {
+        return;
+    }
+    const auto start = RequestStatistics::Clock::now();
+    struct Result {
+        vector<Document> documents;
+        string error;
+        RequestStatistics::Clock::duration latency{};
+    };
+    vector<Result> results(requests.size());
+    vector<size_t> indexes(requests.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    // an exception must not leave a parallel algorithm, bad queries become error lines
+    for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        if (requests[i].type != RequestType::FIND) {
+            return;
+        }
+        try {
+            results[i].documents = search_server_.FindTopDocuments(requests[i].argument);
+        } catch (const exception& e) {
+            results[i].error = e.what();
+        }
+        results[i].latency = RequestStatistics::Clock::now() - start;
+    });
+    for (size_t i = 0; i < requests.size(); ++i) {
+        string& output = requests[i].connection->output;
+        switch (requests[i].type) {
+            case RequestType::FIND:
+                stats_.Record(start, results[i].latency, results[i].documents.size());
+                if (!results[i].error.empty()) {
+                    output += "ERR "s + results[i].error + "\n"s;
+                    break;
+                }
+                for (const Document& document : results[i].documents) {
+                    output += "DOC "s;
+                    AppendNumber(output, static_cast<long long>(document.id));
+                    output += ' ';
+                    AppendNumber(output, document.relevance);
+                    output += ' ';
+                    AppendNumber(output, static_cast<long long>(document.rating));
+                    output += '\n';
+                }
+                output += "END "s;
+                AppendNumber(output, static_cast<long long>(results[i].documents.size()));
+                output += '\n';
+                break;
+            case RequestType::STATS: {
+                const RequestStatsSnapshot snapshot = stats_.GetSnapshot(chrono::seconds(1));
+                output += "STATS qps="s;
+                AppendNumber(output, snapshot.qps);
+                output += " p50_us="s;
+                AppendNumber(output, static_cast<long long>(snapshot.p50_ns / 1000));
+                output += " p99_us="s;
+                AppendNumber(output, static_cast<long long>(snapshot.p99_ns / 1000));
+                output += " requests="s;
+                AppendNumber(output, static_cast<long long>(snapshot.requests));
+                output += '\n';
+                break;
+            }
+            case RequestType::PING:
+                output += "PONG\n"s;
+                break;
+            case RequestType::ERROR:
+                output += "ERR "s;
+                output += requests[i].argument;
+                output += '\n';
+                break;
+        }
+    }
+}
+void SearchService::FlushOutput(Connection& connection) {
+    while (connection.written < connection.output.size()) {
+        const ssize_t count = send(connection.fd, connection.output.data() + connection.written,
+                                   connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // peer is gone, nothing more will be delivered
+                connection.is_closing = true;
+                connection.output.clear();
+                connection.written = 0;
+            }
+            return;
+        }
+        connection.written += static_cast<size_t>(count);
+    }
+    connection.output.clear();
+    connection.written = 0;
+}
+bool SearchService::IsOutputFull(const Connection& connection) const {
+    return connection.output.size() - connection.written > options_.max_unsent_output;
+}
+void SearchService::UpdateEvents(Connection& connection) {
+    uint32_t events = 0;
+    // unread requests stay in the socket, so the client is slowed down by TCP;
+    // a connection which is not read waits for EPOLLOUT only, a readable or half-closed
+    // socket would wake the loop again and again
+    if (!connection.is_closing && !IsOutputFull(connection)) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (connection.written < connection.output.size()) {
+        events |= EPOLLOUT;
+    }
+    if (events == connection.events) {
+        return;
+    }
+    connection.events = events;
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = connection.fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+}
+void SearchService::CloseConnection(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(fd);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "request_stats.h"
+#include "search_server.h"
+// line protocol over TCP, every request and response line ends with '\n':
+//   FIND <query>  ->  "DOC <id> <relevance> <rating>" per document, then "END <count>"
+//   STATS         ->  "STATS qps=<> p50_us=<> p99_us=<> requests=<>" over the last second
+//   PING          ->  "PONG"
+// anything else or a bad query gets "ERR <message>". Clients may pipeline requests,
+// responses of a connection come in request order
+struct ServiceOptions {
+    std::string address = "127.0.0.1";
+    // 0 binds an ephemeral port, see GetPort
+    uint16_t port = 7700;
+    // FIND requests evaluated together at most
+    size_t max_batch = 1024;
+    // a longer request line closes the connection
+    size_t max_line = 1 << 16;
+    // a connection with more unsent output is neither read nor served until the client reads
+    size_t max_unsent_output = 1 << 20;
+};
+// single-threaded epoll loop: requests read from all ready connections in one wakeup are
+// parsed in place (queries are views into the input buffers) and evaluated as one parallel batch
+// like in ProcessQueries, then responses are written back without blocking.
+// Latency of a request counts from the start of its batch to its own result
+class SearchService {
+public:
+    SearchService(const SearchServer& search_server, const ServiceOptions& options = ServiceOptions());
+    SearchService(const SearchService&) = delete;
+    SearchService& operator=(const SearchService&) = delete;
+    ~SearchService();
+
+    uint16_t GetPort() const;
+    // serves until Stop
+    void Run();
+    // may be called from any thread or a signal handler
+    void Stop();
+    const RequestStatistics& GetStatistics() const;
+private:
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        // start of the first unparsed line in input
+        size_t parsed = 0;
+        std::string output;
+        size_t written = 0;
+        // epoll events the connection is registered for
+        uint32_t events = 0;
+        bool is_closing = false;
+    };
+    enum class RequestType {
+        FIND,
+        STATS,
+        PING,
+        ERROR,
+    };
+    struct Request {
+        Connection* connection;
+        RequestType type;
+        // query of FIND or message of ERROR
+        std::string_view argument;
+    };
+
+    void AcceptConnections();
+    // false if the peer closed the connection or it failed
+    bool ReadInput(Connection& connection);
+    // complete lines of connection up to the batch limit, true if lines are left
+    bool ParseRequests(Connection& connection, std::vector<Request>& requests);
+    void ProcessBatch(const std::vector<Request>& requests);
+    void FlushOutput(Connection& connection);
+    bool IsOutputFull(const Connection& connection) const;
+    void UpdateEvents(Connection& connection);
+    void CloseConnection(int fd);
+
+    const SearchServer& search_server_;
+    const ServiceOptions options_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int stop_fd_ = -1;
+    uint16_t port_ = 0;
+    std::unordered_map<int, Connection> connections_;
+    RequestStatistics stats_;
+};
@@ -0,0 +1,208 @@
+#include "simd_kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string_view>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_X86_KERNELS
+#include <immintrin.h>
+#endif
+using namespace std;
+namespace {
+atomic<SimdLevel> simd_level{SimdLevel::SCALAR};
+once_flag simd_level_flag;
+
+void ScatterAddScalar(double* accumulators, const uint32_t* ordinals, const double* contributions, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        accumulators[ordinals[i]] += contributions[i];
+    }
+}
+void FilterAboveThresholdScalar(const double* values, const uint8_t* states, uint8_t state, size_t first, size_t last,
+                                double threshold, vector<uint32_t>& indices) {
+    for (size_t index = first; index < last; ++index) {
+        if (states[index] == state && values[index] > threshold) {
+            indices.push_back(static_cast<uint32_t>(index));
+        }
+    }
+}
+#ifdef SEARCH_SERVER_X86_KERNELS
+// avx2 has gathers but no scatters, sums are stored lane by lane;
+// masked forms of intrinsics are used where plain ones start from undefined registers,
+// which gcc reports as uninitialized
+__attribute__((target("avx2")))
+void ScatterAddAvx2(double* accumulators, const uint32_t* ordinals, const double* contributions, size_t count) {
+    size_t i = 0;
+    alignas(32) double sums[4];
+    const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (; i + 4 <= count; i += 4) {
+        const __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ordinals + i));
+        const __m256d gathered = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), accumulators, lanes, all_lanes, 8);
+        _mm256_store_pd(sums, _mm256_add_pd(gathered, _mm256_loadu_pd(contributions + i)));
+        accumulators[ordinals[i]] = sums[0];
+        accumulators[ordinals[i + 1]] = sums[1];
+        accumulators[ordinals[i + 2]] = sums[2];
+        accumulators[ordinals[i + 3]] = sums[3];
+    }
+    ScatterAddScalar(accumulators, ordinals + i, contributions + i, count - i);
+}
+// states of 4 entries are widened to the lanes of their values, only lanes passing
+// both tests are visited
+__attribute__((target("avx2")))
+void FilterAboveThresholdAvx2(const double* values, const uint8_t* states, uint8_t state, size_t first, size_t last,
+                              double threshold, vector<uint32_t>& indices) {
+    const __m256d thresholds = _mm256_set1_pd(threshold);
+    const __m256i wanted = _mm256_set1_epi64x(state);
+    size_t index = first;
+    for (; index + 4 <= last; index += 4) {
+        int32_t packed;
+        memcpy(&packed, states + index, sizeof(packed));
+        const __m256i lane_states = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+        const __m256d is_state = _mm256_castsi256_pd(_mm256_cmpeq_epi64(lane_states, wanted));
+        const __m256d is_above = _mm256_cmp_pd(_mm256_loadu_pd(values + index), thresholds, _CMP_GT_OQ);
+        for (unsigned mask = _mm256_movemask_pd(_mm256_and_pd(is_state, is_above)); mask != 0; mask &= mask - 1) {
+            indices.push_back(static_cast<uint32_t>(index + __builtin_ctz(mask)));
+        }
+    }
+    FilterAboveThresholdScalar(values, states, state, index, last, threshold, indices);
+}
+__attribute__((target("avx512f")))
+void ScatterAddAvx512(double* accumulators, const uint32_t* ordinals, const double* contributions, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ordinals + i));
+        const __m512d gathered = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, lanes, accumulators, 8);
+        _mm512_i32scatter_pd(accumulators, lanes, _mm512_add_pd(gathered, _mm512_loadu_pd(contributions + i)), 8);
+    }
+    ScatterAddScalar(accumulators, ordinals + i, contributions + i, count - i);
+}
+__attribute__((target("avx512f")))
+void FilterAboveThresholdAvx512(const double* values, const uint8_t* states, uint8_t state, size_t first, size_t last,
+                                double threshold, vector<uint32_t>& indices) {
+    const __m512d thresholds = _mm512_set1_pd(threshold);
+    const __m512i wanted = _mm512_set1_epi64(state);
+    size_t index = first;
+    for (; index + 8 <= last; index += 8) {
+        const __m512i lane_states = _mm512_maskz_cvtepu8_epi64(0xFF, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(states + index)));
+        const __mmask8 is_state = _mm512_cmpeq_epi64_mask(lane_states, wanted);
+        for (unsigned mask = _mm512_mask_cmp_pd_mask(is_state, _mm512_loadu_pd(values + index), thresholds, _CMP_GT_OQ);
+             mask != 0; mask &= mask - 1) {
+            indices.push_back(static_cast<uint32_t>(index + __builtin_ctz(mask)));
+        }
+    }
+    FilterAboveThresholdScalar(values, states, state, index, last, threshold, indices);
+}
+#endif
+SimdLevel ParseSimdLevel(string_view name, SimdLevel fallback) {
+    if (name == "scalar"sv) {
+        return SimdLevel::SCALAR;
+    }
+    if (name == "avx2"sv) {
+        return SimdLevel::AVX2;
+    }
+    if (name == "avx512"sv) {
+        return SimdLevel::AVX512;
+    }
+    return fallback;
+}
+SimdLevel LoadSimdLevel() {
+    call_once(simd_level_flag, [] {
+        const SimdLevel supported = GetSupportedSimdLevel();
+        const char* name = getenv("SEARCH_SERVER_SIMD");
+        const SimdLevel requested = name == nullptr ? supported : ParseSimdLevel(name, supported);
+        simd_level.store(min(requested, supported));
+    });
+    return simd_level.load(memory_order_relaxed);
+}
+}
+const char* GetSimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SCALAR:
+            return "scalar";
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::AVX512:
+            return "avx512";
+    }
+    return "unknown";
+}
+SimdLevel GetSupportedSimdLevel() {
+#ifdef SEARCH_SERVER_X86_KERNELS
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+#endif
+    return SimdLevel::SCALAR;
+}
+SimdLevel GetSimdLevel() {
+    return LoadSimdLevel();
+}
+void SetSimdLevel(SimdLevel level) {
+    LoadSimdLevel();
+    simd_level.store(min(level, GetSupportedSimdLevel()));
+}
+void ScatterAdd(double* accumulators, const uint32_t* ordinals, const double* contributions, size_t count) {
+    switch (LoadSimdLevel()) {
+#ifdef SEARCH_SERVER_X86_KERNELS
+        case SimdLevel::AVX512:
+            ScatterAddAvx512(accumulators, ordinals, contributions, count);
+            return;
+        case SimdLevel::AVX2:
+            ScatterAddAvx2(accumulators, ordinals, contributions, count);
+            return;
+#endif
+        default:
+            ScatterAddScalar(accumulators, ordinals, contributions, count);
+    }
+}
+void FilterAboveThreshold(const double* values, const uint8_t* states, uint8_t state, size_t first, size_t last,
+                          double threshold, vector<uint32_t>& indices) {
+    switch (LoadSimdLevel()) {
+#ifdef SEARCH_SERVER_X86_KERNELS
+        case SimdLevel::AVX512:
+            FilterAboveThresholdAvx512(values, states, state, first, last, threshold, indices);
+            return;
+        case SimdLevel::AVX2:
+            FilterAboveThresholdAvx2(values, states, state, first, last, threshold, indices);
+            return;
+#endif
+        default:
+            FilterAboveThresholdScalar(values, states, state, first, last, threshold, indices);
+    }
+}
+// entries are filtered chunk by chunk against the count-th best value seen so far
+// minus tolerance; the threshold is raised whenever candidates doubled since the last raise
+vector<uint32_t> SelectTopCandidates(const double* values, const uint8_t* states, uint8_t state, size_t size,
+                                     size_t count, double tolerance) {
+    static constexpr size_t CHUNK_SIZE = 4096;
+    vector<uint32_t> candidates;
+    if (count == 0) {
+        return candidates;
+    }
+    double threshold = -numeric_limits<double>::infinity();
+    size_t raise_size = max<size_t>(count * 16, 256);
+    vector<double> candidate_values;
+    for (size_t first = 0; first < size; first += CHUNK_SIZE) {
+        FilterAboveThreshold(values, states, state, first, min(size, first + CHUNK_SIZE), threshold, candidates);
+        if (candidates.size() < raise_size) {
+            continue;
+        }
+        candidate_values.clear();
+        for (const uint32_t index : candidates) {
+            candidate_values.push_back(values[index]);
+        }
+        nth_element(candidate_values.begin(), candidate_values.begin() + (count - 1), candidate_values.end(), greater<>());
+        threshold = max(threshold, candidate_values[count - 1] - tolerance);
+        candidates.erase(remove_if(candidates.begin(), candidates.end(), [values, threshold](uint32_t index) {
+                             return !(values[index] > threshold);
+                         }),
+                         candidates.end());
+        raise_size = max(raise_size, candidates.size() * 2);
+    }
+    return candidates;
+}
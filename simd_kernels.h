@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+// vector kernels of the dense accumulator paths, the widest instruction set of the cpu
+// is picked on the first call (SEARCH_SERVER_SIMD=scalar|avx2|avx512 in environment
+// lowers it), results are the same on every level
+enum class SimdLevel {
+    SCALAR,
+    AVX2,
+    AVX512,
+};
+const char* GetSimdLevelName(SimdLevel level);
+SimdLevel GetSupportedSimdLevel();
+SimdLevel GetSimdLevel();
+// a level above the supported one is lowered to it
+void SetSimdLevel(SimdLevel level);
+
+// accumulators[ordinals[i]] += contributions[i], ordinals of one call must be distinct
+void ScatterAdd(double* accumulators, const uint32_t* ordinals, const double* contributions, size_t count);
+// appends indices in [first, last) with states[index] == state and values[index] > threshold,
+// in increasing order
+void FilterAboveThreshold(const double* values, const uint8_t* states, uint8_t state, size_t first, size_t last,
+                          double threshold, std::vector<uint32_t>& indices);
+// indices of entries with states[index] == state which can rank among the best `count` by value,
+// entries closer than tolerance to the count-th value are kept for tie breaks; increasing order
+std::vector<uint32_t> SelectTopCandidates(const double* values, const uint8_t* states, uint8_t state, size_t size,
+                                          size_t count, double tolerance);
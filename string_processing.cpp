@@ -1,4 +1,6 @@
 #include "string_processing.h"
+#include <algorithm>
+#include <stdexcept>
 using namespace std;
 vector<string> SplitIntoWords(const string& text) {
     vector<string> words;
@@ -32,4 +34,23 @@ vector<string_view> SplitIntoWordsView(string_view str) {
         }
     }
     return result;
-}
\ No newline at end of file
+}
+bool IsValidWord(string_view word) {
+    return none_of(word.begin(), word.end(), [](char c) {
+        return c >= '\0' && c < ' ';
+    });
+}
+QueryWord ParseQueryWord(string_view text) {
+    if (text.empty()) {
+        throw invalid_argument("after minus there're no words"s);
+    }
+    bool is_minus = false;
+    if (text[0] == '-') {
+        is_minus = true;
+        text = text.substr(1);
+    }
+    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+        throw invalid_argument("after minus there're no words"s);
+    }
+    return QueryWord{text, is_minus};
+}
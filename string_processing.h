@@ -1,5 +1,14 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 std::vector<std::string> SplitIntoWords(const std::string& text);
-std::vector<std::string_view> SplitIntoWordsView(std::string_view str);
\ No newline at end of file
+std::vector<std::string_view> SplitIntoWordsView(std::string_view str);
+// a valid word must not contain special characters
+bool IsValidWord(std::string_view word);
+struct QueryWord {
+    std::string_view data;
+    bool is_minus;
+};
+// throws invalid_argument for empty word, lone or double minus and special characters
+QueryWord ParseQueryWord(std::string_view text);
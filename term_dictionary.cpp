@@ -0,0 +1,94 @@
+#include "term_dictionary.h"
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+TermDictionary::TermDictionary(const vector<string_view>& sorted_terms) {
+    term_offsets_.reserve(sorted_terms.size() + 1);
+    term_offsets_.push_back(0);
+    for (size_t i = 0; i < sorted_terms.size(); ++i) {
+        if (i > 0 && sorted_terms[i - 1] >= sorted_terms[i]) {
+            throw invalid_argument("terms of a dictionary have to be sorted and unique"s);
+        }
+        characters_.append(sorted_terms[i]);
+        term_offsets_.push_back(static_cast<uint32_t>(characters_.size()));
+    }
+    // root covers all terms; a node of depth d covering terms [begin, end) has a child
+    // for every distinct character at position d, the term of length d comes first
+    labels_.push_back('\0');
+    term_begin_.push_back(0);
+    term_end_.push_back(static_cast<uint32_t>(sorted_terms.size()));
+    vector<uint32_t> depths = {0};
+    for (uint32_t node = 0; node < labels_.size(); ++node) {
+        first_child_.push_back(static_cast<uint32_t>(labels_.size()));
+        const uint32_t depth = depths[node];
+        uint32_t term = term_begin_[node];
+        if (term < term_end_[node] && sorted_terms[term].size() == depth) {
+            ++term;
+        }
+        while (term < term_end_[node]) {
+            const char label = sorted_terms[term][depth];
+            uint32_t end = term + 1;
+            while (end < term_end_[node] && sorted_terms[end][depth] == label) {
+                ++end;
+            }
+            labels_.push_back(label);
+            term_begin_.push_back(term);
+            term_end_.push_back(end);
+            depths.push_back(depth + 1);
+            term = end;
+        }
+    }
+    first_child_.push_back(static_cast<uint32_t>(labels_.size()));
+}
+optional<uint32_t> TermDictionary::Find(string_view term) const {
+    const auto node = FindNode(term);
+    if (!node) {
+        return nullopt;
+    }
+    // the term equal to the path of the node is the first one under it
+    const uint32_t term_id = term_begin_[*node];
+    if (GetTerm(term_id).size() != term.size()) {
+        return nullopt;
+    }
+    return term_id;
+}
+pair<uint32_t, uint32_t> TermDictionary::FindPrefixRange(string_view prefix) const {
+    const auto node = FindNode(prefix);
+    if (!node) {
+        return {0, 0};
+    }
+    return {term_begin_[*node], term_end_[*node]};
+}
+string_view TermDictionary::GetTerm(uint32_t term_id) const {
+    return string_view(characters_).substr(term_offsets_.at(term_id), term_offsets_.at(term_id + 1) - term_offsets_[term_id]);
+}
+size_t TermDictionary::GetTermCount() const {
+    return term_offsets_.empty() ? 0 : term_offsets_.size() - 1;
+}
+size_t TermDictionary::GetMemoryBytes() const {
+    return first_child_.capacity() * sizeof(uint32_t) + labels_.capacity()
+           + (term_begin_.capacity() + term_end_.capacity() + term_offsets_.capacity()) * sizeof(uint32_t)
+           + characters_.capacity();
+}
+optional<uint32_t> TermDictionary::FindNode(string_view prefix) const {
+    if (labels_.empty()) {
+        return nullopt;
+    }
+    uint32_t node = 0;
+    for (const char label : prefix) {
+        const auto first = labels_.begin() + first_child_[node];
+        const auto last = labels_.begin() + first_child_[node + 1];
+        // labels are ordered as bytes, like characters of sorted strings
+        const auto child = lower_bound(first, last, label, [](char lhs, char rhs) {
+            return static_cast<unsigned char>(lhs) < static_cast<unsigned char>(rhs);
+        });
+        if (child == last || *child != label) {
+            return nullopt;
+        }
+        node = static_cast<uint32_t>(child - labels_.begin());
+    }
+    if (term_begin_[node] == term_end_[node]) {
+        return nullopt;
+    }
+    return node;
+}
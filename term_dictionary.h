@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+// read-only trie over a sorted set of terms, term ids are positions in lexical order,
+// so terms starting with a prefix form one range of ids.
+// Nodes are flat arrays in breadth-first order, children of a node are adjacent
+// and sorted by label, term characters are kept in one buffer
+class TermDictionary {
+public:
+    TermDictionary() = default;
+    // terms have to be sorted and unique
+    explicit TermDictionary(const std::vector<std::string_view>& sorted_terms);
+
+    std::optional<uint32_t> Find(std::string_view term) const;
+    // ids [first, second) of terms starting with prefix, empty prefix gives all terms
+    std::pair<uint32_t, uint32_t> FindPrefixRange(std::string_view prefix) const;
+    std::string_view GetTerm(uint32_t term_id) const;
+    size_t GetTermCount() const;
+    size_t GetMemoryBytes() const;
+private:
+    // node reached by the prefix, nullopt if no term starts with it
+    std::optional<uint32_t> FindNode(std::string_view prefix) const;
+
+    // children of node i are nodes [first_child_[i], first_child_[i + 1]),
+    // labels_[i] is the character leading to node i
+    std::vector<uint32_t> first_child_;
+    std::vector<char> labels_;
+    // ids of the terms under the node
+    std::vector<uint32_t> term_begin_;
+    std::vector<uint32_t> term_end_;
+    std::string characters_;
+    // term i is characters_[term_offsets_[i], term_offsets_[i + 1])
+    std::vector<uint32_t> term_offsets_;
+};
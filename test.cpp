@@ -1,20 +1,47 @@
+#include "bulk_loader.h"
+#include "document_reordering.h"
+#include "durable_search_server.h"
+#include "frozen_index.h"
+#include "head_term_cache.h"
+#include "impact_index.h"
+#include "instrumentation.h"
+#include "numa_index.h"
 #include "process_queries.h"
 #include "search_server.h"
+#include "search_service.h"
+#include "simd_kernels.h"
+#include "warm_up.h"
+#if __cplusplus >= 202002L
+#include "async_search_server.h"
+#endif
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
 #include <execution>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
-void PrintDocument(const Document& document) {
-    cout << "{ "s
-         << "document_id = "s << document.id << ", "s
-         << "relevance = "s << document.relevance << ", "s
-         << "rating = "s << document.rating << " }"s << endl;
-}
-
 int Test1() {
     SearchServer search_server("and with"s);
 
@@ -153,4 +180,1462 @@ int Test4() {
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// pages of a query put together are the whole ranking, each page going after the previous one
+int TestFindNextPage() {
+    SearchServer search_server("and with"s);
+    int id = 0;
+    for (
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+            "curly pet"s,
+            "very curly rat"s,
+        }
+    ) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, {id % 3});
+    }
+
+    const string query = "curly pet rat -not"s;
+    vector<Document> ranking;
+    PageCursor cursor;
+    for (bool has_more = true; has_more;) {
+        const DocumentPage page = search_server.FindNextPage(query, 2, DecodePageCursor(EncodePageCursor(cursor)));
+        assert(page.documents.size() <= 2);
+        ranking.insert(ranking.end(), page.documents.begin(), page.documents.end());
+        cursor = page.next;
+        has_more = page.has_more;
+    }
+    assert(ranking.size() == 6);
+    assert(is_sorted(ranking.begin(), ranking.end(), IsRankedBefore));
+    const vector<Document> top = search_server.FindTopDocuments(query);
+    for (size_t i = 0; i < top.size(); ++i) {
+        assert(abs(top[i].relevance - ranking[i].relevance) < 1e-6);
+    }
+    assert(search_server.FindNextPage(query, 10, cursor).documents.empty());
+    cout << ranking.size() << " documents in pages of 2"s << endl;
+    // 6 documents in pages of 2
+
+    return 0;
+}
+
+// documents of a small vocabulary with a word contained in most of them, same for every run
+void AddGeneratedDocuments(SearchServer& search_server, int document_count) {
+    const vector<string> words = {"pet"s, "cat"s, "dog"s, "rat"s, "curly"s, "funny"s, "nasty"s, "hair"s, "tail"s, "eyes"s, "big"s, "john"s};
+    uint32_t state = 12345;
+    for (int id = 0; id < document_count; ++id) {
+        string text = id % 8 == 0 ? "rare"s : "common"s;
+        const int length = 2 + id % 6;
+        for (int i = 0; i < length; ++i) {
+            state = state * 1103515245 + 12345;
+            // smaller of two picks, skewed towards the first words
+            const size_t word = min((state >> 16) % words.size(), (state >> 4) % words.size());
+            text += " "s + words[word];
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 7 - 3});
+    }
+}
+
+// relevance of matching documents by definition, from the forward index
+map<int, double> ComputeRelevanceByDefinition(const SearchServer& search_server, const vector<string>& plus_words,
+                                              const vector<string>& minus_words, QueryMode mode) {
+    map<string, int> document_freqs;
+    for (const int document_id : search_server) {
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) {
+            ++document_freqs[string(word)];
+        }
+    }
+    map<int, double> document_to_relevance;
+    for (const int document_id : search_server) {
+        const auto& word_freqs = search_server.GetWordFrequencies(document_id);
+        bool is_excluded = false;
+        for (const string& word : minus_words) {
+            is_excluded = is_excluded || word_freqs.count(word) != 0;
+        }
+        double relevance = 0.0;
+        size_t matched_words = 0;
+        for (const string& word : plus_words) {
+            if (const auto it = word_freqs.find(word); it != word_freqs.end()) {
+                relevance += it->second * log(search_server.GetDocumentCount() * 1.0 / document_freqs.at(word));
+                ++matched_words;
+            }
+        }
+        if (!is_excluded && matched_words > 0 && (mode == QueryMode::ANY || matched_words == plus_words.size())) {
+            document_to_relevance[document_id] = relevance;
+        }
+    }
+    return document_to_relevance;
+}
+
+// relevances of a top are the highest ones of expected
+void AssertTopOf(const vector<Document>& documents, const map<int, double>& expected) {
+    vector<double> relevances;
+    for (const auto& [_, relevance] : expected) {
+        relevances.push_back(relevance);
+    }
+    sort(relevances.rbegin(), relevances.rend());
+    assert(documents.size() == min<size_t>(relevances.size(), MAX_RESULT_DOCUMENT_COUNT));
+    for (size_t i = 0; i < documents.size(); ++i) {
+        assert(abs(documents[i].relevance - expected.at(documents[i].id)) < 1e-6);
+        assert(abs(documents[i].relevance - relevances[i]) < 1e-6);
+    }
+}
+
+// conjunctive queries return documents containing every plus word
+int TestConjunctiveQueries() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+
+    AssertTopOf(search_server.FindTopDocuments(QueryMode::ALL, "curly cat"s),
+                ComputeRelevanceByDefinition(search_server, {"curly"s, "cat"s}, {}, QueryMode::ALL));
+    AssertTopOf(search_server.FindTopDocuments(QueryMode::ALL, "pet common -dog"s),
+                ComputeRelevanceByDefinition(search_server, {"pet"s, "common"s}, {"dog"s}, QueryMode::ALL));
+    assert(search_server.FindTopDocuments(QueryMode::ALL, "curly unknown"s).empty());
+    for (const Document& document : search_server.FindTopDocuments(QueryMode::ALL, "nasty rat tail"s)) {
+        const auto [words, _] = search_server.MatchDocument("nasty rat tail"s, document.id);
+        assert(words.size() == 3);
+    }
+
+    return 0;
+}
+
+// planned execution, skipped words of most documents among them, gives the exact top
+int TestQueryPlanner() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+
+    for (const QueryMode mode : {QueryMode::ANY, QueryMode::ALL}) {
+        AssertTopOf(search_server.FindTopDocuments(mode, "common john"s),
+                    ComputeRelevanceByDefinition(search_server, {"common"s, "john"s}, {}, mode));
+        AssertTopOf(search_server.FindTopDocuments(mode, "common pet eyes -big"s),
+                    ComputeRelevanceByDefinition(search_server, {"common"s, "pet"s, "eyes"s}, {"big"s}, mode));
+    }
+    const QueryPlan plan = search_server.ExplainQuery("common john"s);
+    assert(plan.terms.size() == 2);
+    assert(plan.estimated_postings <= static_cast<size_t>(search_server.GetDocumentCount()) * 2);
+    assert(search_server.ExplainQuery("unknown"s).strategy == QueryStrategy::EMPTY);
+    cout << plan;
+
+    return 0;
+}
+
+// impact index gives the top by quantized relevance, within the quantization error of the exact one
+int TestImpactIndex() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+    const ImpactIndex impact_index(search_server);
+
+    for (const string& query : {"curly cat"s, "nasty rat -dog"s, "john eyes tail common"s}) {
+        const vector<string> words = SplitIntoWords(query);
+        vector<string> plus_words;
+        vector<string> minus_words;
+        for (const string& word : words) {
+            if (word[0] == '-') {
+                minus_words.push_back(word.substr(1));
+            } else {
+                plus_words.push_back(word);
+            }
+        }
+        const map<int, double> expected = ComputeRelevanceByDefinition(search_server, plus_words, minus_words, QueryMode::ANY);
+        const double max_error = plus_words.size() * impact_index.GetImpactScale() / 2;
+
+        ImpactSearchOptions options;
+        options.top_k = 10;
+        const ImpactSearchResult result = impact_index.FindTopDocuments(query, options);
+        assert(result.is_exact);
+        assert(result.documents.size() == min<size_t>(10, expected.size()));
+        for (const Document& document : result.documents) {
+            assert(abs(document.relevance - expected.at(document.id)) <= max_error + 1e-9);
+        }
+        // no document outside of the top has a clearly higher relevance
+        for (const auto& [document_id, relevance] : expected) {
+            assert(relevance <= result.documents.back().relevance + 2 * max_error + 1e-9
+                   || any_of(result.documents.begin(), result.documents.end(), [document_id = document_id](const Document& document) {
+                          return document.id == document_id;
+                      }));
+        }
+        // same top again, buffers of the previous query are reused
+        assert(impact_index.FindTopDocuments(query, options).documents.size() == result.documents.size());
+
+        options.posting_budget = 3;
+        const ImpactSearchResult partial = impact_index.FindTopDocuments(query, options);
+        assert(partial.scored_postings <= 3);
+        assert(!partial.is_exact || partial.scored_postings < 3);
+    }
+    cout << impact_index.GetPostingCount() << " postings in impact index"s << endl;
+
+    return 0;
+}
+
+// an index built in the computed order finds what the index in id order finds,
+// orders which are not permutations of the server's ids are rejected
+int TestDocumentReordering() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+    const vector<int> identity_order = GetIdentityOrder(search_server);
+    const vector<int> document_order = ComputeDocumentOrder(search_server);
+    CheckDocumentOrder(search_server, document_order);
+    assert(document_order != identity_order);
+
+    const ImpactIndex identity_index(search_server, identity_order);
+    const ImpactIndex reordered_index(search_server, document_order);
+    ImpactSearchOptions options;
+    options.top_k = 10;
+    for (const string& query : {"curly cat"s, "nasty rat -dog"s, "john eyes tail common"s, "rare -pet"s}) {
+        const ImpactSearchResult expected = identity_index.FindTopDocuments(query, options);
+        const ImpactSearchResult result = reordered_index.FindTopDocuments(query, options);
+        assert(result.is_exact == expected.is_exact);
+        assert(result.documents.size() == expected.documents.size());
+        for (size_t i = 0; i < result.documents.size(); ++i) {
+            assert(result.documents[i].id == expected.documents[i].id);
+            assert(result.documents[i].relevance == expected.documents[i].relevance);
+        }
+    }
+
+    const auto is_rejected = [&](const vector<int>& order) {
+        try {
+            CheckDocumentOrder(search_server, order);
+        } catch (const invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    vector<int> order = document_order;
+    order.pop_back();
+    assert(is_rejected(order));
+    order = document_order;
+    order[1] = order[0];
+    assert(is_rejected(order));
+    order = document_order;
+    order[0] = 100'000;
+    assert(is_rejected(order));
+    order = document_order;
+    order.push_back(document_order[0]);
+    assert(is_rejected(order));
+    cout << EstimateCompressedPostingBytes(search_server, document_order) << " bytes of postings in computed order, "s
+         << EstimateCompressedPostingBytes(search_server, identity_order) << " in id order"s << endl;
+    // 597 bytes of postings in computed order, 792 in id order
+
+    return 0;
+}
+
+// every execution mode gives the sequential top
+int TestExecutionModes() {
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 200; ++id) {
+        string text = "pet"s;
+        for (const string& word : {"funny"s, "nasty"s, "curly"s, "rat"s, "hair"s}) {
+            if ((id * 7 + word.size() * 3 + word[0]) % 5 < 2) {
+                text += " "s + word;
+            }
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 4});
+    }
+
+    const string query = "curly funny rat -hair"s;
+    const vector<Document> expected = search_server.FindTopDocuments(execution::seq, query);
+    for (const ExecutionMode mode : {ExecutionMode::SEQUENTIAL, ExecutionMode::PARALLEL_TERMS, ExecutionMode::SHARDED}) {
+        const vector<Document> documents = search_server.FindTopDocuments(mode, query);
+        assert(documents.size() == expected.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            assert(abs(documents[i].relevance - expected[i].relevance) < 1e-6);
+        }
+    }
+    assert(search_server.FindTopDocuments(ADAPTIVE_POLICY, query).size() == expected.size());
+    search_server.RemoveDocument(ADAPTIVE_POLICY, 0);
+    assert(search_server.GetDocumentCount() == 199);
+
+    return 0;
+}
+
+// a batch gives the top of every query searched alone, whatever words its queries share
+int TestFindTopDocumentsBatch() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 600);
+    // sparse ids of other statuses sharing the words of the generated ones
+    const vector<string> words = {"pet"s, "cat"s, "dog"s, "rat"s, "curly"s, "funny"s, "tail"s, "rare"s};
+    for (int id = 1000; id < 1300; id += 3) {
+        const DocumentStatus status = static_cast<DocumentStatus>(id % 4);
+        search_server.AddDocument(id, words[id % 8] + " "s + words[id * 5 % 8] + " common"s, status, {id % 9 - 4});
+    }
+
+    vector<string> queries = {"curly cat -dog"s, "pet rare"s, "common -rare"s, "tail"s, "rat -rat"s, "unknown"s, "funny nasty -hair -eyes"s};
+    const vector<string> query_words = {"pet"s, "cat"s, "dog"s, "rat"s, "curly"s, "funny"s, "nasty"s, "hair"s, "tail"s, "rare"s, "common"s};
+    uint32_t state = 777;
+    for (int i = 0; i < 40; ++i) {
+        string query;
+        const int word_count = 1 + i % 4;
+        for (int k = 0; k < word_count; ++k) {
+            state = state * 1103515245 + 12345;
+            query += (k == 0 ? ""s : (state >> 8) % 4 == 0 ? " -"s : " "s) + query_words[(state >> 16) % query_words.size()];
+        }
+        queries.push_back(query);
+    }
+    const auto is_actual = [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    const auto is_banned = [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::BANNED;
+    };
+    const auto is_positive = [](int document_id, DocumentStatus status, int rating) {
+        return rating > 0;
+    };
+    const auto assert_batch = [&](const auto& document_predicate) {
+        const vector<vector<Document>> sequential = search_server.FindTopDocumentsBatch(queries, document_predicate);
+        const vector<vector<Document>> parallel = search_server.FindTopDocumentsBatch(execution::par, queries, document_predicate);
+        assert(sequential.size() == queries.size() && parallel.size() == queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const vector<Document> expected = search_server.FindTopDocuments(queries[i], document_predicate);
+            for (const vector<Document>* documents : {&sequential[i], &parallel[i]}) {
+                assert(documents->size() == expected.size());
+                // documents tied in relevance and rating come in any order
+                for (size_t k = 0; k < expected.size(); ++k) {
+                    assert((*documents)[k].rating == expected[k].rating);
+                    assert(abs((*documents)[k].relevance - expected[k].relevance) < 1e-6);
+                    if ((*documents)[k].id != expected[k].id) {
+                        // the other document of the tie, scored alone, has the same relevance
+                        const int document_id = (*documents)[k].id;
+                        const vector<Document> alone = search_server.FindTopDocuments(queries[i], [&](int id, DocumentStatus status, int rating) {
+                            return id == document_id && document_predicate(id, status, rating);
+                        });
+                        assert(alone.size() == 1 && abs(alone[0].relevance - expected[k].relevance) < 1e-6);
+                    }
+                }
+            }
+        }
+    };
+    assert_batch(is_actual);
+    assert_batch(is_banned);
+    assert_batch(is_positive);
+
+    return 0;
+}
+
+// queries stop at their budget, queries over the admitted cost are shed after max_queue_wait,
+// admitted cost is released when queries finish and a bad query throws instead of terminating
+int TestAdmissionControl() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 5000);
+    const vector<string> queries = {"pet cat"s, "curly dog -rare"s, "common"s, "john"s};
+    const size_t common_cost = search_server.EstimateQueryCost("common"s);
+
+    AdmissionController admission(common_cost * 10);
+    const auto limited = ProcessQueries(search_server, queries, admission, chrono::seconds(10), 100);
+    for (const auto& result : limited) {
+        assert(result && result->scored_postings <= 100);
+    }
+    assert(limited[2]->is_partial);
+    const auto timed_out = ProcessQueries(search_server, queries, admission, chrono::seconds(0));
+    for (const auto& result : timed_out) {
+        assert(result && result->is_partial && result->documents.empty());
+    }
+    const auto complete = ProcessQueries(search_server, queries, admission, chrono::seconds(10));
+    for (size_t i = 0; i < queries.size(); ++i) {
+        assert(complete[i] && !complete[i]->is_partial);
+        assert(complete[i]->documents.size() == search_server.FindTopDocuments(queries[i]).size());
+    }
+    assert(admission.GetInflightCost() == 0);
+    assert(admission.GetAdmittedCount() == 3 * queries.size());
+    assert(admission.GetShedCount() == 0);
+
+    // a running query holds the whole limit, so "common" waits and is shed, cheap ones still fit
+    AdmissionController busy_admission(common_cost, chrono::milliseconds(20));
+    AdmissionController::Ticket running = busy_admission.Admit(common_cost - 10);
+    assert(running && busy_admission.GetInflightCost() == common_cost - 10);
+    const auto start = chrono::steady_clock::now();
+    const auto shed = ProcessQueries(search_server, {"common"s, "unknown"s}, busy_admission, chrono::seconds(10));
+    assert(chrono::steady_clock::now() - start >= chrono::milliseconds(20));
+    assert(!shed[0] && shed[1]);
+    assert(busy_admission.GetShedCount() == 1);
+    assert(busy_admission.GetInflightCost() == common_cost - 10);
+    running.Release();
+    assert(busy_admission.GetInflightCost() == 0);
+    // nothing runs, so a query over the limit is admitted
+    assert(ProcessQueries(search_server, {"common pet"s}, busy_admission, chrono::seconds(10))[0]);
+
+    bool is_rejected = false;
+    try {
+        ProcessQueries(search_server, {"cat"s, "cat --dog"s}, admission, chrono::seconds(10));
+    } catch (const invalid_argument&) {
+        is_rejected = true;
+    }
+    assert(is_rejected && admission.GetAdmittedCount() == 3 * queries.size());
+    is_rejected = false;
+    try {
+        ProcessQueries(search_server, {"cat"s, "cat --dog"s});
+    } catch (const invalid_argument&) {
+        is_rejected = true;
+    }
+    assert(is_rejected);
+
+    return 0;
+}
+
+// percentiles are within the sub-bucket error, only requests started within the window count,
+// records of exited threads still count and qps of an overwritten ring is taken over its records
+int TestRequestStatistics() {
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value);
+    }
+    assert(histogram.GetCount() == 1000 && histogram.GetMax() == 1000);
+    const double error = 1.0 / LatencyHistogram::SUB_BUCKET_COUNT;
+    for (const auto& [percentile, expected] : {pair{50.0, 500.0}, pair{90.0, 900.0}, pair{99.0, 990.0}}) {
+        const double value = static_cast<double>(histogram.GetPercentile(percentile));
+        assert(value >= expected && value <= expected * (1 + error));
+    }
+    assert(histogram.GetPercentile(100) == 1000 && histogram.GetPercentile(0) == 1);
+
+    using Clock = RequestStatistics::Clock;
+    RequestStatistics stats;
+    const Clock::time_point now = Clock::now();
+    for (int i = 0; i < 10; ++i) {
+        stats.Record(now - chrono::minutes(5), chrono::milliseconds(100), 1);
+    }
+    for (int i = 0; i < 20; ++i) {
+        stats.Record(now - chrono::milliseconds(i), chrono::microseconds(i < 10 ? 10 : 1000), i % 2);
+    }
+    const RequestStatsSnapshot recent = stats.GetSnapshot(chrono::seconds(10));
+    assert(recent.is_complete && recent.requests == 20 && recent.empty_requests == 10 && recent.total_hits == 10);
+    assert(recent.p50_ns >= 10'000 && recent.p50_ns < 11'000);
+    assert(recent.p90_ns >= 1'000'000 && recent.max_ns == 1'000'000);
+    assert(abs(recent.qps - 2.0) < 0.1);
+    const RequestStatsSnapshot all = stats.GetSnapshot(chrono::minutes(10));
+    assert(all.requests == 30 && all.max_ns == 100'000'000);
+    assert(stats.GetSnapshot(chrono::seconds(0)).requests == 0);
+
+    for (int i = 0; i < 4; ++i) {
+        thread([&stats, now] {
+            stats.Record(now, chrono::microseconds(10), 1);
+        }).join();
+    }
+    assert(stats.GetSnapshot(chrono::seconds(10)).requests == 24);
+
+    // 16 records of the last 16 ms are kept from 100, qps is 1000 over them, not 1.6 over the window
+    RequestStatistics small_stats(16);
+    const Clock::time_point small_now = Clock::now();
+    for (int i = 99; i >= 0; --i) {
+        small_stats.Record(small_now - chrono::milliseconds(i), chrono::microseconds(10), 1);
+    }
+    const RequestStatsSnapshot overwritten = small_stats.GetSnapshot(chrono::seconds(10));
+    assert(!overwritten.is_complete && overwritten.requests == 16);
+    assert(overwritten.qps > 100);
+
+    // a thread exiting after the instance is gone doesn't touch it
+    atomic<bool> is_recorded = false;
+    atomic<bool> is_destroyed = false;
+    thread writer;
+    {
+        RequestStatistics short_lived_stats;
+        writer = thread([&] {
+            short_lived_stats.Record(Clock::now(), chrono::microseconds(10), 1);
+            is_recorded = true;
+            while (!is_destroyed) {
+                this_thread::yield();
+            }
+        });
+        while (!is_recorded) {
+            this_thread::yield();
+        }
+    }
+    is_destroyed = true;
+    writer.join();
+
+    return 0;
+}
+
+// responses of pipelined requests come in request order, a client which doesn't read stops
+// being read, and a half-closed connection gets all its responses without waking the loop
+int TestSearchService() {
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 2000; ++id) {
+        search_server.AddDocument(id, "cat dog pet number"s + to_string(id % 50), DocumentStatus::ACTUAL, {1});
+    }
+    ServiceOptions options;
+    options.port = 0;
+    options.max_unsent_output = 8 << 20;
+    SearchService service(search_server, options);
+    thread server_thread([&service] {
+        service.Run();
+    });
+    const auto connect_client = [&service](int receive_buffer) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (receive_buffer > 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        }
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(service.GetPort());
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        assert(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        return fd;
+    };
+    // lines until the peer closes or the last line starts with `last`
+    const auto read_lines = [](int fd, string_view last) {
+        vector<string> lines;
+        string buffer;
+        char chunk[1 << 16];
+        while (lines.empty() || lines.back().compare(0, last.size(), last) != 0) {
+            const ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+            if (count <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(count));
+            for (size_t end = buffer.find('\n'); end != string::npos; end = buffer.find('\n')) {
+                lines.push_back(buffer.substr(0, end));
+                buffer.erase(0, end + 1);
+            }
+        }
+        return lines;
+    };
+
+    const int client = connect_client(0);
+    const string pipelined = "PING\nFIND number3\nBOGUS\nFIND cat --dog\nSTATS\n"s;
+    assert(send(client, pipelined.data(), pipelined.size(), 0) == static_cast<ssize_t>(pipelined.size()));
+    const vector<string> lines = read_lines(client, "STATS"sv);
+    assert(lines.size() == 10);
+    assert(lines[0] == "PONG"s);
+    for (size_t i = 1; i <= 5; ++i) {
+        assert(lines[i].compare(0, 4, "DOC "s) == 0 && stoi(lines[i].substr(4)) % 50 == 3);
+    }
+    assert(lines[6] == "END 5"s);
+    assert(lines[7] == "ERR unknown command"s);
+    assert(lines[8].compare(0, 4, "ERR "s) == 0);
+    assert(lines[9].compare(0, 6, "STATS "s) == 0);
+    close(client);
+
+    // requests are sent until the server stops reading them
+    const int slow_client = connect_client(4096);
+    fcntl(slow_client, F_SETFL, O_NONBLOCK);
+    string requests;
+    for (int i = 0; i < 50; ++i) {
+        requests += "FIND number"s + to_string(i) + "\n"s;
+    }
+    size_t sent = 0;
+    for (int idle = 0; idle < 20 && sent < (size_t(1) << 30);) {
+        const size_t offset = sent % requests.size();
+        const ssize_t count = send(slow_client, requests.data() + offset, requests.size() - offset, 0);
+        if (count > 0) {
+            sent += static_cast<size_t>(count);
+            idle = 0;
+        } else {
+            this_thread::sleep_for(chrono::milliseconds(5));
+            ++idle;
+        }
+    }
+    assert(sent < (size_t(1) << 30));
+    // a torn last line is not a request
+    const size_t request_count = sent / requests.size() * 50
+                                 + count(requests.begin(), requests.begin() + sent % requests.size(), '\n');
+    shutdown(slow_client, SHUT_WR);
+    fcntl(slow_client, F_SETFL, 0);
+    const auto count_responses = [&read_lines](int fd) {
+        size_t response_count = 0;
+        int expected_number = 0;
+        for (const string& line : read_lines(fd, "\n"sv)) {
+            if (line.compare(0, 4, "END "s) == 0) {
+                ++response_count;
+                expected_number = (expected_number + 1) % 50;
+            } else {
+                assert(line.compare(0, 4, "DOC "s) == 0 && stoi(line.substr(4)) % 50 == expected_number);
+            }
+        }
+        return response_count;
+    };
+    const size_t response_count = count_responses(slow_client);
+    assert(response_count == request_count);
+    close(slow_client);
+
+    // requests fit in the socket, so the server reads them to the end of input,
+    // their responses don't and the client doesn't read for a while
+    const int closing_client = connect_client(4096);
+    string closing_requests;
+    for (int i = 0; i < 400; ++i) {
+        closing_requests += requests;
+    }
+    assert(send(closing_client, closing_requests.data(), closing_requests.size(), 0) == static_cast<ssize_t>(closing_requests.size()));
+    shutdown(closing_client, SHUT_WR);
+    clockid_t server_clock;
+    pthread_getcpuclockid(server_thread.native_handle(), &server_clock);
+    const auto get_server_time = [&server_clock] {
+        timespec time{};
+        clock_gettime(server_clock, &time);
+        return chrono::seconds(time.tv_sec) + chrono::nanoseconds(time.tv_nsec);
+    };
+    // the server serves the requests it has read, then it waits for the client without spinning
+    bool is_idle = false;
+    for (int attempt = 0; attempt < 50 && !is_idle; ++attempt) {
+        const auto start = get_server_time();
+        this_thread::sleep_for(chrono::milliseconds(100));
+        is_idle = get_server_time() - start < chrono::milliseconds(10);
+    }
+    assert(is_idle);
+    assert(count_responses(closing_client) == 400 * 50);
+    close(closing_client);
+
+    service.Stop();
+    server_thread.join();
+    cout << response_count << " pipelined responses in order"s << endl;
+
+    return 0;
+}
+
+// changes survive reopening, a torn tail of the log is cut off, rejected changes are not logged
+int TestDurableSearchServer() {
+    char directory_template[] = "/tmp/search_server_test_XXXXXX";
+    const string directory = mkdtemp(directory_template);
+    WalOptions options;
+    options.sync = false;
+    {
+        DurableSearchServer search_server(directory, "and with"s, options);
+        vector<thread> writers;
+        for (int writer = 0; writer < 4; ++writer) {
+            writers.emplace_back([&search_server, writer] {
+                for (int i = 0; i < 25; ++i) {
+                    search_server.AddDocument(writer * 100 + i, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {writer});
+                }
+            });
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+        search_server.RemoveDocument(0);
+        try {
+            search_server.AddDocument(1, "duplicate id"s, DocumentStatus::ACTUAL, {});
+            assert(false);
+        } catch (const invalid_argument&) {
+        }
+        try {
+            search_server.AddDocument(1000, "bad \x01 word"s, DocumentStatus::ACTUAL, {});
+            assert(false);
+        } catch (const invalid_argument&) {
+        }
+        // removed id can be added again
+        search_server.AddDocument(0, "curly hair"s, DocumentStatus::ACTUAL, {});
+        assert(search_server.GetWalStats().records == 102);
+        assert(search_server.Read([](const SearchServer& index) {
+            return index.GetDocumentCount();
+        }) == 100);
+    }
+    // half of a record, as left by a crash during a write
+    {
+        ofstream wal(directory + "/wal"s, ios::binary | ios::app);
+        wal.write("\x20\x00\x00\x00\x01\x02", 6);
+    }
+    {
+        DurableSearchServer search_server(directory, "and with"s, options);
+        assert(search_server.GetRecoveryStats().replayed_records == 102);
+        assert(search_server.GetRecoveryStats().discarded_bytes == 6);
+        assert(search_server.Read([](const SearchServer& index) {
+            return index.FindTopDocuments("curly"s).size();
+        }) == 1);
+        search_server.Checkpoint();
+        search_server.RemoveDocument(1);
+    }
+    {
+        DurableSearchServer search_server(directory, "and with"s, options);
+        assert(search_server.GetRecoveryStats().snapshot_documents == 100);
+        assert(search_server.GetRecoveryStats().replayed_records == 1);
+        assert(search_server.Read([](const SearchServer& index) {
+            return index.GetDocumentCount();
+        }) == 99);
+        cout << search_server.GetRecoveryStats().snapshot_documents << " documents recovered from snapshot"s << endl;
+        // 100 documents recovered from snapshot
+    }
+    remove((directory + "/wal"s).c_str());
+    remove((directory + "/snapshot"s).c_str());
+    remove(directory.c_str());
+
+    return 0;
+}
+
+// a failed write of the log fails every later commit, nothing after a torn group is applied
+int TestWriteAheadLogFailure() {
+    char directory_template[] = "/tmp/search_server_test_XXXXXX";
+    const string directory = mkdtemp(directory_template);
+    const string wal_path = directory + "/wal"s;
+    // writes past the file size limit fail with EFBIG instead of killing the process
+    const auto previous_handler = signal(SIGXFSZ, SIG_IGN);
+    rlimit previous_limit;
+    getrlimit(RLIMIT_FSIZE, &previous_limit);
+    {
+        DurableSearchServer search_server(directory, "and with"s);
+        search_server.AddDocument(1, "funny pet"s, DocumentStatus::ACTUAL, {1});
+        struct stat wal_stat;
+        assert(stat(wal_path.c_str(), &wal_stat) == 0);
+        // a few bytes of the next record fit, the rest of it is lost
+        rlimit limit = previous_limit;
+        limit.rlim_cur = static_cast<rlim_t>(wal_stat.st_size) + 10;
+        setrlimit(RLIMIT_FSIZE, &limit);
+        for (const int document_id : {2, 3}) {
+            try {
+                search_server.AddDocument(document_id, "nasty rat"s, DocumentStatus::ACTUAL, {2});
+                assert(false);
+            } catch (const runtime_error&) {
+            }
+            // the limit is gone, yet the log stays failed
+            setrlimit(RLIMIT_FSIZE, &previous_limit);
+        }
+        assert(search_server.Read([](const SearchServer& index) {
+            return index.GetDocumentCount();
+        }) == 1);
+    }
+    signal(SIGXFSZ, previous_handler);
+    {
+        DurableSearchServer search_server(directory, "and with"s);
+        assert(search_server.GetRecoveryStats().replayed_records == 1);
+        assert(search_server.GetRecoveryStats().discarded_bytes == 10);
+    }
+    remove(wal_path.c_str());
+    remove((directory + "/snapshot"s).c_str());
+    remove(directory.c_str());
+
+    return 0;
+}
+
+// frozen image gives the results of the server it was built from, generations go up
+int TestFrozenIndex() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 300);
+    search_server.AddDocument(1000, "curly cat with big eyes"s, DocumentStatus::BANNED, {5});
+    search_server.AddDocument(1001, "tilde cat~"s, DocumentStatus::ACTUAL, {5});
+    char path_template[] = "/tmp/frozen_index_test_XXXXXX";
+    const int fd = mkstemp(path_template);
+    assert(fd >= 0);
+    close(fd);
+    const string path = path_template;
+    remove(path.c_str());
+
+    assert(WriteFrozenIndex(search_server, path) == 1);
+    const MappedFrozenIndex mapped_index(path);
+    const FrozenIndexView& frozen_index = mapped_index.GetView();
+    assert(frozen_index.GetDocumentCount() == search_server.GetDocumentCount());
+    for (const string& query : {"curly cat"s, "nasty rat -dog"s, "common john eyes"s, "unknown"s, "c* -do*"s, "ca* -cu*"s}) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            const vector<Document> expected = search_server.FindTopDocuments(query, status);
+            const vector<Document> documents = frozen_index.FindTopDocuments(query, status);
+            assert(documents.size() == expected.size());
+            for (size_t i = 0; i < documents.size(); ++i) {
+                assert(documents[i].id == expected[i].id);
+                assert(documents[i].relevance == expected[i].relevance);
+            }
+        }
+        for (const int document_id : {1, 2, 1000}) {
+            const auto [words, status] = frozen_index.MatchDocument(query, document_id);
+            const auto [expected_words, expected_status] = search_server.MatchDocument(query, document_id);
+            assert(words == expected_words && status == expected_status);
+        }
+    }
+    // no fuzzy matching, '~' is a part of the word like in SearchServer without it
+    assert(frozen_index.FindTopDocuments("cat~"s).size() == 1);
+    for (const string& query : {"cat~"s, "cat~1 -dog~"s, "curly cat~"s}) {
+        const vector<Document> documents = frozen_index.FindTopDocuments(query);
+        const vector<Document> expected = search_server.FindTopDocuments(query);
+        assert(documents.size() == expected.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            assert(documents[i].id == expected[i].id && documents[i].relevance == expected[i].relevance);
+        }
+    }
+    assert(WriteFrozenIndex(search_server, path) == 2);
+    remove(path.c_str());
+
+    return 0;
+}
+
+// prefix terms expand to the most frequent indexed words starting with the prefix
+int TestPrefixQueries() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+    search_server.AddDocument(1000, "cattle catalog"s, DocumentStatus::ACTUAL, {1});
+
+    const vector<string_view> words = search_server.FindWordsByPrefix("c"s);
+    assert((words == vector<string_view>{"common"sv, "cat"sv, "curly"sv, "catalog"sv, "cattle"sv}));
+    assert(search_server.FindWordsByPrefix("cat"s, 2).size() == 2);
+    assert(search_server.FindWordsByPrefix("x"s).empty());
+    AssertTopOf(search_server.FindTopDocuments("cat* -cu*"s),
+                ComputeRelevanceByDefinition(search_server, {"cat"s, "catalog"s, "cattle"s}, {"curly"s}, QueryMode::ANY));
+    // words of removed documents are not expanded to
+    search_server.RemoveDocument(1000);
+    assert((search_server.FindWordsByPrefix("cat"s) == vector<string_view>{"cat"sv}));
+    cout << words.size() << " words for c*"s << endl;
+    // 5 words for c*
+
+    return 0;
+}
+
+// top of a head term stays exact while its cached candidates are removed and outranked
+int TestHeadTermCache() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 2000);
+
+    for (int round = 0; round < 4; ++round) {
+        const vector<Document> top = search_server.FindTopDocuments("common"s);
+        AssertTopOf(top, ComputeRelevanceByDefinition(search_server, {"common"s}, {}, QueryMode::ANY));
+        search_server.RemoveDocument(top[0].id);
+        search_server.RemoveDocuments({top[1].id, top[2].id});
+    }
+    search_server.AddDocument(3000, "common common pet"s, DocumentStatus::ACTUAL, {1});
+    const vector<Document> top = search_server.FindTopDocuments("common"s);
+    assert(top[0].id == 3000);
+    AssertTopOf(top, ComputeRelevanceByDefinition(search_server, {"common"s}, {}, QueryMode::ANY));
+    assert(search_server.FindTopDocuments("common"s, DocumentStatus::BANNED).empty());
+    cout << search_server.GetDocumentCount() << " documents after removals from the head term top"s << endl;
+    // 1989 documents after removals from the head term top
+
+    // an entry handed out stays as it was while the cache changes
+    HeadTermCache cache(4, 2);
+    assert(cache.IsEmpty() && !cache.Find("cat"s, DocumentStatus::ACTUAL));
+    cache.Build("cat"s, DocumentStatus::ACTUAL, {{1, 0.5, 0}, {2, 0.25, 0}});
+    const auto entry = cache.Find("cat"s, DocumentStatus::ACTUAL);
+    cache.AddPosting("cat"s, DocumentStatus::ACTUAL, {3, 0.75, 0});
+    cache.AddPosting("dog"s, DocumentStatus::ACTUAL, {3, 0.75, 0});
+    cache.RemovePosting("cat"s, DocumentStatus::ACTUAL, 1);
+    assert(entry->candidates.size() == 2 && entry->candidates[0].document_id == 1);
+    const auto updated = cache.Find("cat"s, DocumentStatus::ACTUAL);
+    assert(updated->candidates.size() == 2 && updated->candidates[0].document_id == 3);
+    assert(!cache.Find("cat"s, DocumentStatus::BANNED) && !cache.Find("dog"s, DocumentStatus::ACTUAL));
+    cache.Clear();
+    assert(cache.IsEmpty() && !cache.Find("cat"s, DocumentStatus::ACTUAL));
+
+    return 0;
+}
+
+// bulk removal erases words left without postings, sequential and parallel alike
+int TestRemoveDocuments() {
+    for (const bool is_parallel : {false, true}) {
+        SearchServer search_server("and with"s);
+        AddGeneratedDocuments(search_server, 300);
+        search_server.AddDocument(1000, "zebra zeal cat"s, DocumentStatus::ACTUAL, {1});
+        search_server.AddDocument(1001, "zebra and cat"s, DocumentStatus::BANNED, {2});
+
+        const size_t postings_of_5 = search_server.GetWordFrequencies(5).size();
+        const vector<int> document_ids = {5, 1000, 1001, 5000};
+        const RemovalStatistics statistics = is_parallel ? search_server.RemoveDocuments(execution::par, document_ids)
+                                                         : search_server.RemoveDocuments(execution::seq, document_ids);
+        assert(statistics.removed_documents == 3);
+        assert(statistics.erased_words == 2);
+        assert(statistics.removed_postings == postings_of_5 + 5);
+        assert(search_server.GetDocumentCount() == 299);
+        assert(search_server.FindWordsByPrefix("ze"s).empty());
+        assert(search_server.FindTopDocuments("zebra"s).empty());
+        AssertTopOf(search_server.FindTopDocuments("cat pet -dog"s),
+                    ComputeRelevanceByDefinition(search_server, {"cat"s, "pet"s}, {"dog"s}, QueryMode::ANY));
+        // erased words are indexed again from the text of a new document
+        search_server.AddDocument(1002, "zebra"s, DocumentStatus::ACTUAL, {3});
+        assert(search_server.FindTopDocuments("zebra"s).at(0).id == 1002);
+        if (is_parallel) {
+            cout << statistics.erased_words << " words erased with "s << statistics.removed_documents << " documents"s << endl;
+            // 2 words erased with 3 documents
+        }
+    }
+
+    return 0;
+}
+
+// facets count every document matching the query, the predicate only selects the top
+int TestFacets() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+    search_server.AddDocument(1000, "curly cat"s, DocumentStatus::BANNED, {-7});
+    search_server.AddDocument(1001, "nasty cat"s, DocumentStatus::REMOVED, {9});
+
+    const map<int, double> matched = ComputeRelevanceByDefinition(search_server, {"cat"s, "curly"s}, {"dog"s}, QueryMode::ANY);
+    FacetCounts expected;
+    expected.total_matches = matched.size();
+    for (const auto& [document_id, _] : matched) {
+        ++expected.by_status[static_cast<size_t>(search_server.GetDocumentStatus(document_id))];
+        const int rating = search_server.GetDocumentRating(document_id);
+        // buckets of 3 ratings starting at multiples of 3
+        ++expected.by_rating[rating - ((rating % 3) + 3) % 3];
+    }
+    for (const bool is_parallel : {false, true}) {
+        const FacetedResult result = is_parallel ? search_server.FindTopDocumentsWithFacets(execution::par, "cat curly -dog"s, DocumentStatus::ACTUAL, 3)
+                                                 : search_server.FindTopDocumentsWithFacets("cat curly -dog"s, DocumentStatus::ACTUAL, 3);
+        assert(result.facets.total_matches == expected.total_matches);
+        assert(result.facets.by_status == expected.by_status);
+        assert(result.facets.by_rating == expected.by_rating);
+        assert(result.documents.size() == search_server.FindTopDocuments("cat curly -dog"s).size());
+        for (const Document& document : result.documents) {
+            assert(document.id < 1000);
+        }
+    }
+    cout << expected.total_matches << " matches in "s << expected.by_rating.size() << " rating buckets"s << endl;
+    // 202 matches in 5 rating buckets
+
+    return 0;
+}
+
+// scoring policies rank by their own relevance, document lengths of BM25 survive a snapshot
+int TestScoringPolicies() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+
+    const string query = "curly cat -dog"s;
+    const vector<Document> expected = search_server.FindTopDocuments(query);
+    const vector<Document> tf_idf = search_server.FindTopDocuments(TF_IDF_SCORING, query);
+    assert(tf_idf.size() == expected.size());
+    for (size_t i = 0; i < tf_idf.size(); ++i) {
+        assert(abs(tf_idf[i].relevance - expected[i].relevance) < 1e-6);
+    }
+    const vector<Document> bm25 = search_server.FindTopDocuments(BM25_SCORING, query);
+    assert(bm25.size() == expected.size());
+    assert(is_sorted(bm25.begin(), bm25.end(), IsRankedBefore));
+
+    stringstream snapshot;
+    search_server.SaveSnapshot(snapshot);
+    SearchServer loaded_server("and with"s);
+    loaded_server.LoadSnapshot(snapshot);
+    const vector<Document> loaded_bm25 = loaded_server.FindTopDocuments(BM25_SCORING, query);
+    assert(loaded_bm25.size() == bm25.size());
+    for (size_t i = 0; i < bm25.size(); ++i) {
+        assert(loaded_bm25[i].id == bm25[i].id && loaded_bm25[i].relevance == bm25[i].relevance);
+    }
+    // batch and facets evaluate the policy with their own engines
+    const vector<Document> batch_bm25 = search_server.FindTopDocumentsBatch(BM25_SCORING, {query}, [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL;
+    })[0];
+    const FacetedResult faceted_bm25 = search_server.FindTopDocumentsWithFacets(BM25_SCORING, query, [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL;
+    });
+    for (const vector<Document>* documents : {&batch_bm25, &faceted_bm25.documents}) {
+        assert(documents->size() == bm25.size());
+        for (size_t i = 0; i < bm25.size(); ++i) {
+            assert((*documents)[i].id == bm25[i].id && abs((*documents)[i].relevance - bm25[i].relevance) < 1e-6);
+        }
+    }
+    cout << bm25.size() << " documents ranked by BM25"s << endl;
+    // 5 documents ranked by BM25
+
+    // BM25 by definition, postings of the query cover the id range, so the dense engine is used
+    SearchServer small_server("and with"s);
+    small_server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {1});
+    small_server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {2});
+    small_server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {3});
+    small_server.AddDocument(4, "groomed starling eugene"s, DocumentStatus::ACTUAL, {4});
+    const double average_length = 15.0 / 4;
+    const auto bm25_of = [&](double count, double length, double document_freq) {
+        const double k1 = 1.2;
+        const double b = 0.75;
+        return log(1.0 + (4 - document_freq + 0.5) / (document_freq + 0.5))
+               * count * (k1 + 1.0) / (count + k1 * (1.0 - b + b * length / average_length));
+    };
+    const map<int, double> expected_bm25 = {
+        {1, bm25_of(1, 4, 2)},
+        {2, bm25_of(2, 4, 1) + bm25_of(1, 4, 2)},
+        {3, bm25_of(1, 4, 2)},
+        {4, bm25_of(1, 3, 2)},
+    };
+    const vector<Document> small_bm25 = small_server.FindTopDocuments(BM25_SCORING, "fluffy groomed cat"s);
+    assert(small_bm25.size() == expected_bm25.size());
+    for (const Document& document : small_bm25) {
+        assert(abs(document.relevance - expected_bm25.at(document.id)) < 1e-6);
+    }
+
+    return 0;
+}
+
+// every supported level gives the results of the scalar kernels, also for counts
+// which are not multiples of the vector width, and keeps near ties of the count-th value
+int TestSimdKernels() {
+    const SimdLevel initial_level = GetSimdLevel();
+    const double tolerance = SearchServer::RELEVANCE_TOLERANCE;
+    struct Results {
+        vector<double> accumulators;
+        vector<uint32_t> filtered;
+        vector<uint32_t> top;
+    };
+    const auto run_kernels = [&](size_t size) {
+        // few distinct values, some of them closer than tolerance, so ties cross the count-th value
+        vector<double> values(size);
+        vector<uint8_t> states(size);
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = static_cast<double>(i * 37 % 11) + static_cast<double>(i % 3) * tolerance / 4;
+            states[i] = static_cast<uint8_t>(i * 7 % 3);
+        }
+        Results results;
+        results.accumulators = values;
+        vector<uint32_t> ordinals;
+        vector<double> contributions;
+        for (size_t i = 0; i < size; i += 2) {
+            ordinals.push_back(static_cast<uint32_t>(size - 1 - i));
+            contributions.push_back(0.1 * static_cast<double>(i));
+        }
+        ScatterAdd(results.accumulators.data(), ordinals.data(), contributions.data(), ordinals.size());
+        FilterAboveThreshold(values.data(), states.data(), 1, size / 3, size, 5.0, results.filtered);
+        results.top = SelectTopCandidates(values.data(), states.data(), 1, size, MAX_RESULT_DOCUMENT_COUNT, tolerance);
+
+        vector<double> matched;
+        for (size_t i = 0; i < size; ++i) {
+            if (states[i] == 1) {
+                matched.push_back(values[i]);
+            }
+        }
+        sort(matched.begin(), matched.end(), greater<double>());
+        for (size_t i = 0; i < size; ++i) {
+            const bool is_candidate = states[i] == 1
+                                      && (matched.size() <= MAX_RESULT_DOCUMENT_COUNT
+                                          || values[i] >= matched[MAX_RESULT_DOCUMENT_COUNT - 1] - tolerance);
+            if (is_candidate) {
+                assert(binary_search(results.top.begin(), results.top.end(), static_cast<uint32_t>(i)));
+            }
+        }
+        assert(is_sorted(results.top.begin(), results.top.end()));
+        return results;
+    };
+    const vector<size_t> sizes = {0, 1, 3, 4, 5, 7, 8, 9, 13, 16, 17, 31, 33, 63, 65, 100, 1003};
+    for (const size_t size : sizes) {
+        SetSimdLevel(SimdLevel::SCALAR);
+        const Results expected = run_kernels(size);
+        for (const SimdLevel level : {SimdLevel::AVX2, SimdLevel::AVX512}) {
+            if (level > GetSupportedSimdLevel()) {
+                continue;
+            }
+            SetSimdLevel(level);
+            const Results results = run_kernels(size);
+            assert(results.accumulators == expected.accumulators);
+            assert(results.filtered == expected.filtered);
+            assert(results.top == expected.top);
+        }
+    }
+    SetSimdLevel(initial_level);
+    cout << "kernels of "s << GetSimdLevelName(GetSupportedSimdLevel()) << " match scalar ones"s << endl;
+    // kernels of avx512 match scalar ones (avx2 or scalar on other cpus)
+
+    return 0;
+}
+
+// hot queries are ordered by count, then by first appearance; progress counts every replayed query
+int TestQueryLogWarmUp() {
+    istringstream log_stream("cat\ndog\n\ncat\nrat\ndog\ncat\nbird\nrat\nfox\ncat -\n"s);
+    const vector<string> query_log = ReadQueryLog(log_stream);
+    assert(query_log.size() == 10);
+    assert((SelectHotQueries(query_log, 10) == vector<string>{"cat"s, "dog"s, "rat"s, "bird"s, "fox"s, "cat -"s}));
+    assert((SelectHotQueries(query_log, 4) == vector<string>{"cat"s, "dog"s, "rat"s, "bird"s}));
+    assert(SelectHotQueries(query_log, 0).empty());
+
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 300);
+    WarmUpOptions options;
+    options.thread_count = 2;
+    QueryLogWarmUp warm_up(search_server, query_log, options);
+    WarmUpProgress progress = warm_up.GetProgress();
+    assert(progress.total_queries == 6 && progress.replayed_queries == 0 && !progress.is_ready);
+    assert(progress.elapsed.count() == 0);
+    // waiting without a start starts the warm-up
+    warm_up.Wait();
+    progress = warm_up.GetProgress();
+    assert(progress.is_ready && warm_up.IsReady());
+    assert(progress.replayed_queries == 6 && progress.failed_queries == 1 && progress.prefetched_bytes == 0);
+    assert(progress.elapsed.count() > 0);
+    warm_up.Run();
+    assert(warm_up.GetProgress().replayed_queries == 6);
+
+    char path_template[] = "/tmp/warm_up_test_XXXXXX";
+    const int fd = mkstemp(path_template);
+    assert(fd >= 0);
+    close(fd);
+    const string path = path_template;
+    remove(path.c_str());
+    WriteFrozenIndex(search_server, path);
+    {
+        const MappedFrozenIndex mapped_index(path);
+        QueryLogWarmUp frozen_warm_up(mapped_index.GetView(), query_log, options);
+        assert(frozen_warm_up.WaitFor(chrono::seconds(10)));
+        progress = frozen_warm_up.GetProgress();
+        assert(progress.replayed_queries == 6 && progress.failed_queries == 1 && progress.prefetched_bytes > 0);
+        cout << progress.replayed_queries << " hot queries replayed, "s << progress.failed_queries << " failed"s << endl;
+        // 6 hot queries replayed, 1 failed
+    }
+    remove(path.c_str());
+
+    return 0;
+}
+
+// replicas of every node answer like a frozen index, each query is counted on one node
+int TestNumaReplicatedIndex() {
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+    const vector<char> image = BuildFrozenIndex(search_server);
+    const FrozenIndexView frozen_index(image.data(), image.size());
+    const vector<string> distinct_queries = {"curly cat"s, "nasty rat -dog"s, "common john eyes"s, "unknown"s, "c* -do*"s};
+    vector<string> queries;
+    for (size_t i = 0; i < 200; ++i) {
+        queries.push_back(distinct_queries[i % distinct_queries.size()]);
+    }
+
+    const NumaTopology simulated = SimulateNumaTopology(2);
+    assert(simulated.nodes.size() == 2 && simulated.is_simulated);
+    const NumaTopology parsed = ParseNumaTopology("0;0"s);
+    assert(parsed.nodes.size() == 2 && parsed.nodes[0].cpus == vector<int>{0} && parsed.nodes[1].cpus == vector<int>{0});
+    for (const NumaTopology& topology : {simulated, parsed}) {
+        NumaReplicatedIndex numa_index(search_server, topology);
+        assert(numa_index.GetReplicaBytes() == image.size());
+        for (const size_t workers_per_node : {0, 1, 3}) {
+            numa_index.ResetNodeStatistics();
+            const vector<vector<Document>> results = numa_index.ProcessQueries(queries, workers_per_node);
+            assert(results.size() == queries.size());
+            for (size_t i = 0; i < queries.size(); ++i) {
+                const vector<Document> expected = frozen_index.FindTopDocuments(queries[i]);
+                assert(results[i].size() == expected.size());
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    assert(results[i][j].id == expected[j].id && results[i][j].relevance == expected[j].relevance);
+                }
+            }
+            const vector<NumaNodeStatistics> statistics = numa_index.GetNodeStatistics();
+            assert(statistics.size() == 2);
+            size_t query_count = 0;
+            for (const NumaNodeStatistics& node_statistics : statistics) {
+                query_count += node_statistics.queries;
+            }
+            assert(query_count == queries.size());
+        }
+    }
+    cout << queries.size() << " queries answered by replicas of 2 nodes"s << endl;
+    // 200 queries answered by replicas of 2 nodes
+
+    return 0;
+}
+
+// records are cut at line ends with CRLF, a missing last line end and windows shorter than a line
+int TestBulkLoader() {
+    assert((SplitLines("a\r\nb\n\nc"s) == vector<string_view>{"a"sv, "b"sv, ""sv, "c"sv}));
+    assert((SplitLines("a\n"s) == vector<string_view>{"a"sv}));
+    assert(SplitLines(""s).empty());
+
+    char path_template[] = "/tmp/bulk_loader_test_XXXXXX";
+    const int fd = mkstemp(path_template);
+    assert(fd >= 0);
+    close(fd);
+    const string path = path_template;
+    const auto write_file = [&path](const string& content) {
+        ofstream(path, ios::binary | ios::trunc) << content;
+    };
+
+    // ids go on from first_id across windows, a window of 4 bytes holds one line at most
+    write_file("alpha cat\r\nbeta cat\nlong gamma cat\r\ndelta\nepsilon cat"s);
+    for (const size_t window_bytes : {size_t(4), size_t(20), size_t(64) << 20}) {
+        SearchServer search_server("and with"s);
+        BulkLoadOptions options;
+        options.first_id = 100;
+        options.window_bytes = window_bytes;
+        const BulkLoadStats stats = LoadCorpus(search_server, path, options);
+        assert(stats.documents == 5 && search_server.GetDocumentCount() == 5);
+        const vector<string> words = {"alpha"s, "beta"s, "gamma"s, "delta"s, "epsilon"s};
+        for (size_t i = 0; i < words.size(); ++i) {
+            const vector<Document> documents = search_server.FindTopDocuments(words[i]);
+            assert(documents.size() == 1 && documents[0].id == 100 + static_cast<int>(i));
+        }
+        // a '\r' left in the text would make "cat\r" a word of its own
+        assert(search_server.FindTopDocuments("cat"s).size() == 4);
+    }
+
+    // empty ratings give rating 0, CRLF and a missing last line end like above
+    write_file("7\t\tcat\r\n8\t1,2,6\tdog\n9\t-4\trat"s);
+    {
+        SearchServer search_server("and with"s);
+        BulkLoadOptions options;
+        options.format = RecordFormat::TSV;
+        assert(LoadCorpus(search_server, path, options).documents == 3);
+        assert(search_server.FindTopDocuments("cat"s).at(0).id == 7 && search_server.FindTopDocuments("cat"s)[0].rating == 0);
+        assert(search_server.FindTopDocuments("dog"s).at(0).id == 8 && search_server.FindTopDocuments("dog"s)[0].rating == 3);
+        assert(search_server.FindTopDocuments("rat"s).at(0).id == 9 && search_server.FindTopDocuments("rat"s)[0].rating == -4);
+    }
+
+    // the line number counts lines of earlier windows, which stay indexed
+    write_file("1\t\tcat\n2\t5\tdog\n3\tx\trat\n4\t\tbird\n"s);
+    for (const size_t window_bytes : {size_t(4), size_t(64) << 20}) {
+        SearchServer search_server("and with"s);
+        BulkLoadOptions options;
+        options.format = RecordFormat::TSV;
+        options.window_bytes = window_bytes;
+        string message;
+        try {
+            LoadCorpus(search_server, path, options);
+        } catch (const invalid_argument& e) {
+            message = e.what();
+        }
+        assert(message == "malformed record at line 3"s);
+        assert(search_server.GetDocumentCount() == (window_bytes == 4 ? 2 : 0));
+    }
+    remove(path.c_str());
+    cout << "bulk loader records match their lines"s << endl;
+    // bulk loader records match their lines
+
+    return 0;
+}
+
+// numbers and booleans of a json text by their path ("stages.parse.calls", array items by index);
+// Read is false if the text isn't a single well-formed json value
+class JsonReader {
+public:
+    explicit JsonReader(string text)
+            : text_(move(text)) {
+    }
+
+    bool Read() {
+        if (!ReadValue(""s)) {
+            return false;
+        }
+        SkipSpaces();
+        return position_ == text_.size();
+    }
+    const map<string, double>& GetValues() const {
+        return values_;
+    }
+private:
+    void SkipSpaces() {
+        while (position_ < text_.size() && isspace(static_cast<unsigned char>(text_[position_]))) {
+            ++position_;
+        }
+    }
+    bool Accept(char c) {
+        SkipSpaces();
+        if (position_ < text_.size() && text_[position_] == c) {
+            ++position_;
+            return true;
+        }
+        return false;
+    }
+    bool ReadString(string& result) {
+        if (!Accept('"')) {
+            return false;
+        }
+        for (; position_ < text_.size() && text_[position_] != '"'; ++position_) {
+            if (static_cast<unsigned char>(text_[position_]) < 0x20) {
+                return false;
+            }
+            // an escaped character is kept as it is
+            if (text_[position_] == '\\' && ++position_ == text_.size()) {
+                return false;
+            }
+            result += text_[position_];
+        }
+        return Accept('"');
+    }
+    bool ReadValue(const string& path) {
+        SkipSpaces();
+        if (position_ == text_.size()) {
+            return false;
+        }
+        const char c = text_[position_];
+        if (c == '{' || c == '[') {
+            ++position_;
+            const char end = c == '{' ? '}' : ']';
+            if (Accept(end)) {
+                return true;
+            }
+            for (size_t index = 0;; ++index) {
+                string key;
+                if (c == '[') {
+                    key = to_string(index);
+                } else if (!ReadString(key) || !Accept(':')) {
+                    return false;
+                }
+                if (!ReadValue(path.empty() ? key : path + "."s + key)) {
+                    return false;
+                }
+                if (!Accept(',')) {
+                    return Accept(end);
+                }
+            }
+        }
+        if (c == '"') {
+            string value;
+            return ReadString(value);
+        }
+        for (const auto& [literal, value] : {pair{"true"sv, 1.0}, pair{"false"sv, 0.0}, pair{"null"sv, 0.0}}) {
+            if (string_view(text_).substr(position_, literal.size()) == literal) {
+                position_ += literal.size();
+                values_[path] = value;
+                return true;
+            }
+        }
+        if (c != '-' && !isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+        char* end = nullptr;
+        values_[path] = strtod(text_.c_str() + position_, &end);
+        position_ = end - text_.c_str();
+        return true;
+    }
+
+    const string text_;
+    size_t position_ = 0;
+    map<string, double> values_;
+};
+
+// stage counters move only while instrumentation is on, the dump is well-formed json either way;
+// without -DSEARCH_SERVER_INSTRUMENTATION every counter stays zero
+int TestInstrumentation() {
+    assert(JsonReader("{\"a\":[1,{\"b\":-2.5e1}],\"c\":true, \"d\":\"x\\\"y\"}"s).Read());
+    for (const string& malformed : {"{"s, "{\"a\":}"s, "[1,]"s, "{\"a\":1}}"s, "{a:1}"s, "[1 2]"s}) {
+        assert(!JsonReader(malformed).Read());
+    }
+#ifdef SEARCH_SERVER_INSTRUMENTATION
+    const bool is_compiled = true;
+#else
+    const bool is_compiled = false;
+#endif
+    const bool was_enabled = IsInstrumentationEnabled();
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 300);
+    const auto dump_after_queries = [&search_server](bool enabled) {
+        SetInstrumentationEnabled(enabled);
+        ResetInstrumentation();
+        for (const string& query : {"curly cat"s, "nasty rat -dog"s, "common john eyes"s, "c* -do*"s}) {
+            search_server.FindTopDocuments(query);
+        }
+        SetInstrumentationEnabled(false);
+        ostringstream out;
+        DumpInstrumentation(out);
+        JsonReader reader(out.str());
+        assert(reader.Read());
+        return reader.GetValues();
+    };
+
+    const map<string, double> disabled = dump_after_queries(false);
+    assert(disabled.at("compiled"s) == (is_compiled ? 1.0 : 0.0) && disabled.at("enabled"s) == 0.0);
+    for (int stage = 0; stage < static_cast<int>(Stage::STAGE_COUNT); ++stage) {
+        const string name = GetStageName(static_cast<Stage>(stage));
+        assert(disabled.at("stages."s + name + ".calls"s) == 0.0 && disabled.at("stages."s + name + ".items"s) == 0.0);
+    }
+    const map<string, double> enabled = dump_after_queries(true);
+    for (const string& name : {"parse"s, "posting_walk"s, "materialize"s, "top_k"s}) {
+        assert((enabled.at("stages."s + name + ".calls"s) > 0.0) == is_compiled);
+    }
+    assert((enabled.at("stages.posting_walk.items"s) > 0.0) == is_compiled);
+    assert(enabled.at("stages.parse.calls"s) == (is_compiled ? 4.0 : 0.0));
+    SetInstrumentationEnabled(was_enabled);
+    cout << "stage counters "s << (is_compiled ? "recorded"s : "compiled out"s) << endl;
+    // stage counters compiled out (recorded with -DSEARCH_SERVER_INSTRUMENTATION)
+
+    return 0;
+}
+
+#if __cplusplus >= 202002L
+// a coroutine waiting for the server is suspended and its pool thread serves others,
+// a single pool thread doesn't deadlock on a writer waiting for its turn on that thread
+int TestAsyncSearchServer() {
+    ThreadPool pool(1);
+    AsyncSharedMutex mutex(pool);
+    vector<string> events;
+    thread reader_thread;
+    const auto reader = [&]() -> Task<> {
+        co_await pool.Schedule();
+        const auto lock = co_await mutex.LockShared();
+        events.push_back("reader"s);
+    };
+    const auto writer = [&]() -> Task<> {
+        co_await pool.Schedule();
+        const auto lock = co_await mutex.LockExclusive();
+        reader_thread = thread([&] {
+            SyncWait(reader());
+        });
+        // the writer gives the pool thread away until the reader, run on it,
+        // is suspended on the lock held here
+        while (mutex.GetWaiterCount() == 0) {
+            co_await pool.Schedule();
+        }
+        events.push_back("writer"s);
+    };
+    SyncWait(writer());
+    reader_thread.join();
+    assert((events == vector<string>{"writer"s, "reader"s}));
+
+    SearchServer search_server("and with"s);
+    AsyncSearchServer async_server(search_server, 2);
+    // the document is the first one for its own number whatever else is indexed meanwhile
+    const auto add_and_find = [&](int document_id) -> Task<bool> {
+        vector<int> ratings = {document_id};
+        co_await async_server.AddDocument(document_id, "curly cat "s + to_string(document_id), DocumentStatus::ACTUAL, ratings);
+        const PartialResult result = co_await async_server.FindTopDocuments("curly "s + to_string(document_id));
+        co_return !result.documents.empty() && result.documents[0].id == document_id;
+    };
+    vector<thread> clients;
+    atomic<int> found = 0;
+    for (int document_id = 0; document_id < 8; ++document_id) {
+        clients.emplace_back([&, document_id] {
+            found += SyncWait(add_and_find(document_id));
+        });
+    }
+    for (thread& client : clients) {
+        client.join();
+    }
+    assert(search_server.GetDocumentCount() == 8);
+    assert(found == 8);
+    cout << events[0] << " before "s << events[1] << endl;
+    // writer before reader
+
+    return 0;
+}
+#endif
+
+// typo-tolerant terms expand to the nearest indexed words, literal words before the fuzzy index
+int TestFuzzyMatching() {
+    SearchServer literal_server("and with"s);
+    literal_server.AddDocument(1, "cat~ with hair~2"s, DocumentStatus::ACTUAL, {1});
+    assert(literal_server.FindTopDocuments("cat hair~"s).empty());
+    assert(literal_server.FindTopDocuments("cat~ -hair~2"s).empty());
+    assert(literal_server.FindTopDocuments("hair~2"s).size() == 1);
+
+    SearchServer search_server("and with"s);
+    AddGeneratedDocuments(search_server, 500);
+    search_server.EnableFuzzyMatching(2);
+
+    const auto matches = search_server.FindSimilarWords("catt"s, 1);
+    assert(!matches.empty() && matches[0].word == "cat"sv && matches[0].distance == 1);
+    AssertTopOf(search_server.FindTopDocuments("catt~ -tall~"s),
+                ComputeRelevanceByDefinition(search_server, {"cat"s}, {"tail"s}, QueryMode::ANY));
+    AssertTopOf(search_server.FindTopDocuments("haor~2"s),
+                ComputeRelevanceByDefinition(search_server, {"hair"s}, {}, QueryMode::ANY));
+    // a word added after the index is built is found too
+    search_server.AddDocument(1001, "caterpillar"s, DocumentStatus::ACTUAL, {1});
+    assert(search_server.FindTopDocuments("caterpilar~"s).at(0).id == 1001);
+    try {
+        search_server.FindTopDocuments("cat~3"s);
+        assert(false);
+    } catch (const invalid_argument&) {
+    }
+    cout << matches[0].word << " for catt"s << endl;
+    // cat for catt
+
+    return 0;
+}
+
+int main() {
+    Test1();
+    Test2();
+    Test3();
+    Test4();
+    TestFindNextPage();
+    TestExecutionModes();
+    TestFindTopDocumentsBatch();
+    TestAdmissionControl();
+    TestRequestStatistics();
+    TestSearchService();
+    TestImpactIndex();
+    TestDocumentReordering();
+    TestConjunctiveQueries();
+    TestQueryPlanner();
+    TestDurableSearchServer();
+    TestWriteAheadLogFailure();
+    TestPrefixQueries();
+    TestFrozenIndex();
+    TestFuzzyMatching();
+    TestHeadTermCache();
+    TestRemoveDocuments();
+    TestFacets();
+    TestScoringPolicies();
+    TestSimdKernels();
+    TestQueryLogWarmUp();
+    TestNumaReplicatedIndex();
+    TestBulkLoader();
+    TestInstrumentation();
+#if __cplusplus >= 202002L
+    TestAsyncSearchServer();
+#endif
+}
@@ -0,0 +1,156 @@
+#include "warm_up.h"
+#include <algorithm>
+#include <unordered_map>
+#include "adaptive_execution.h"
+#include "simd_kernels.h"
+using namespace std;
+namespace {
+int64_t GetSteadyNanoseconds() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+vector<string> ReadQueryLog(istream& input) {
+    vector<string> queries;
+    for (string line; getline(input, line);) {
+        if (!line.empty()) {
+            queries.push_back(move(line));
+        }
+    }
+    return queries;
+}
+vector<string> SelectHotQueries(const vector<string>& query_log, size_t max_queries) {
+    // query -> (count, first position)
+    unordered_map<string_view, pair<size_t, size_t>> query_counts;
+    for (size_t position = 0; position < query_log.size(); ++position) {
+        ++query_counts.try_emplace(query_log[position], 0, position).first->second.first;
+    }
+    vector<pair<string_view, pair<size_t, size_t>>> ranked(query_counts.begin(), query_counts.end());
+    const auto is_hotter = [](const auto& lhs, const auto& rhs) {
+        return lhs.second.first != rhs.second.first ? lhs.second.first > rhs.second.first : lhs.second.second < rhs.second.second;
+    };
+    if (ranked.size() > max_queries) {
+        nth_element(ranked.begin(), ranked.begin() + max_queries, ranked.end(), is_hotter);
+        ranked.resize(max_queries);
+    }
+    sort(ranked.begin(), ranked.end(), is_hotter);
+    vector<string> hot_queries;
+    hot_queries.reserve(ranked.size());
+    for (const auto& [query, _] : ranked) {
+        hot_queries.emplace_back(query);
+    }
+    return hot_queries;
+}
+
+QueryLogWarmUp::QueryLogWarmUp(const SearchServer& search_server, const vector<string>& query_log, const WarmUpOptions& options)
+        : QueryLogWarmUp([&search_server](const string& query) {
+                             search_server.FindTopDocuments(query);
+                         },
+                         nullptr, query_log, options) {
+}
+QueryLogWarmUp::QueryLogWarmUp(const FrozenIndexView& frozen_index, const vector<string>& query_log, const WarmUpOptions& options)
+        : QueryLogWarmUp([&frozen_index](const string& query) {
+                             frozen_index.FindTopDocuments(query);
+                         },
+                         [&frozen_index](const string& query) {
+                             return frozen_index.Prefetch(query);
+                         },
+                         query_log, options) {
+}
+QueryLogWarmUp::QueryLogWarmUp(function<void(const string&)> replay, function<size_t(const string&)> prefetch,
+                               const vector<string>& query_log, const WarmUpOptions& options)
+        : replay_(move(replay))
+        , prefetch_(move(prefetch))
+        , hot_queries_(SelectHotQueries(query_log, options.max_queries))
+        , thread_count_(max<size_t>(1, options.thread_count)) {
+}
+QueryLogWarmUp::~QueryLogWarmUp() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+void QueryLogWarmUp::Start() {
+    lock_guard lock(mutex_);
+    if (thread_.joinable() || is_ready_) {
+        return;
+    }
+    start_ns_ = GetSteadyNanoseconds();
+    thread_ = thread([this] {
+        Execute();
+    });
+}
+void QueryLogWarmUp::Run() {
+    Start();
+    Wait();
+}
+void QueryLogWarmUp::Wait() {
+    Start();
+    unique_lock lock(mutex_);
+    ready_.wait(lock, [this] {
+        return is_ready_.load();
+    });
+}
+bool QueryLogWarmUp::WaitFor(chrono::milliseconds timeout) {
+    Start();
+    unique_lock lock(mutex_);
+    return ready_.wait_for(lock, timeout, [this] {
+        return is_ready_.load();
+    });
+}
+bool QueryLogWarmUp::IsReady() const {
+    return is_ready_;
+}
+WarmUpProgress QueryLogWarmUp::GetProgress() const {
+    WarmUpProgress progress;
+    progress.total_queries = hot_queries_.size();
+    progress.replayed_queries = replayed_queries_;
+    progress.failed_queries = failed_queries_;
+    progress.prefetched_bytes = prefetched_bytes_;
+    progress.is_ready = is_ready_;
+    const int64_t start_ns = start_ns_;
+    if (start_ns != 0) {
+        const int64_t finish_ns = progress.is_ready ? finish_ns_.load() : GetSteadyNanoseconds();
+        progress.elapsed = chrono::nanoseconds(finish_ns - start_ns);
+    }
+    return progress;
+}
+// read-ahead is issued for all queries before the replay, so the kernel reads pages
+// while workers still fault in the first ones
+void QueryLogWarmUp::Execute() {
+    GetExecutionThresholds();
+    GetSimdLevel();
+    if (prefetch_) {
+        for (const string& query : hot_queries_) {
+            try {
+                prefetched_bytes_ += prefetch_(query);
+            } catch (const exception&) {
+                // the replay counts the query as failed
+            }
+        }
+    }
+    atomic<size_t> next_query{0};
+    const auto replay = [&] {
+        for (size_t query = next_query++; query < hot_queries_.size(); query = next_query++) {
+            try {
+                replay_(hot_queries_[query]);
+            } catch (const exception&) {
+                ++failed_queries_;
+            }
+            ++replayed_queries_;
+        }
+    };
+    vector<thread> workers;
+    for (size_t worker = 1; worker < thread_count_; ++worker) {
+        workers.emplace_back(replay);
+    }
+    replay();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    finish_ns_ = GetSteadyNanoseconds();
+    {
+        lock_guard lock(mutex_);
+        is_ready_ = true;
+    }
+    ready_.notify_all();
+}
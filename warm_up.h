@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frozen_index.h"
+#include "search_server.h"
+// raw queries of a log, one per line, empty lines skipped
+std::vector<std::string> ReadQueryLog(std::istream& input);
+// distinct queries of the log, most frequent first, equally frequent in order of first appearance
+std::vector<std::string> SelectHotQueries(const std::vector<std::string>& query_log, size_t max_queries);
+
+struct WarmUpOptions {
+    // hottest distinct queries replayed
+    size_t max_queries = 10000;
+    size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+};
+struct WarmUpProgress {
+    size_t total_queries = 0;
+    size_t replayed_queries = 0;
+    // replayed queries which threw, bad queries of the log among them
+    size_t failed_queries = 0;
+    // bytes of mapped postings advised to be read ahead, summed over queries
+    size_t prefetched_bytes = 0;
+    bool is_ready = false;
+    std::chrono::nanoseconds elapsed{0};
+};
+
+// replays the hottest queries of a log in parallel before serving: posting lists of hot
+// words are faulted in, lazily built state is built (head term cache, prefix dictionary,
+// calibration of execution thresholds, vector kernel dispatch), and for a frozen index the
+// postings of hot words are read ahead with madvise first.
+// The index has to outlive the warm-up and must not change while it runs
+class QueryLogWarmUp {
+public:
+    QueryLogWarmUp(const SearchServer& search_server, const std::vector<std::string>& query_log,
+                   const WarmUpOptions& options = WarmUpOptions());
+    QueryLogWarmUp(const FrozenIndexView& frozen_index, const std::vector<std::string>& query_log,
+                   const WarmUpOptions& options = WarmUpOptions());
+    QueryLogWarmUp(const QueryLogWarmUp&) = delete;
+    QueryLogWarmUp& operator=(const QueryLogWarmUp&) = delete;
+    // waits for a started warm-up
+    ~QueryLogWarmUp();
+
+    // runs in a background thread, a second call does nothing
+    void Start();
+    // Start and Wait
+    void Run();
+    // both start the warm-up if it isn't started yet, so they never wait for nothing
+    void Wait();
+    // true if the warm-up finished within timeout
+    bool WaitFor(std::chrono::milliseconds timeout);
+    bool IsReady() const;
+    WarmUpProgress GetProgress() const;
+private:
+    QueryLogWarmUp(std::function<void(const std::string&)> replay, std::function<size_t(const std::string&)> prefetch,
+                   const std::vector<std::string>& query_log, const WarmUpOptions& options);
+    void Execute();
+
+    const std::function<void(const std::string&)> replay_;
+    // empty for indexes not backed by a mapping
+    const std::function<size_t(const std::string&)> prefetch_;
+    const std::vector<std::string> hot_queries_;
+    const size_t thread_count_;
+    std::thread thread_;
+    std::atomic<size_t> replayed_queries_{0};
+    std::atomic<size_t> failed_queries_{0};
+    std::atomic<size_t> prefetched_bytes_{0};
+    std::atomic<bool> is_ready_{false};
+    std::atomic<int64_t> start_ns_{0};
+    std::atomic<int64_t> finish_ns_{0};
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+};
@@ -0,0 +1,320 @@
+#include "write_ahead_log.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+namespace {
+const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+// lsn and type
+const size_t PAYLOAD_PREFIX_SIZE = sizeof(uint64_t) + sizeof(uint8_t);
+
+array<uint32_t, 256> MakeCrc32Table() {
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+template <typename T>
+void AppendValue(string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+// cursor over a payload, every read is bounds-checked
+class PayloadReader {
+public:
+    explicit PayloadReader(string_view data)
+            : data_(data) {
+    }
+    template <typename T>
+    bool Read(T& value) {
+        if (data_.size() < sizeof(value)) {
+            return false;
+        }
+        memcpy(&value, data_.data(), sizeof(value));
+        data_.remove_prefix(sizeof(value));
+        return true;
+    }
+    bool ReadText(string& text, size_t size) {
+        if (data_.size() < size) {
+            return false;
+        }
+        text.assign(data_.substr(0, size));
+        data_.remove_prefix(size);
+        return true;
+    }
+    bool IsAtEnd() const {
+        return data_.empty();
+    }
+private:
+    string_view data_;
+};
+bool DecodePayload(string_view payload, WalRecord& record) {
+    PayloadReader reader(payload);
+    uint8_t type;
+    if (!reader.Read(record.lsn) || !reader.Read(type) || !reader.Read(record.document_id)) {
+        return false;
+    }
+    record.type = static_cast<WalRecordType>(type);
+    if (record.type == WalRecordType::REMOVE_DOCUMENT) {
+        return reader.IsAtEnd();
+    }
+    if (record.type != WalRecordType::ADD_DOCUMENT) {
+        return false;
+    }
+    int32_t status;
+    uint32_t rating_count;
+    if (!reader.Read(status) || !reader.Read(rating_count)) {
+        return false;
+    }
+    record.status = static_cast<DocumentStatus>(status);
+    record.ratings.resize(min<size_t>(rating_count, payload.size() / sizeof(int)));
+    if (record.ratings.size() != rating_count) {
+        return false;
+    }
+    for (int& rating : record.ratings) {
+        if (!reader.Read(rating)) {
+            return false;
+        }
+    }
+    uint32_t text_size;
+    return reader.Read(text_size) && reader.ReadText(record.text, text_size) && reader.IsAtEnd();
+}
+bool WriteAll(int fd, string_view data) {
+    while (!data.empty()) {
+        const ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+string ReadFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return string();
+        }
+        throw runtime_error("can't open write-ahead log "s + path);
+    }
+    string data;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0) {
+        data.reserve(static_cast<size_t>(file_stat.st_size));
+    }
+    char buffer[1 << 16];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            throw runtime_error("can't read write-ahead log "s + path);
+        }
+        data.append(buffer, static_cast<size_t>(count));
+    }
+    close(fd);
+    return data;
+}
+}  // namespace
+
+uint32_t ComputeCrc32(string_view data) {
+    static const array<uint32_t, 256> table = MakeCrc32Table();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const char c : data) {
+        crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+WriteAheadLog::WriteAheadLog(const string& path, const WalOptions& options, uint64_t first_lsn)
+        : WriteAheadLog(path, options, first_lsn, Read(path, numeric_limits<uint64_t>::max())) {
+}
+WriteAheadLog::WriteAheadLog(const string& path, const WalOptions& options, uint64_t first_lsn, const WalReadResult& existing)
+        : path_(path)
+        , options_(options) {
+    fd_ = open(path_.c_str(), O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw runtime_error("can't open write-ahead log "s + path_);
+    }
+    if (existing.valid_bytes < existing.file_bytes
+        && (ftruncate(fd_, static_cast<off_t>(existing.valid_bytes)) != 0 || fsync(fd_) != 0)) {
+        close(fd_);
+        throw runtime_error("can't cut torn tail of write-ahead log "s + path_);
+    }
+    last_lsn_ = max(existing.last_lsn, first_lsn - 1);
+    durable_lsn_ = last_lsn_;
+    committer_ = thread([this] {
+        CommitLoop();
+    });
+}
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard lock(mutex_);
+        is_stopping_ = true;
+    }
+    has_pending_.notify_one();
+    committer_.join();
+    close(fd_);
+}
+uint64_t WriteAheadLog::AppendAddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    string payload;
+    payload.reserve(sizeof(int) * (4 + ratings.size()) + document.size());
+    AppendValue(payload, static_cast<uint8_t>(WalRecordType::ADD_DOCUMENT));
+    AppendValue(payload, document_id);
+    AppendValue(payload, static_cast<int32_t>(status));
+    AppendValue(payload, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        AppendValue(payload, rating);
+    }
+    AppendValue(payload, static_cast<uint32_t>(document.size()));
+    payload.append(document);
+    return Append(payload);
+}
+uint64_t WriteAheadLog::AppendRemoveDocument(int document_id) {
+    string payload;
+    AppendValue(payload, static_cast<uint8_t>(WalRecordType::REMOVE_DOCUMENT));
+    AppendValue(payload, document_id);
+    return Append(payload);
+}
+uint64_t WriteAheadLog::Append(const string& payload_without_lsn) {
+    lock_guard lock(mutex_);
+    const uint64_t lsn = ++last_lsn_;
+    const size_t record_start = pending_.size();
+    AppendValue(pending_, static_cast<uint32_t>(sizeof(lsn) + payload_without_lsn.size()));
+    // crc placeholder, filled after the payload is in place
+    AppendValue(pending_, uint32_t{0});
+    AppendValue(pending_, lsn);
+    pending_.append(payload_without_lsn);
+    const uint32_t crc = ComputeCrc32(string_view(pending_).substr(record_start + RECORD_HEADER_SIZE));
+    memcpy(pending_.data() + record_start + sizeof(uint32_t), &crc, sizeof(crc));
+    ++stats_.records;
+    has_pending_.notify_one();
+    return lsn;
+}
+void WriteAheadLog::WaitDurable(uint64_t lsn) {
+    unique_lock lock(mutex_);
+    committed_.wait(lock, [this, lsn] {
+        return durable_lsn_ >= lsn || has_error_;
+    });
+    if (has_error_) {
+        throw runtime_error("can't write write-ahead log "s + path_);
+    }
+}
+uint64_t WriteAheadLog::GetDurableLsn() const {
+    lock_guard lock(mutex_);
+    return durable_lsn_;
+}
+uint64_t WriteAheadLog::GetLastLsn() const {
+    lock_guard lock(mutex_);
+    return last_lsn_;
+}
+void WriteAheadLog::Truncate() {
+    unique_lock lock(mutex_);
+    committed_.wait(lock, [this] {
+        return (durable_lsn_ == last_lsn_ && !is_writing_) || has_error_;
+    });
+    if (has_error_ || ftruncate(fd_, 0) != 0 || fsync(fd_) != 0) {
+        throw runtime_error("can't truncate write-ahead log "s + path_);
+    }
+}
+WalStats WriteAheadLog::GetStats() const {
+    lock_guard lock(mutex_);
+    return stats_;
+}
+void WriteAheadLog::CommitLoop() {
+    unique_lock lock(mutex_);
+    while (true) {
+        has_pending_.wait(lock, [this] {
+            return !pending_.empty() || is_stopping_;
+        });
+        if (pending_.empty()) {
+            return;
+        }
+        // after a failed write the file may end with a torn group, nothing is written after it
+        if (has_error_) {
+            pending_.clear();
+            continue;
+        }
+        // records appended while this group is being synced form the next group
+        string group;
+        group.swap(pending_);
+        const uint64_t group_lsn = last_lsn_;
+        is_writing_ = true;
+        lock.unlock();
+        const bool is_written = WriteAll(fd_, group) && (!options_.sync || fdatasync(fd_) == 0);
+        lock.lock();
+        is_writing_ = false;
+        if (is_written) {
+            durable_lsn_ = group_lsn;
+            ++stats_.commits;
+            stats_.bytes += group.size();
+        } else {
+            has_error_ = true;
+        }
+        committed_.notify_all();
+    }
+}
+WalReadResult WriteAheadLog::Read(const string& path, uint64_t after_lsn) {
+    const string data = ReadFile(path);
+    WalReadResult result;
+    result.file_bytes = data.size();
+    // framing is sequential, checking and decoding of records is not
+    vector<string_view> payloads;
+    size_t position = 0;
+    while (data.size() - position >= RECORD_HEADER_SIZE) {
+        uint32_t size;
+        memcpy(&size, data.data() + position, sizeof(size));
+        if (size < PAYLOAD_PREFIX_SIZE || data.size() - position - RECORD_HEADER_SIZE < size) {
+            break;
+        }
+        payloads.push_back(string_view(data).substr(position + RECORD_HEADER_SIZE, size));
+        position += RECORD_HEADER_SIZE + size;
+    }
+    vector<WalRecord> records(payloads.size());
+    vector<char> is_valid(payloads.size(), false);
+    vector<size_t> indexes(payloads.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        const char* header = payloads[i].data() - RECORD_HEADER_SIZE;
+        uint32_t crc;
+        memcpy(&crc, header + sizeof(uint32_t), sizeof(crc));
+        if (crc != ComputeCrc32(payloads[i])) {
+            return;
+        }
+        uint64_t lsn;
+        memcpy(&lsn, payloads[i].data(), sizeof(lsn));
+        if (lsn <= after_lsn) {
+            records[i].lsn = lsn;
+            is_valid[i] = true;
+        } else {
+            is_valid[i] = DecodePayload(payloads[i], records[i]);
+        }
+    });
+    // everything after the first bad record is a torn tail
+    const size_t valid_count = static_cast<size_t>(find(is_valid.begin(), is_valid.end(), false) - is_valid.begin());
+    result.valid_bytes = valid_count == 0 ? 0 : static_cast<uint64_t>(payloads[valid_count - 1].data() + payloads[valid_count - 1].size() - data.data());
+    result.last_lsn = valid_count == 0 ? 0 : records[valid_count - 1].lsn;
+    for (size_t i = 0; i < valid_count; ++i) {
+        if (records[i].lsn > after_lsn) {
+            result.records.push_back(move(records[i]));
+        }
+    }
+    return result;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "document.h"
+enum class WalRecordType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+};
+struct WalRecord {
+    uint64_t lsn = 0;
+    WalRecordType type = WalRecordType::ADD_DOCUMENT;
+    int document_id = 0;
+    // ADD_DOCUMENT only
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string text;
+};
+struct WalOptions {
+    // fdatasync after every group of records, without it records survive a process crash only
+    bool sync = true;
+};
+struct WalStats {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    // group commits written to the file
+    uint64_t commits = 0;
+};
+struct WalReadResult {
+    std::vector<WalRecord> records;
+    // size of the valid prefix, a torn or corrupted tail starts here
+    uint64_t valid_bytes = 0;
+    uint64_t file_bytes = 0;
+    // lsn of the last valid record, 0 for an empty log
+    uint64_t last_lsn = 0;
+};
+// append-only log of index mutations
+// record: <payload size u32><crc32 of payload u32><payload>, payload starts with lsn and type
+// Appends only copy the record into a buffer; a background thread writes everything buffered
+// and syncs it with one fdatasync (group commit), so concurrent writers share syncs
+class WriteAheadLog {
+public:
+    // opens or creates the log, a torn tail left by a crash is cut off,
+    // numbering continues after first_lsn or the last record in the file
+    explicit WriteAheadLog(const std::string& path, const WalOptions& options = WalOptions(), uint64_t first_lsn = 1);
+    // same with the result of Read of the file just before, so the file is not read again
+    WriteAheadLog(const std::string& path, const WalOptions& options, uint64_t first_lsn, const WalReadResult& existing);
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    // everything appended is committed before the file is closed
+    ~WriteAheadLog();
+
+    // return lsn of the record, it is durable once WaitDurable(lsn) returns
+    uint64_t AppendAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    uint64_t AppendRemoveDocument(int document_id);
+    // throws runtime_error once any write failed: records after a torn group are
+    // dropped, so the durable lsn stays where the first failure left it
+    void WaitDurable(uint64_t lsn);
+    uint64_t GetDurableLsn() const;
+    uint64_t GetLastLsn() const;
+    // waits for appended records and empties the file, lsn numbering goes on
+    void Truncate();
+    WalStats GetStats() const;
+
+    // records of the file with lsn greater than after_lsn, decoded and checked in parallel
+    static WalReadResult Read(const std::string& path, uint64_t after_lsn = 0);
+private:
+    uint64_t Append(const std::string& payload_without_lsn);
+    void CommitLoop();
+
+    const std::string path_;
+    const WalOptions options_;
+    int fd_ = -1;
+    mutable std::mutex mutex_;
+    std::condition_variable has_pending_;
+    std::condition_variable committed_;
+    std::string pending_;
+    uint64_t last_lsn_ = 0;
+    uint64_t durable_lsn_ = 0;
+    bool is_writing_ = false;
+    bool is_stopping_ = false;
+    bool has_error_ = false;
+    WalStats stats_;
+    std::thread committer_;
+};
+uint32_t ComputeCrc32(std::string_view data);